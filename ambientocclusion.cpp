@@ -0,0 +1,80 @@
+#include "ambientocclusion.hpp"
+
+#include <cmath>
+#include <cppitertools/itertools.hpp>
+#include <glm/geometric.hpp>
+#include <numbers>
+
+#include "threadpool.hpp"
+
+namespace {
+
+// Vertices per chunk handed out by the scheduler
+constexpr std::size_t grainSize{256};
+
+// Rotates the ray pattern per vertex, so that neighbors don't share the
+// same blind spots
+float hashAngle(std::uint32_t value) {
+  value ^= value >> 16;
+  value *= 0x7feb352dU;
+  value ^= value >> 15;
+  value *= 0x846ca68bU;
+  value ^= value >> 16;
+  return static_cast<float>(value) * (2.0f * std::numbers::pi_v<float> /
+                                      4294967296.0f);
+}
+
+}  // namespace
+
+std::vector<std::uint8_t> bakeAmbientOcclusion(std::span<const Vertex> vertices,
+                                               const MeshBvh& bvh,
+                                               float maxDistance,
+                                               ThreadPool& pool,
+                                               std::size_t numRays) {
+  std::vector<std::uint8_t> occlusion(vertices.size(), 255);
+  if (bvh.empty() || numRays == 0 || maxDistance <= 0.0f) return occlusion;
+
+  // Rays start a little off the surface, so they don't hit it right away
+  const auto bias{maxDistance * 1e-3f};
+  const auto goldenAngle{std::numbers::pi_v<float> *
+                         (3.0f - std::sqrt(5.0f))};
+
+  pool.parallelForStealing(
+      vertices.size(), grainSize, [&](std::size_t begin, std::size_t end) {
+        for (const auto index : iter::range(begin, end)) {
+          const auto& vertex{vertices[index]};
+          const auto length{glm::length(vertex.normal)};
+          if (length == 0.0f) continue;
+          const auto normal{vertex.normal / length};
+
+          // Orthonormal basis around the normal (Duff et al. 2017)
+          const auto sign{std::copysign(1.0f, normal.z)};
+          const auto a{-1.0f / (sign + normal.z)};
+          const auto b{normal.x * normal.y * a};
+          const glm::vec3 tangent{1.0f + sign * normal.x * normal.x * a,
+                                  sign * b, -sign * normal.x};
+          const glm::vec3 bitangent{b, sign + normal.y * normal.y * a,
+                                    -normal.y};
+
+          // Cosine-weighted spiral over the hemisphere
+          const auto origin{vertex.position + normal * bias};
+          const auto rotation{hashAngle(static_cast<std::uint32_t>(index))};
+          std::size_t numOpen{};
+          for (const auto ray : iter::range(numRays)) {
+            const auto u{(static_cast<float>(ray) + 0.5f) /
+                         static_cast<float>(numRays)};
+            const auto radius{std::sqrt(u)};
+            const auto angle{rotation +
+                             goldenAngle * static_cast<float>(ray)};
+            const auto direction{tangent * (radius * std::cos(angle)) +
+                                 bitangent * (radius * std::sin(angle)) +
+                                 normal * std::sqrt(1.0f - u)};
+            if (!bvh.isOccluded(origin, direction, maxDistance)) ++numOpen;
+          }
+          occlusion[index] = static_cast<std::uint8_t>(std::lround(
+              255.0f * static_cast<float>(numOpen) /
+              static_cast<float>(numRays)));
+        }
+      });
+  return occlusion;
+}
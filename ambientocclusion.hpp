@@ -0,0 +1,24 @@
+#ifndef AMBIENTOCCLUSION_HPP_
+#define AMBIENTOCCLUSION_HPP_
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "meshbvh.hpp"
+#include "vertex.hpp"
+
+class ThreadPool;
+
+// Bakes how open the hemisphere around each vertex normal is: the share
+// of numRays cosine-weighted rays that travel maxDistance without hitting
+// the mesh, as unorm8 (255 is fully open). Vertices without a normal are
+// left open. Enclosed areas cost far more rays than open ones, so vertices
+// are spread over the pool with work stealing.
+std::vector<std::uint8_t> bakeAmbientOcclusion(std::span<const Vertex> vertices,
+                                               const MeshBvh& bvh,
+                                               float maxDistance,
+                                               ThreadPool& pool,
+                                               std::size_t numRays = 32);
+
+#endif
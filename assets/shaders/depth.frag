@@ -0,0 +1,5 @@
+#version 410
+
+// The target has no color attachment; only depth is written
+
+void main() {}
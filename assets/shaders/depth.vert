@@ -0,0 +1,23 @@
+#version 410
+
+// Depth-only pass for occlusion culling; same positions as texture.vert
+
+layout(location = 0) in vec3 inPosition;
+
+layout(std140) uniform FrameData {
+  mat4 viewMatrix;
+  mat4 projMatrix;
+  vec4 lightDirWorldSpace;
+  vec4 Ia, Id, Is;
+};
+
+layout(std140) uniform ObjectData {
+  mat4 modelMatrix;
+  mat4 vertexMatrix;  // Stored positions to object space
+  mat4 normalMatrix;
+};
+
+void main() {
+  vec4 PObj = vertexMatrix * vec4(inPosition, 1.0);
+  gl_Position = projMatrix * viewMatrix * modelMatrix * PObj;
+}
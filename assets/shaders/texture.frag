@@ -1,30 +1,44 @@
 #version 410
 
+// Variants, one of: MAPPING_TRIPLANAR, MAPPING_CYLINDRICAL,
+// MAPPING_SPHERICAL, MAPPING_MESH (the default)
+
 in vec3 fragN;
 in vec3 fragL;
 in vec3 fragV;
 in vec2 fragTexCoord;
 in vec3 fragPObj;
 in vec3 fragNObj;
-
-// Light properties
-uniform vec4 Ia, Id, Is;
-
-// Material properties
-uniform vec4 Ka, Kd, Ks;
-uniform float shininess;
-
-// Diffuse texture sampler
-uniform sampler2D diffuseTex;
-
-// Mapping mode
-// 0: triplanar; 1: cylindrical; 2: spherical; 3: from mesh
-uniform int mappingMode;
+in float fragOcclusion;
+flat in uint fragMaterial;
+
+// Camera and light, shared by every object drawn in a frame
+layout(std140) uniform FrameData {
+  mat4 viewMatrix;
+  mat4 projMatrix;
+  vec4 lightDirWorldSpace;
+  vec4 Ia, Id, Is;
+};
+
+// Material properties, with the layer of the diffuse texture array (-1 for
+// none)
+struct Material {
+  vec4 Ka, Kd, Ks;
+  float shininess;
+  int diffuseLayer;
+};
+
+// Every material a draw may use (materialsPerBlock), selected per vertex
+layout(std140) uniform MaterialData {
+  Material materials[256];
+};
+
+uniform sampler2DArray diffuseTex;
 
 out vec4 outColor;
 
 // Blinn-Phong reflection model
-vec4 BlinnPhong(vec3 N, vec3 L, vec3 V, vec2 texCoord) {
+vec4 BlinnPhong(vec3 N, vec3 L, vec3 V, vec4 map_Kd, Material material) {
   N = normalize(N);
   L = normalize(L);
 
@@ -37,26 +51,32 @@ vec4 BlinnPhong(vec3 N, vec3 L, vec3 V, vec2 texCoord) {
     V = normalize(V);
     vec3 H = normalize(L + V);
     float angle = max(dot(H, N), 0.0);
-    specular = pow(angle, shininess);
+    specular = pow(angle, material.shininess);
   }
 
-  vec4 map_Kd = texture(diffuseTex, texCoord);
   vec4 map_Ka = map_Kd;
 
-  vec4 diffuseColor = map_Kd * Kd * Id * lambertian;
-  vec4 specularColor = Ks * Is * specular;
-  vec4 ambientColor = map_Ka * Ka * Ia;
+  vec4 diffuseColor = map_Kd * material.Kd * Id * lambertian;
+  vec4 specularColor = material.Ks * Is * specular;
+  // Only the ambient term is occluded; the light has its own direction
+  vec4 ambientColor = map_Ka * material.Ka * Ia * fragOcclusion;
 
   return ambientColor + diffuseColor + specularColor;
 }
 
+vec4 SampleDiffuse(vec2 texCoord, int layer) {
+  return layer < 0 ? vec4(1.0)
+                   : texture(diffuseTex, vec3(texCoord, float(layer)));
+}
+
+#define PI 3.14159265358979323846
+
+#if defined(MAPPING_TRIPLANAR)
 // Planar mapping
 vec2 PlanarMappingX(vec3 P) { return vec2(1.0 - P.z, P.y); }
 vec2 PlanarMappingY(vec3 P) { return vec2(P.x, 1.0 - P.z); }
 vec2 PlanarMappingZ(vec3 P) { return P.xy; }
-
-#define PI 3.14159265358979323846
-
+#elif defined(MAPPING_CYLINDRICAL)
 // Cylindrical mapping
 vec2 CylindricalMapping(vec3 P) {
   float longitude = atan(P.x, P.z);
@@ -67,7 +87,7 @@ vec2 CylindricalMapping(vec3 P) {
 
   return vec2(u, v);
 }
-
+#elif defined(MAPPING_SPHERICAL)
 // Spherical mapping
 vec2 SphericalMapping(vec3 P) {
   float longitude = atan(P.x, P.z);
@@ -78,45 +98,31 @@ vec2 SphericalMapping(vec3 P) {
 
   return vec2(u, v);
 }
+#endif
 
 void main() {
-  vec4 color;
-
-  if (mappingMode == 0) {
-    // Triplanar mapping
-
-    // A offset to center the texture around the origin
-    vec3 offset = vec3(-0.5, -0.5, -0.5);
-
-    // Sample with x planar mapping
-    vec2 texCoord1 = PlanarMappingX(fragPObj + offset);
-    vec4 color1 = BlinnPhong(fragN, fragL, fragV, texCoord1);
-
-    // Sample with y planar mapping
-    vec2 texCoord2 = PlanarMappingY(fragPObj + offset);
-    vec4 color2 = BlinnPhong(fragN, fragL, fragV, texCoord2);
-
-    // Sample with z planar mapping
-    vec2 texCoord3 = PlanarMappingZ(fragPObj + offset);
-    vec4 color3 = BlinnPhong(fragN, fragL, fragV, texCoord3);
-
-    // Compute average based on normal
-    vec3 weight = abs(normalize(fragNObj));
-    color = color1 * weight.x + color2 * weight.y + color3 * weight.z;
-  } else {
-    vec2 texCoord;
-    if (mappingMode == 1) {
-      // Cylindrical mapping
-      texCoord = CylindricalMapping(fragPObj);
-    } else if (mappingMode == 2) {
-      // Spherical mapping
-      texCoord = SphericalMapping(fragPObj);
-    } else if (mappingMode == 3) {
-      // From mesh
-      texCoord = fragTexCoord;
-    }
-    color = BlinnPhong(fragN, fragL, fragV, texCoord);
-  }
+  Material material = materials[fragMaterial];
+  int layer = material.diffuseLayer;
+
+#if defined(MAPPING_TRIPLANAR)
+  // A offset to center the texture around the origin
+  vec3 P = fragPObj + vec3(-0.5, -0.5, -0.5);
+
+  // Blend the three planar samples by the normal, then light once
+  vec3 weight = abs(normalize(fragNObj));
+  weight /= weight.x + weight.y + weight.z;
+  vec4 map_Kd = SampleDiffuse(PlanarMappingX(P), layer) * weight.x +
+                SampleDiffuse(PlanarMappingY(P), layer) * weight.y +
+                SampleDiffuse(PlanarMappingZ(P), layer) * weight.z;
+#elif defined(MAPPING_CYLINDRICAL)
+  vec4 map_Kd = SampleDiffuse(CylindricalMapping(fragPObj), layer);
+#elif defined(MAPPING_SPHERICAL)
+  vec4 map_Kd = SampleDiffuse(SphericalMapping(fragPObj), layer);
+#else
+  vec4 map_Kd = SampleDiffuse(fragTexCoord, layer);
+#endif
+
+  vec4 color = BlinnPhong(fragN, fragL, fragV, map_Kd, material);
 
   if (gl_FrontFacing) {
     outColor = color;
@@ -1,15 +1,27 @@
 #version 410
 
+// Variants: OCTAHEDRAL_NORMALS when inNormal holds an octahedral-encoded
+// normal in xy
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in float inOcclusion;  // Baked, 1 where fully open
+layout(location = 4) in uint inMaterial;    // Index into MaterialData
 
-uniform mat4 modelMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projMatrix;
-uniform mat3 normalMatrix;
+// Camera and light, shared by every object drawn in a frame
+layout(std140) uniform FrameData {
+  mat4 viewMatrix;
+  mat4 projMatrix;
+  vec4 lightDirWorldSpace;
+  vec4 Ia, Id, Is;
+};
 
-uniform vec4 lightDirWorldSpace;
+layout(std140) uniform ObjectData {
+  mat4 modelMatrix;
+  mat4 vertexMatrix;  // Stored positions to object space
+  mat4 normalMatrix;  // Upper 3x3 is used
+};
 
 out vec3 fragV;
 out vec3 fragL;
@@ -17,18 +29,40 @@ out vec3 fragN;
 out vec2 fragTexCoord;
 out vec3 fragPObj;
 out vec3 fragNObj;
+out float fragOcclusion;
+flat out uint fragMaterial;
+
+#if defined(OCTAHEDRAL_NORMALS)
+vec3 decodeOctahedral(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0.0) {
+    vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    n.xy = (1.0 - abs(n.yx)) * signs;
+  }
+  return normalize(n);
+}
+#endif
 
 void main() {
-  vec3 P = (viewMatrix * modelMatrix * vec4(inPosition, 1.0)).xyz;
-  vec3 N = normalMatrix * inNormal;
+#if defined(OCTAHEDRAL_NORMALS)
+  vec3 normal = decodeOctahedral(inNormal.xy);
+#else
+  vec3 normal = inNormal;
+#endif
+
+  vec4 PObj = vertexMatrix * vec4(inPosition, 1.0);
+  vec3 P = (viewMatrix * modelMatrix * PObj).xyz;
+  vec3 N = mat3(normalMatrix) * normal;
   vec3 L = -(viewMatrix * lightDirWorldSpace).xyz;
 
   fragL = L;
   fragV = -P;
   fragN = N;
   fragTexCoord = inTexCoord;
-  fragPObj = inPosition;
-  fragNObj = inNormal;
+  fragPObj = PObj.xyz;
+  fragNObj = normal;
+  fragOcclusion = inOcclusion;
+  fragMaterial = inMaterial;
 
   gl_Position = projMatrix * vec4(P, 1.0);
 }
@@ -0,0 +1,86 @@
+// Reports the post-transform cache efficiency of a mesh's index buffer
+// before and after the reordering done by Model::loadObj, without a GPU.
+// Fails if the reordering makes the ACMR worse.
+//
+// Usage: meshoptimize-bench [file.obj] [cache size]
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cppitertools/itertools.hpp>
+#include <filesystem>
+
+#include "abcg.hpp"
+#include "meshcluster.hpp"
+#include "meshoptimize.hpp"
+#include "objparser.hpp"
+#include "threadpool.hpp"
+#include "vertexwelder.hpp"
+
+int main(int argc, char** argv) {
+  try {
+    const std::string path{argc > 1 ? argv[1]
+                                    : "assets/hintze-hall-1m.obj"};
+    const std::size_t cacheSize{
+        argc > 2 ? static_cast<std::size_t>(std::max(3, std::atoi(argv[2])))
+                 : 16};
+    const auto basePath{std::filesystem::path{path}.parent_path().string()};
+
+    ThreadPool pool;
+    const auto data{parseObj(path, basePath, pool)};
+
+    std::vector<Vertex> corners(data.indices.size());
+    for (const auto i : iter::range(corners.size())) {
+      const auto& index{data.indices[i]};
+      const auto& attrib{data.attrib};
+      auto& vertex{corners[i]};
+      vertex.position = {attrib.vertices[3 * index.vertex_index + 0],
+                         attrib.vertices[3 * index.vertex_index + 1],
+                         attrib.vertices[3 * index.vertex_index + 2]};
+      if (index.normal_index >= 0) {
+        vertex.normal = {attrib.normals[3 * index.normal_index + 0],
+                         attrib.normals[3 * index.normal_index + 1],
+                         attrib.normals[3 * index.normal_index + 2]};
+      }
+      if (index.texcoord_index >= 0) {
+        vertex.texCoord = {attrib.texcoords[2 * index.texcoord_index + 0],
+                           attrib.texcoords[2 * index.texcoord_index + 1]};
+      }
+    }
+
+    std::vector<Vertex> vertices;
+    std::vector<std::uint32_t> indices;
+    VertexWelder{}.weld(corners, vertices, indices, pool);
+    const auto clusters{buildClusters(vertices, indices)};
+
+    fmt::print("{}: {} vertices, {} triangles, {} clusters\n", path,
+               vertices.size(), indices.size() / 3, clusters.size());
+
+    const auto before{analyzeVertexCache(indices, cacheSize)};
+
+    const auto start{std::chrono::steady_clock::now()};
+    pool.parallelFor(clusters.size(), [&](std::size_t cluster) {
+      const auto range{std::span{indices}.subspan(
+          clusters[cluster].firstIndex, clusters[cluster].indexCount)};
+      optimizeVertexCache(range);
+      optimizeOverdraw(range, vertices);
+    });
+    optimizeVertexFetch(vertices, indices);
+    const std::chrono::duration<double> elapsed{
+        std::chrono::steady_clock::now() - start};
+
+    const auto after{analyzeVertexCache(indices, cacheSize)};
+
+    fmt::print("FIFO cache of {} vertices\n", cacheSize);
+    fmt::print("{:>8} {:>8} {:>8}\n", "", "ACMR", "ATVR");
+    fmt::print("{:>8} {:>8.3f} {:>8.3f}\n", "before", before.acmr, before.atvr);
+    fmt::print("{:>8} {:>8.3f} {:>8.3f}\n", "after", after.acmr, after.atvr);
+    fmt::print("Reordered in {:.3f} s\n", elapsed.count());
+
+    return after.acmr <= before.acmr ? 0 : 1;
+  } catch (const std::exception& exception) {
+    fmt::print(stderr, "{}\n", exception.what());
+    return -1;
+  }
+}
@@ -0,0 +1,320 @@
+// Google Benchmark suite for the CPU side of model loading, on synthetic
+// height field meshes of 10K to 10M triangles. Needs no GL context.
+//
+// Usage: model-bench [--benchmark_filter=<regex>] [other benchmark flags]
+
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+
+#include <cmath>
+#include <cppitertools/itertools.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+
+#include "ambientocclusion.hpp"
+#include "meshbvh.hpp"
+#include "meshcache.hpp"
+#include "meshcluster.hpp"
+#include "meshgeometry.hpp"
+#include "model.hpp"
+#include "potentiallyvisible.hpp"
+#include "threadpool.hpp"
+#include "vertexwelder.hpp"
+
+namespace {
+
+constexpr std::int64_t minTriangles{10'000};
+constexpr std::int64_t maxTriangles{10'000'000};
+
+// Square grid with about numTriangles triangles, displaced by a wave so
+// that its normals vary
+struct Grid {
+  std::vector<Vertex> vertices;
+  std::vector<std::uint32_t> indices;
+};
+
+Grid makeGrid(std::int64_t numTriangles) {
+  const auto side{static_cast<std::uint32_t>(
+      std::max(1.0, std::sqrt(static_cast<double>(numTriangles) / 2.0)))};
+
+  Grid grid;
+  grid.vertices.reserve(std::size_t{side + 1} * (side + 1));
+  for (const auto row : iter::range(side + 1)) {
+    for (const auto column : iter::range(side + 1)) {
+      const glm::vec2 texCoord{static_cast<float>(column) / side,
+                               static_cast<float>(row) / side};
+      const auto height{0.05f * std::sin(20.0f * texCoord.x) *
+                        std::cos(20.0f * texCoord.y)};
+      grid.vertices.push_back(
+          {{texCoord.x, height, texCoord.y}, {}, texCoord});
+    }
+  }
+
+  grid.indices.reserve(std::size_t{6} * side * side);
+  for (const auto row : iter::range(side)) {
+    for (const auto column : iter::range(side)) {
+      const auto corner{row * (side + 1) + column};
+      for (const auto offset :
+           {0U, side + 1, 1U, 1U, side + 1, side + 2}) {
+        grid.indices.push_back(corner + offset);
+      }
+    }
+  }
+  return grid;
+}
+
+// OBJ file of the grid, written once per size and reused by later runs
+std::string gridObjPath(std::int64_t numTriangles) {
+  const auto directory{std::filesystem::temp_directory_path() /
+                       "model-bench"};
+  std::filesystem::create_directories(directory);
+  const auto path{
+      (directory / fmt::format("grid-{}.obj", numTriangles)).string()};
+  if (std::filesystem::exists(path)) return path;
+
+  const auto grid{makeGrid(numTriangles)};
+  fmt::memory_buffer buffer;
+  for (const auto& vertex : grid.vertices) {
+    fmt::format_to(std::back_inserter(buffer), "v {} {} {}\nvt {} {}\n",
+                   vertex.position.x, vertex.position.y, vertex.position.z,
+                   vertex.texCoord.x, vertex.texCoord.y);
+  }
+  for (const auto offset : iter::range<std::size_t>(0, grid.indices.size(),
+                                                    3)) {
+    const auto a{grid.indices[offset + 0] + 1};
+    const auto b{grid.indices[offset + 1] + 1};
+    const auto c{grid.indices[offset + 2] + 1};
+    fmt::format_to(std::back_inserter(buffer), "f {}/{} {}/{} {}/{}\n", a, a,
+                   b, b, c, c);
+  }
+
+  // Written under another name first so an interrupted run leaves no
+  // truncated file behind
+  const auto partialPath{path + ".partial"};
+  {
+    std::ofstream stream{partialPath, std::ios::binary};
+    stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+  }
+  std::filesystem::rename(partialPath, path);
+  return path;
+}
+
+void setTriangleCounters(benchmark::State& state, std::size_t numTriangles) {
+  state.counters["triangles"] = static_cast<double>(numTriangles);
+  state.counters["triangles/s"] =
+      benchmark::Counter(static_cast<double>(numTriangles),
+                         benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// Model::processObj from the OBJ file, i.e. Model::loadObj without the GL
+// upload: parsing, welding, normals, clusters, LODs, reordering and the
+// cache write
+void BM_ProcessObj(benchmark::State& state) {
+  const auto path{gridObjPath(state.range(0))};
+  ThreadPool pool;
+  std::size_t numTriangles{};
+  for ([[maybe_unused]] auto _ : state) {
+    state.PauseTiming();
+    std::filesystem::remove(meshCachePath(path));
+    auto model{std::make_unique<Model>(pool)};
+    state.ResumeTiming();
+
+    model->processObj(path);
+    numTriangles = static_cast<std::size_t>(model->getNumTriangles());
+
+    state.PauseTiming();
+    model.reset();
+    state.ResumeTiming();
+  }
+  setTriangleCounters(state, numTriangles);
+}
+
+// Model::processObj when the mesh cache is valid
+void BM_ProcessObjCached(benchmark::State& state) {
+  const auto path{gridObjPath(state.range(0))};
+  ThreadPool pool;
+  {
+    Model model{pool};
+    model.processObj(path);
+  }
+  for ([[maybe_unused]] auto _ : state) {
+    Model model{pool};
+    model.processObj(path);
+    benchmark::DoNotOptimize(model.getNumTriangles());
+  }
+}
+
+void BM_WeldVertices(benchmark::State& state) {
+  const auto grid{makeGrid(state.range(0))};
+  std::vector<Vertex> corners;
+  corners.reserve(grid.indices.size());
+  for (const auto index : grid.indices) corners.push_back(grid.vertices[index]);
+
+  ThreadPool pool;
+  const VertexWelder welder;
+  std::vector<Vertex> vertices;
+  std::vector<std::uint32_t> indices;
+  for ([[maybe_unused]] auto _ : state) {
+    if (state.range(1) != 0) {
+      welder.weld(corners, vertices, indices, pool);
+    } else {
+      welder.weld(corners, vertices, indices);
+    }
+    benchmark::DoNotOptimize(vertices.data());
+    benchmark::DoNotOptimize(indices.data());
+  }
+  setTriangleCounters(state, grid.indices.size() / 3);
+}
+
+void BM_ComputeVertexNormals(benchmark::State& state) {
+  auto grid{makeGrid(state.range(0))};
+  const auto weighting{state.range(2) != 0 ? NormalWeighting::Angle
+                                           : NormalWeighting::Area};
+  ThreadPool pool;
+  for ([[maybe_unused]] auto _ : state) {
+    if (state.range(1) != 0) {
+      computeVertexNormals(grid.vertices, grid.indices, pool, weighting);
+    } else {
+      computeVertexNormals(grid.vertices, grid.indices, weighting);
+    }
+    benchmark::DoNotOptimize(grid.vertices.data());
+  }
+  setTriangleCounters(state, grid.indices.size() / 3);
+}
+
+void BM_ComputeBounds(benchmark::State& state) {
+  const auto grid{makeGrid(state.range(0))};
+  ThreadPool pool;
+  for ([[maybe_unused]] auto _ : state) {
+    benchmark::DoNotOptimize(computeBounds(grid.vertices, pool));
+  }
+  setTriangleCounters(state, grid.indices.size() / 3);
+}
+
+void BM_BuildBvh(benchmark::State& state) {
+  const auto grid{makeGrid(state.range(0))};
+  MeshBvh bvh;
+  for ([[maybe_unused]] auto _ : state) {
+    bvh.build(grid.vertices, grid.indices);
+    benchmark::DoNotOptimize(bvh.getNodes().data());
+  }
+  setTriangleCounters(state, grid.indices.size() / 3);
+}
+
+// One camera step: a sphere skimming the waves, as if walking on them
+void BM_SlideSphere(benchmark::State& state) {
+  const auto grid{makeGrid(state.range(0))};
+  MeshBvh bvh;
+  bvh.build(grid.vertices, grid.indices);
+  constexpr auto radius{0.01f};
+  glm::vec3 position{0.5f, 0.06f, 0.5f};
+  for ([[maybe_unused]] auto _ : state) {
+    position = bvh.slideSphere(
+        position, position + glm::vec3{0.001f, -0.0005f, 0.0005f}, radius);
+    if (position.x > 0.9f) position = {0.1f, 0.06f, 0.1f};
+    benchmark::DoNotOptimize(position);
+  }
+}
+
+// One pick: a ray cast at a grazing angle across the waves
+void BM_Raycast(benchmark::State& state) {
+  const auto grid{makeGrid(state.range(0))};
+  MeshBvh bvh;
+  bvh.build(grid.vertices, grid.indices);
+  RayHit hit;
+  auto offset{0.0f};
+  for ([[maybe_unused]] auto _ : state) {
+    const glm::vec3 origin{0.0f, 0.2f, offset};
+    benchmark::DoNotOptimize(
+        bvh.raycast(origin, glm::vec3{1.0f, -0.3f, 0.5f}, 1.0f, hit));
+    offset = offset < 0.5f ? offset + 0.001f : 0.0f;
+  }
+}
+
+void BM_BakeAmbientOcclusion(benchmark::State& state) {
+  auto grid{makeGrid(state.range(0))};
+  ThreadPool pool;
+  computeVertexNormals(grid.vertices, grid.indices, pool);
+  MeshBvh bvh;
+  bvh.build(grid.vertices, grid.indices);
+  for ([[maybe_unused]] auto _ : state) {
+    benchmark::DoNotOptimize(
+        bakeAmbientOcclusion(grid.vertices, bvh, 0.05f, pool));
+  }
+  setTriangleCounters(state, grid.indices.size() / 3);
+}
+
+void BM_BakeVisibilitySets(benchmark::State& state) {
+  auto grid{makeGrid(state.range(0))};
+  ThreadPool pool;
+  const auto clusters{buildClusters(grid.vertices, grid.indices)};
+  const auto bounds{computeBounds(grid.vertices, pool)};
+  MeshBvh bvh;
+  bvh.build(grid.vertices, grid.indices);
+  PotentiallyVisibleSets sets;
+  for ([[maybe_unused]] auto _ : state) {
+    sets.bake(grid.vertices, grid.indices, clusters, bvh, bounds, pool);
+    benchmark::DoNotOptimize(sets.getSets().data());
+  }
+  setTriangleCounters(state, grid.indices.size() / 3);
+  state.counters["sets"] = static_cast<double>(
+      sets.getSets().size() / sets.getGrid().wordsPerSet);
+}
+
+}  // namespace
+
+BENCHMARK(BM_ProcessObj)
+    ->RangeMultiplier(10)
+    ->Range(minTriangles, maxTriangles)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_ProcessObjCached)
+    ->RangeMultiplier(10)
+    ->Range(minTriangles, maxTriangles)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_WeldVertices)
+    ->ArgsProduct({benchmark::CreateRange(minTriangles, maxTriangles, 10),
+                   {0, 1}})
+    ->ArgNames({"triangles", "pool"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_ComputeVertexNormals)
+    ->ArgsProduct({benchmark::CreateRange(minTriangles, maxTriangles, 10),
+                   {0, 1},
+                   {0, 1}})
+    ->ArgNames({"triangles", "pool", "angle"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_ComputeBounds)
+    ->RangeMultiplier(10)
+    ->Range(minTriangles, maxTriangles)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_BuildBvh)
+    ->RangeMultiplier(10)
+    ->Range(minTriangles, maxTriangles)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_SlideSphere)
+    ->RangeMultiplier(10)
+    ->Range(minTriangles, maxTriangles)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Raycast)
+    ->RangeMultiplier(10)
+    ->Range(minTriangles, maxTriangles)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_BakeAmbientOcclusion)
+    ->RangeMultiplier(10)
+    ->Range(minTriangles, maxTriangles)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_BakeVisibilitySets)
+    ->RangeMultiplier(10)
+    ->Range(minTriangles, maxTriangles)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
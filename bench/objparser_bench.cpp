@@ -0,0 +1,134 @@
+// Measures parseObj throughput against thread count and checks its output
+// against tinyobj::ObjReader.
+//
+// Usage: objparser-bench [file.obj] [repetitions]
+
+#include <fmt/core.h>
+#include <tiny_obj_loader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cppitertools/itertools.hpp>
+#include <filesystem>
+#include <thread>
+
+#include "abcg.hpp"
+#include "objparser.hpp"
+#include "threadpool.hpp"
+
+namespace {
+
+template <typename Function>
+double bestSeconds(int repetitions, const Function& function) {
+  auto best{std::numeric_limits<double>::max()};
+  for ([[maybe_unused]] const auto repetition : iter::range(repetitions)) {
+    const auto start{std::chrono::steady_clock::now()};
+    function();
+    const std::chrono::duration<double> elapsed{
+        std::chrono::steady_clock::now() - start};
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+// Returns the number of differences between the two parsers' outputs
+std::size_t compareWithTinyObj(const ObjData& data,
+                               const tinyobj::ObjReader& reader) {
+  std::size_t differences{};
+
+  // Faces of all shapes in file order
+  std::vector<tinyobj::index_t> indices;
+  for (const auto& shape : reader.GetShapes()) {
+    indices.insert(indices.end(), shape.mesh.indices.begin(),
+                   shape.mesh.indices.end());
+  }
+  if (indices.size() != data.indices.size()) {
+    fmt::print("  index count differs: {} vs {}\n", data.indices.size(),
+               indices.size());
+    return 1;
+  }
+  for (const auto i : iter::range(indices.size())) {
+    if (indices[i].vertex_index != data.indices[i].vertex_index ||
+        indices[i].normal_index != data.indices[i].normal_index ||
+        indices[i].texcoord_index != data.indices[i].texcoord_index) {
+      ++differences;
+    }
+  }
+
+  const auto compareReals{[&](std::string_view name,
+                              const std::vector<tinyobj::real_t>& expected,
+                              const std::vector<float>& actual) {
+    if (expected.size() != actual.size()) {
+      fmt::print("  {} count differs: {} vs {}\n", name, actual.size(),
+                 expected.size());
+      ++differences;
+      return;
+    }
+    std::size_t mismatches{};
+    float maxError{};
+    for (const auto i : iter::range(expected.size())) {
+      if (expected[i] != actual[i]) {
+        ++mismatches;
+        maxError = std::max(maxError, std::abs(expected[i] - actual[i]));
+      }
+    }
+    if (mismatches > 0) {
+      fmt::print("  {}: {} values differ (max abs error {})\n", name,
+                 mismatches, maxError);
+    }
+    differences += mismatches;
+  }};
+  compareReals("positions", reader.GetAttrib().vertices, data.attrib.vertices);
+  compareReals("normals", reader.GetAttrib().normals, data.attrib.normals);
+  compareReals("texcoords", reader.GetAttrib().texcoords,
+               data.attrib.texcoords);
+
+  return differences;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  try {
+    const std::string path{argc > 1 ? argv[1]
+                                    : "assets/hintze-hall-1m.obj"};
+    const int repetitions{argc > 2 ? std::max(1, std::atoi(argv[2])) : 3};
+    const auto basePath{std::filesystem::path{path}.parent_path().string()};
+    const auto megabytes{
+        static_cast<double>(std::filesystem::file_size(path)) / (1 << 20)};
+
+    fmt::print("{} ({:.1f} MB)\n", path, megabytes);
+
+    tinyobj::ObjReaderConfig readerConfig;
+    readerConfig.mtl_search_path = basePath;
+    tinyobj::ObjReader reader;
+    const auto tinyObjSeconds{bestSeconds(repetitions, [&] {
+      if (!reader.ParseFromFile(path, readerConfig)) {
+        throw abcg::Exception{abcg::Exception::Runtime(reader.Error())};
+      }
+    })};
+    fmt::print("{:>8} {:>10.1f} MB/s\n", "tinyobj", megabytes / tinyObjSeconds);
+
+    ObjData data;
+    const auto maxThreads{std::max(1U, std::thread::hardware_concurrency())};
+    for (std::size_t numThreads{1}; numThreads <= maxThreads;
+         numThreads = numThreads < maxThreads
+                          ? std::min<std::size_t>(numThreads * 2, maxThreads)
+                          : numThreads + 1) {
+      ThreadPool pool{numThreads};
+      const auto seconds{bestSeconds(
+          repetitions, [&] { data = parseObj(path, basePath, pool); })};
+      fmt::print("{:>8} {:>10.1f} MB/s ({:.2f}x tinyobj)\n",
+                 fmt::format("{} thr", numThreads), megabytes / seconds,
+                 tinyObjSeconds / seconds);
+    }
+
+    const auto differences{compareWithTinyObj(data, reader)};
+    fmt::print("Output {} tinyobj ({} differences)\n",
+               differences == 0 ? "matches" : "differs from", differences);
+    return differences == 0 ? 0 : 1;
+  } catch (const std::exception& exception) {
+    fmt::print(stderr, "{}\n", exception.what());
+    return -1;
+  }
+}
@@ -0,0 +1,148 @@
+#include "benchmark.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cppitertools/itertools.hpp>
+#include <fstream>
+#include <sstream>
+
+std::vector<CameraKeyframe> loadCameraPath(std::string_view path) {
+  std::ifstream stream{std::string{path}};
+  if (!stream) {
+    throw abcg::Exception{
+        abcg::Exception::Runtime(fmt::format("Failed to read {}", path))};
+  }
+
+  std::vector<CameraKeyframe> keyframes;
+  std::string line;
+  for (std::size_t lineNumber{1}; std::getline(stream, line); ++lineNumber) {
+    const auto first{line.find_first_not_of(" \t\r")};
+    if (first == std::string::npos || line[first] == '#') continue;
+
+    std::istringstream fields{line};
+    CameraKeyframe keyframe;
+    fields >> keyframe.eye.x >> keyframe.eye.y >> keyframe.eye.z >>
+        keyframe.at.x >> keyframe.at.y >> keyframe.at.z >> keyframe.up.x >>
+        keyframe.up.y >> keyframe.up.z;
+    if (!fields) {
+      throw abcg::Exception{abcg::Exception::Runtime(
+          fmt::format("{}:{}: expected eye, at and up", path, lineNumber))};
+    }
+    keyframes.push_back(keyframe);
+  }
+
+  if (keyframes.empty()) {
+    throw abcg::Exception{abcg::Exception::Runtime(
+        fmt::format("{} has no camera keyframes", path))};
+  }
+  return keyframes;
+}
+
+TimingSummary summarize(std::vector<double> samples) {
+  if (samples.empty()) return {};
+
+  std::ranges::sort(samples);
+  const auto rank{[&](double percentile) {
+    const auto index{static_cast<std::size_t>(
+        std::ceil(percentile * static_cast<double>(samples.size())))};
+    return samples[std::clamp<std::size_t>(index, 1, samples.size()) - 1];
+  }};
+  return {samples.front(), rank(0.5), rank(0.99)};
+}
+
+void BenchmarkRecorder::beginFrame() {
+  auto& frame{m_frames.emplace_back()};
+#if !defined(__EMSCRIPTEN__)
+  abcg::glGenQueries(1, &frame.query);
+  abcg::glBeginQuery(GL_TIME_ELAPSED, frame.query);
+#endif
+}
+
+void BenchmarkRecorder::endFrame(double cpuMilliseconds,
+                                 std::size_t numTriangles,
+                                 std::size_t numOccludedClusters,
+                                 std::size_t numPvsCulledClusters) {
+#if !defined(__EMSCRIPTEN__)
+  abcg::glEndQuery(GL_TIME_ELAPSED);
+#endif
+  m_frames.back().cpuMilliseconds = cpuMilliseconds;
+  m_frames.back().numTriangles = numTriangles;
+  m_frames.back().numOccludedClusters = numOccludedClusters;
+  m_frames.back().numPvsCulledClusters = numPvsCulledClusters;
+}
+
+void BenchmarkRecorder::finish(std::string_view path) {
+#if !defined(__EMSCRIPTEN__)
+  for (auto& frame : m_frames) {
+    GLuint64 nanoseconds{};
+    abcg::glGetQueryObjectui64v(frame.query, GL_QUERY_RESULT, &nanoseconds);
+    frame.gpuMilliseconds = static_cast<double>(nanoseconds) / 1.0e6;
+  }
+#endif
+  terminateGL();
+
+  std::vector<double> cpuTimes;
+  std::vector<double> gpuTimes;
+  for (const auto& frame : m_frames) {
+    cpuTimes.push_back(frame.cpuMilliseconds);
+    gpuTimes.push_back(frame.gpuMilliseconds);
+  }
+  const auto cpu{summarize(cpuTimes)};
+  const auto gpu{summarize(gpuTimes)};
+
+  const std::string basePath{path};
+  std::ofstream csv{basePath + ".csv"};
+  csv << "frame,cpu_ms,gpu_ms,triangles,occluded_clusters,"
+         "pvs_culled_clusters\n";
+  for (const auto index : iter::range(m_frames.size())) {
+    const auto& frame{m_frames[index]};
+    csv << fmt::format("{},{:.4f},{:.4f},{},{},{}\n", index,
+                       frame.cpuMilliseconds, frame.gpuMilliseconds,
+                       frame.numTriangles, frame.numOccludedClusters,
+                       frame.numPvsCulledClusters);
+  }
+
+  std::ofstream json{basePath + ".json"};
+  const auto summaryJson{[](const TimingSummary& summary) {
+    return fmt::format(R"({{"min": {:.4f}, "median": {:.4f}, "p99": {:.4f}}})",
+                       summary.min, summary.median, summary.p99);
+  }};
+  json << "{\n";
+  json << fmt::format("  \"frames\": {},\n", m_frames.size());
+  json << fmt::format("  \"cpu_ms\": {},\n", summaryJson(cpu));
+  json << fmt::format("  \"gpu_ms\": {},\n", summaryJson(gpu));
+  json << "  \"samples\": [\n";
+  for (const auto index : iter::range(m_frames.size())) {
+    const auto& frame{m_frames[index]};
+    json << fmt::format(
+        R"(    {{"cpu_ms": {:.4f}, "gpu_ms": {:.4f}, "triangles": {}, )"
+        R"("occluded_clusters": {}, "pvs_culled_clusters": {}}}{})",
+        frame.cpuMilliseconds, frame.gpuMilliseconds, frame.numTriangles,
+        frame.numOccludedClusters, frame.numPvsCulledClusters,
+        index + 1 < m_frames.size() ? ",\n" : "\n");
+  }
+  json << "  ]\n}\n";
+
+  if (!csv || !json) {
+    throw abcg::Exception{abcg::Exception::Runtime(
+        fmt::format("Failed to write {}.csv/.json", basePath))};
+  }
+
+  fmt::print("{} frames\n", m_frames.size());
+  fmt::print("{:>4} {:>10} {:>10} {:>10}\n", "", "min", "median", "p99");
+  fmt::print("{:>4} {:>7.3f} ms {:>7.3f} ms {:>7.3f} ms\n", "CPU", cpu.min,
+             cpu.median, cpu.p99);
+  fmt::print("{:>4} {:>7.3f} ms {:>7.3f} ms {:>7.3f} ms\n", "GPU", gpu.min,
+             gpu.median, gpu.p99);
+}
+
+void BenchmarkRecorder::terminateGL() {
+#if !defined(__EMSCRIPTEN__)
+  for (auto& frame : m_frames) {
+    abcg::glDeleteQueries(1, &frame.query);
+    frame.query = 0;
+  }
+#endif
+}
@@ -0,0 +1,63 @@
+#ifndef BENCHMARK_HPP_
+#define BENCHMARK_HPP_
+
+#include <glm/vec3.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "abcg.hpp"
+
+// One camera pose of a scripted path
+struct CameraKeyframe {
+  glm::vec3 eye{};
+  glm::vec3 at{};
+  glm::vec3 up{0.0f, 0.0f, 1.0f};
+};
+
+// Reads a camera path: one keyframe per line as nine numbers (eye, at and
+// up), with blank lines and lines starting with '#' ignored
+std::vector<CameraKeyframe> loadCameraPath(std::string_view path);
+
+// Min, median and 99th percentile (nearest rank) of a set of samples
+struct TimingSummary {
+  double min{};
+  double median{};
+  double p99{};
+};
+
+TimingSummary summarize(std::vector<double> samples);
+
+// Per-frame CPU and GPU times of a benchmark run. GPU times come from
+// GL_TIME_ELAPSED queries, one per frame, read back only at the end so the
+// run never waits on the GPU. WebGL has no timer queries; GPU times are
+// reported as zero there.
+class BenchmarkRecorder {
+ public:
+  void beginFrame();
+  void endFrame(double cpuMilliseconds, std::size_t numTriangles,
+                std::size_t numOccludedClusters,
+                std::size_t numPvsCulledClusters);
+
+  // Collects the pending GPU times, then writes path + ".csv" and
+  // path + ".json" and prints the summaries
+  void finish(std::string_view path);
+
+  // Deletes the queries of an unfinished run
+  void terminateGL();
+
+  [[nodiscard]] std::size_t getNumFrames() const { return m_frames.size(); }
+
+ private:
+  struct Frame {
+    double cpuMilliseconds{};
+    double gpuMilliseconds{};
+    std::size_t numTriangles{};
+    std::size_t numOccludedClusters{};
+    std::size_t numPvsCulledClusters{};
+    GLuint query{};
+  };
+  std::vector<Frame> m_frames;
+};
+
+#endif
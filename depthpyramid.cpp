@@ -0,0 +1,278 @@
+#include "depthpyramid.hpp"
+
+#include <algorithm>
+#include <cppitertools/itertools.hpp>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vec2.hpp>
+#include <limits>
+#include <optional>
+
+void DepthPyramid::resize(int viewportWidth, int viewportHeight,
+                          int downscale) {
+  invalidate();
+  m_width = std::max(viewportWidth / downscale, 1);
+  m_height = std::max(viewportHeight / downscale, 1);
+
+#if !defined(__EMSCRIPTEN__)
+  if (m_framebuffer == 0) {
+    abcg::glGenFramebuffers(1, &m_framebuffer);
+    abcg::glGenTextures(1, &m_depthTexture);
+    for (auto& readback : m_readbacks) {
+      abcg::glGenBuffers(1, &readback.buffer);
+    }
+  }
+
+  abcg::glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+  abcg::glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, m_width,
+                     m_height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  abcg::glBindTexture(GL_TEXTURE_2D, 0);
+
+  GLint previousFramebuffer{};
+  abcg::glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+  abcg::glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+  abcg::glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                               GL_TEXTURE_2D, m_depthTexture, 0);
+  // Depth only
+  const GLenum noColor{GL_NONE};
+  abcg::glDrawBuffers(1, &noColor);
+  abcg::glReadBuffer(GL_NONE);
+  const auto status{abcg::glCheckFramebufferStatus(GL_FRAMEBUFFER)};
+  abcg::glBindFramebuffer(GL_FRAMEBUFFER,
+                          static_cast<GLuint>(previousFramebuffer));
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    throw abcg::Exception{
+        abcg::Exception::Runtime("Incomplete occlusion depth framebuffer")};
+  }
+
+  const auto size{static_cast<GLsizeiptr>(sizeof(float)) * m_width *
+                  m_height};
+  for (const auto& readback : m_readbacks) {
+    abcg::glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    abcg::glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+  }
+  abcg::glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+#endif
+}
+
+void DepthPyramid::beginCapture() {
+#if !defined(__EMSCRIPTEN__)
+  abcg::glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_previousFramebuffer);
+  abcg::glGetIntegerv(GL_VIEWPORT, m_previousViewport.data());
+
+  abcg::glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+  abcg::glViewport(0, 0, m_width, m_height);
+  abcg::glClear(GL_DEPTH_BUFFER_BIT);
+#endif
+}
+
+void DepthPyramid::endCapture(const glm::mat4& clipMatrix,
+                              const glm::vec3& eye) {
+#if !defined(__EMSCRIPTEN__)
+  // Still unread after a full cycle: the GPU is far behind, so drop it
+  auto& readback{m_readbacks[m_nextReadback]};
+  if (readback.fence != nullptr) abcg::glDeleteSync(readback.fence);
+
+  abcg::glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+  abcg::glReadPixels(0, 0, m_width, m_height, GL_DEPTH_COMPONENT, GL_FLOAT,
+                     nullptr);
+  abcg::glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  readback.fence = abcg::glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  readback.clipMatrix = clipMatrix;
+  readback.eye = eye;
+  m_nextReadback = (m_nextReadback + 1) % readbackLatency;
+
+  abcg::glBindFramebuffer(GL_FRAMEBUFFER,
+                          static_cast<GLuint>(m_previousFramebuffer));
+  abcg::glViewport(m_previousViewport[0], m_previousViewport[1],
+                   m_previousViewport[2], m_previousViewport[3]);
+#else
+  (void)clipMatrix;
+  (void)eye;
+#endif
+}
+
+void DepthPyramid::update(const glm::vec3& eye) {
+#if !defined(__EMSCRIPTEN__)
+  // Fences signal in the order they were issued, so stop at the first one
+  // still pending and adopt the newest before it
+  std::optional<std::size_t> newest;
+  for (const auto offset : iter::range(readbackLatency)) {
+    auto& readback{m_readbacks[(m_nextReadback + offset) % readbackLatency]};
+    if (readback.fence == nullptr) continue;
+    const auto status{abcg::glClientWaitSync(readback.fence, 0, 0)};
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      break;
+    }
+    abcg::glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+    newest = (m_nextReadback + offset) % readbackLatency;
+  }
+
+  if (newest) {
+    const auto& readback{m_readbacks[*newest]};
+    abcg::glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    const auto size{static_cast<GLsizeiptr>(sizeof(float)) * m_width *
+                    m_height};
+    const auto* depth{static_cast<const float*>(abcg::glMapBufferRange(
+        GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT))};
+    if (depth != nullptr) {
+      buildLevels(depth);
+      m_clipMatrix = readback.clipMatrix;
+      m_captureEye = readback.eye;
+      abcg::glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    abcg::glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+#endif
+
+  m_dilation = isReady() ? glm::distance(eye, m_captureEye) : 0.0f;
+}
+
+void DepthPyramid::invalidate() {
+  discardReadbacks();
+  m_levels.clear();
+}
+
+bool DepthPyramid::isOccluded(const glm::vec3& boundsMin,
+                              const glm::vec3& boundsMax) const {
+  if (m_levels.empty()) return false;
+
+  // Nearest window depth and screen rectangle of the corners
+  const auto low{boundsMin - glm::vec3{m_dilation}};
+  const auto high{boundsMax + glm::vec3{m_dilation}};
+  auto nearest{std::numeric_limits<float>::max()};
+  glm::vec2 ndcMin{std::numeric_limits<float>::max()};
+  glm::vec2 ndcMax{std::numeric_limits<float>::lowest()};
+  for (const auto corner : iter::range(8)) {
+    const glm::vec4 position{(corner & 1) != 0 ? high.x : low.x,
+                             (corner & 2) != 0 ? high.y : low.y,
+                             (corner & 4) != 0 ? high.z : low.z, 1.0f};
+    const auto clip{m_clipMatrix * position};
+    // Between the eye and the near plane, or behind the eye
+    if (clip.z < -clip.w) return false;
+
+    const glm::vec2 ndc{clip.x / clip.w, clip.y / clip.w};
+    ndcMin = glm::min(ndcMin, ndc);
+    ndcMax = glm::max(ndcMax, ndc);
+    nearest = std::min(nearest, clip.z / clip.w * 0.5f + 0.5f);
+  }
+  if (ndcMin.x < -1.0f || ndcMin.y < -1.0f || ndcMax.x > 1.0f ||
+      ndcMax.y > 1.0f) {
+    return false;
+  }
+
+  // Texels of the finest level under the rectangle
+  const auto& finest{m_levels.front()};
+  const auto toTexel{[](float ndc, int size) {
+    const auto texel{static_cast<int>((ndc * 0.5f + 0.5f) *
+                                      static_cast<float>(size))};
+    return std::clamp(texel, 0, size - 1);
+  }};
+  auto x0{toTexel(ndcMin.x, finest.width)};
+  auto y0{toTexel(ndcMin.y, finest.height)};
+  auto x1{toTexel(ndcMax.x, finest.width)};
+  auto y1{toTexel(ndcMax.y, finest.height)};
+
+  // Coarser levels until the rectangle spans at most 4 x 4 texels
+  std::size_t level{};
+  while (level + 1 < m_levels.size() && std::max(x1 - x0, y1 - y0) >= 4) {
+    x0 /= 2;
+    y0 /= 2;
+    x1 /= 2;
+    y1 /= 2;
+    ++level;
+  }
+
+  const auto& texels{m_levels[level]};
+  auto farthest{0.0f};
+  for (const auto y : iter::range(y0, y1 + 1)) {
+    const auto* row{
+        &texels.depth[static_cast<std::size_t>(y * texels.width)]};
+    for (const auto x : iter::range(x0, x1 + 1)) {
+      farthest = std::max(farthest, row[x]);
+    }
+  }
+  return nearest > farthest;
+}
+
+void DepthPyramid::terminateGL() {
+  discardReadbacks();
+#if !defined(__EMSCRIPTEN__)
+  for (auto& readback : m_readbacks) {
+    abcg::glDeleteBuffers(1, &readback.buffer);
+    readback.buffer = 0;
+  }
+  abcg::glDeleteTextures(1, &m_depthTexture);
+  abcg::glDeleteFramebuffers(1, &m_framebuffer);
+  m_depthTexture = 0;
+  m_framebuffer = 0;
+#endif
+  m_levels.clear();
+}
+
+void DepthPyramid::buildLevels(const float* depth) {
+  // The target is rasterized at texel centers only, so an occluder may
+  // cover a texel that partly sees past its edge. Taking the farthest
+  // depth of the neighbors as well shrinks the occluders by a texel.
+  const auto width{static_cast<std::size_t>(m_width)};
+  const auto height{static_cast<std::size_t>(m_height)};
+  std::vector<float> rows(width * height);
+  for (const auto y : iter::range(height)) {
+    const auto* source{&depth[y * width]};
+    for (const auto x : iter::range(width)) {
+      const auto left{x > 0 ? x - 1 : x};
+      const auto right{std::min(x + 1, width - 1)};
+      rows[y * width + x] =
+          std::max({source[left], source[x], source[right]});
+    }
+  }
+
+  m_levels.resize(1);
+  auto& finest{m_levels.front()};
+  finest.width = m_width;
+  finest.height = m_height;
+  finest.depth.resize(width * height);
+  for (const auto y : iter::range(height)) {
+    const auto up{y > 0 ? y - 1 : y};
+    const auto down{std::min(y + 1, height - 1)};
+    for (const auto x : iter::range(width)) {
+      finest.depth[y * width + x] =
+          std::max({rows[up * width + x], rows[y * width + x],
+                    rows[down * width + x]});
+    }
+  }
+
+  // Each coarser texel keeps the farthest of the 2 x 2 below it; odd edges
+  // fold into the last texel
+  while (m_levels.back().width > 1 || m_levels.back().height > 1) {
+    const auto& previous{m_levels.back()};
+    Level next{(previous.width + 1) / 2, (previous.height + 1) / 2, {}};
+    next.depth.resize(static_cast<std::size_t>(next.width * next.height));
+    for (const auto y : iter::range(next.height)) {
+      const auto y1{std::min(2 * y + 1, previous.height - 1)};
+      for (const auto x : iter::range(next.width)) {
+        const auto x1{std::min(2 * x + 1, previous.width - 1)};
+        const auto at{[&](int sx, int sy) {
+          return previous.depth[static_cast<std::size_t>(
+              sy * previous.width + sx)];
+        }};
+        next.depth[static_cast<std::size_t>(y * next.width + x)] =
+            std::max({at(2 * x, 2 * y), at(x1, 2 * y), at(2 * x, y1),
+                      at(x1, y1)});
+      }
+    }
+    m_levels.push_back(std::move(next));
+  }
+}
+
+void DepthPyramid::discardReadbacks() {
+#if !defined(__EMSCRIPTEN__)
+  for (auto& readback : m_readbacks) {
+    if (readback.fence != nullptr) abcg::glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+  }
+#endif
+}
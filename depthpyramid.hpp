@@ -0,0 +1,83 @@
+#ifndef DEPTHPYRAMID_HPP_
+#define DEPTHPYRAMID_HPP_
+
+#include <array>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <vector>
+
+#include "abcg.hpp"
+
+// Occlusion test against the depth of an earlier frame. The caller draws
+// that frame's visible geometry depth-only into a target a fraction of the
+// viewport size; its depth is read back through pixel buffers once the GPU
+// is done with it, usually a frame or two later, and reduced on the CPU
+// into a pyramid holding the farthest depth of each texel. WebGL can't read
+// back without stalling, so nothing is ever occluded there.
+class DepthPyramid {
+ public:
+  // Sizes the depth target to 1/downscale of the viewport. Pending
+  // readbacks and the current pyramid are dropped.
+  void resize(int viewportWidth, int viewportHeight, int downscale = 4);
+
+  // Binds and clears the depth target. The occluders are drawn next, with
+  // the clip matrix (projection * view * model) and the eye (model space)
+  // given to endCapture.
+  void beginCapture();
+  // Restores the previous framebuffer and viewport and queues the readback
+  void endCapture(const glm::mat4& clipMatrix, const glm::vec3& eye);
+
+  // Adopts the newest finished readback, if any, and sets the eye (model
+  // space) boxes are seen from this frame
+  void update(const glm::vec3& eye);
+  // Drops pending readbacks and the current pyramid, e.g. for a new model
+  void invalidate();
+
+  // Whether the box (model space) is behind the captured depth everywhere
+  // it covers. The box is first grown by how far the eye moved since the
+  // capture. Boxes crossing the near plane or the edges of the captured
+  // view count as visible.
+  [[nodiscard]] bool isOccluded(const glm::vec3& boundsMin,
+                                const glm::vec3& boundsMax) const;
+
+  [[nodiscard]] bool isReady() const { return !m_levels.empty(); }
+
+  void terminateGL();
+
+ private:
+  // Frames a readback may stay in flight before its buffer is reused
+  static constexpr std::size_t readbackLatency{3};
+
+  struct Readback {
+    GLuint buffer{};
+    GLsync fence{};
+    glm::mat4 clipMatrix{1.0f};
+    glm::vec3 eye{};
+  };
+
+  struct Level {
+    int width{};
+    int height{};
+    std::vector<float> depth;  // Farthest window depth per texel
+  };
+
+  GLuint m_framebuffer{};
+  GLuint m_depthTexture{};
+  int m_width{};
+  int m_height{};
+  std::array<Readback, readbackLatency> m_readbacks{};
+  std::size_t m_nextReadback{};  // Oldest slot, written next
+  GLint m_previousFramebuffer{};
+  std::array<GLint, 4> m_previousViewport{};
+
+  // Pyramid of the adopted readback, finest level first
+  std::vector<Level> m_levels;
+  glm::mat4 m_clipMatrix{1.0f};
+  glm::vec3 m_captureEye{};
+  float m_dilation{};
+
+  void buildLevels(const float* depth);
+  void discardReadbacks();
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include "exhibits.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cppitertools/itertools.hpp>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+// Reads three coordinates, leaving those given as "*" unchanged
+bool parseCorner(std::string_view fields, glm::vec3& corner) {
+  std::istringstream stream{std::string{fields}};
+  for (const auto axis : iter::range(3)) {
+    std::string token;
+    if (!(stream >> token)) return false;
+    if (token == "*") continue;
+
+    std::istringstream value{token};
+    if (!(value >> corner[axis]) || !value.eof()) return false;
+  }
+  std::string extra;
+  return !(stream >> extra);
+}
+
+}  // namespace
+
+bool Exhibit::contains(const glm::vec3& point) const {
+  for (const auto axis : iter::range(3)) {
+    if (point[axis] < regionMin[axis] - triggerRadius ||
+        point[axis] > regionMax[axis] + triggerRadius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<Exhibit> loadExhibits(std::string_view path) {
+  std::ifstream stream{std::string{path}};
+  if (!stream) {
+    throw abcg::Exception{
+        abcg::Exception::Runtime(fmt::format("Failed to read {}", path))};
+  }
+
+  std::vector<Exhibit> exhibits;
+  std::string line;
+  for (std::size_t lineNumber{1}; std::getline(stream, line); ++lineNumber) {
+    const auto fail{[&](std::string_view message) {
+      throw abcg::Exception{abcg::Exception::Runtime(
+          fmt::format("{}:{}: {}", path, lineNumber, message))};
+    }};
+
+    line.erase(line.find_last_not_of(" \t\r") + 1);
+    const auto first{line.find_first_not_of(" \t")};
+    if (first == std::string::npos || line[first] == '#') continue;
+
+    // A keyword, then the rest of the line after one space
+    const std::string_view content{std::string_view{line}.substr(first)};
+    const auto keywordEnd{std::min(content.find(' '), content.size())};
+    const auto keyword{content.substr(0, keywordEnd)};
+    const auto rest{content.substr(std::min(keywordEnd + 1, content.size()))};
+
+    if (keyword == "exhibit") {
+      if (rest.empty()) fail("expected a title");
+      exhibits.emplace_back().title = rest;
+      continue;
+    }
+    if (exhibits.empty()) fail("expected an exhibit first");
+
+    auto& exhibit{exhibits.back()};
+    if (keyword == "min" || keyword == "max") {
+      if (!parseCorner(rest, keyword == "min" ? exhibit.regionMin
+                                              : exhibit.regionMax)) {
+        fail("expected three coordinates or '*'");
+      }
+    } else if (keyword == "radius") {
+      std::istringstream value{std::string{rest}};
+      if (!(value >> exhibit.triggerRadius) || exhibit.triggerRadius < 0.0f) {
+        fail("expected a non-negative radius");
+      }
+    } else if (keyword == "text") {
+      exhibit.text.emplace_back(rest);
+    } else {
+      fail(fmt::format("unknown keyword {}", keyword));
+    }
+  }
+
+  for (const auto& exhibit : exhibits) {
+    for (const auto axis : iter::range(3)) {
+      if (exhibit.regionMin[axis] > exhibit.regionMax[axis]) {
+        throw abcg::Exception{abcg::Exception::Runtime(fmt::format(
+            "{}: region of {} has min above max", path, exhibit.title))};
+      }
+    }
+  }
+  return exhibits;
+}
+
+void ExhibitGrid::build(std::span<const Exhibit> exhibits, int cellsPerAxis) {
+  m_exhibits = exhibits;
+
+  // Span the bounded coordinates, grown by the trigger radii
+  glm::vec3 min{std::numeric_limits<float>::max()};
+  glm::vec3 max{std::numeric_limits<float>::lowest()};
+  for (const auto& exhibit : exhibits) {
+    for (const auto axis : iter::range(3)) {
+      for (const auto bound : {exhibit.regionMin[axis] - exhibit.triggerRadius,
+                               exhibit.regionMax[axis] +
+                                   exhibit.triggerRadius}) {
+        if (std::abs(bound) == std::numeric_limits<float>::max()) continue;
+        min[axis] = std::min(min[axis], bound);
+        max[axis] = std::max(max[axis], bound);
+      }
+    }
+  }
+  for (const auto axis : iter::range(3)) {
+    if (min[axis] > max[axis]) min[axis] = max[axis] = 0.0f;
+    const auto extent{max[axis] - min[axis]};
+    m_numCells[axis] = extent > 0.0f ? std::max(cellsPerAxis, 1) : 1;
+    m_cellSize[axis] =
+        extent > 0.0f ? extent / static_cast<float>(m_numCells[axis]) : 1.0f;
+  }
+  m_origin = min;
+
+  // Exhibits per cell, counted and then filled in file order
+  const auto numCells{static_cast<std::size_t>(m_numCells.x) *
+                      static_cast<std::size_t>(m_numCells.y) *
+                      static_cast<std::size_t>(m_numCells.z)};
+  const auto forEachCell{[&](const Exhibit& exhibit, const auto& function) {
+    const glm::vec3 radius{exhibit.triggerRadius};
+    const auto first{cellOf(exhibit.regionMin - radius)};
+    const auto last{cellOf(exhibit.regionMax + radius)};
+    for (const auto z : iter::range(first.z, last.z + 1)) {
+      for (const auto y : iter::range(first.y, last.y + 1)) {
+        for (const auto x : iter::range(first.x, last.x + 1)) {
+          function((static_cast<std::size_t>(z) * m_numCells.y + y) *
+                       m_numCells.x +
+                   x);
+        }
+      }
+    }
+  }};
+
+  m_cellStart.assign(numCells + 1, 0);
+  for (const auto& exhibit : exhibits) {
+    forEachCell(exhibit, [&](std::size_t cell) { ++m_cellStart[cell + 1]; });
+  }
+  for (const auto cell : iter::range(numCells)) {
+    m_cellStart[cell + 1] += m_cellStart[cell];
+  }
+  m_cellExhibits.resize(m_cellStart.back());
+  auto next{m_cellStart};
+  for (const auto index : iter::range(exhibits.size())) {
+    forEachCell(exhibits[index], [&](std::size_t cell) {
+      m_cellExhibits[next[cell]++] = static_cast<std::uint32_t>(index);
+    });
+  }
+}
+
+void ExhibitGrid::query(const glm::vec3& point,
+                        std::vector<std::size_t>& result) const {
+  result.clear();
+  if (m_cellStart.empty()) return;
+
+  const auto cell{cellOf(point)};
+  const auto index{(static_cast<std::size_t>(cell.z) * m_numCells.y + cell.y) *
+                       m_numCells.x +
+                   cell.x};
+  for (const auto slot :
+       iter::range(m_cellStart[index], m_cellStart[index + 1])) {
+    const auto exhibit{m_cellExhibits[slot]};
+    if (m_exhibits[exhibit].contains(point)) result.push_back(exhibit);
+  }
+}
+
+glm::ivec3 ExhibitGrid::cellOf(const glm::vec3& point) const {
+  // Points outside the grid map to its border cells. Regions unbounded
+  // along an axis cover every cell along it, so they are still found.
+  glm::ivec3 cell;
+  for (const auto axis : iter::range(3)) {
+    const auto position{(point[axis] - m_origin[axis]) / m_cellSize[axis]};
+    cell[axis] = static_cast<int>(std::clamp(
+        position, 0.0f, static_cast<float>(m_numCells[axis] - 1)));
+  }
+  return cell;
+}
@@ -0,0 +1,53 @@
+#ifndef EXHIBITS_HPP_
+#define EXHIBITS_HPP_
+
+#include <cstdint>
+#include <glm/vec3.hpp>
+#include <limits>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "abcg.hpp"
+
+// A point of interest shown when the camera enters its region
+struct Exhibit {
+  std::string title;
+  std::vector<std::string> text;  // Lines of the description
+  glm::vec3 regionMin{std::numeric_limits<float>::lowest()};
+  glm::vec3 regionMax{std::numeric_limits<float>::max()};
+  float triggerRadius{};  // Distance the region is grown by
+
+  [[nodiscard]] bool contains(const glm::vec3& point) const;
+};
+
+// Reads exhibits from a text file of "exhibit <title>" entries, each
+// followed by "min x y z" and "max x y z" lines ("*" for an unbounded
+// axis), an optional "radius r" and any number of "text <line>" lines.
+// Blank lines and lines starting with '#' are ignored.
+std::vector<Exhibit> loadExhibits(std::string_view path);
+
+// Uniform grid over the exhibit regions. Each cell lists the exhibits whose
+// region overlaps it, so a query only tests those of one cell.
+class ExhibitGrid {
+ public:
+  // The grid spans the bounded part of the regions with up to cellsPerAxis
+  // cells along each axis. exhibits must outlive the grid.
+  void build(std::span<const Exhibit> exhibits, int cellsPerAxis = 16);
+
+  // Indices of the exhibits whose region contains point, in file order
+  void query(const glm::vec3& point, std::vector<std::size_t>& result) const;
+
+ private:
+  std::span<const Exhibit> m_exhibits;
+  glm::vec3 m_origin{};
+  glm::vec3 m_cellSize{1.0f};
+  glm::ivec3 m_numCells{};
+  std::vector<std::uint32_t> m_cellStart;  // Per cell, into m_cellExhibits
+  std::vector<std::uint32_t> m_cellExhibits;
+
+  [[nodiscard]] glm::ivec3 cellOf(const glm::vec3& point) const;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#include "frustum.hpp"
+
+#include <cppitertools/itertools.hpp>
+#include <glm/geometric.hpp>
+
+Frustum::Frustum(const glm::mat4& clipMatrix) {
+  // Gribb-Hartmann plane extraction from the rows of the matrix
+  std::array<glm::vec4, 4> rows{};
+  for (const auto row : iter::range(4)) {
+    rows.at(row) = glm::vec4(clipMatrix[0][row], clipMatrix[1][row],
+                             clipMatrix[2][row], clipMatrix[3][row]);
+  }
+
+  m_planes = {rows[3] + rows[0], rows[3] - rows[0],   // Left, right
+              rows[3] + rows[1], rows[3] - rows[1],   // Bottom, top
+              rows[3] + rows[2], rows[3] - rows[2]};  // Near, far
+
+  for (auto& plane : m_planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+}
+
+bool Frustum::intersects(const glm::vec3& boundsMin,
+                         const glm::vec3& boundsMax) const {
+  for (const auto& plane : m_planes) {
+    // Corner of the box furthest along the plane normal
+    const glm::vec3 corner{plane.x >= 0 ? boundsMax.x : boundsMin.x,
+                           plane.y >= 0 ? boundsMax.y : boundsMin.y,
+                           plane.z >= 0 ? boundsMax.z : boundsMin.z};
+    if (glm::dot(glm::vec3(plane), corner) + plane.w < 0) return false;
+  }
+  return true;
+}
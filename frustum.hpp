@@ -0,0 +1,23 @@
+#ifndef FRUSTUM_HPP_
+#define FRUSTUM_HPP_
+
+#include <array>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+// View frustum as six inward-facing planes, in the space the matrix maps
+// from (object space for projection * view * model)
+class Frustum {
+ public:
+  explicit Frustum(const glm::mat4& clipMatrix);
+
+  // Conservative test: may accept boxes just outside a frustum corner
+  [[nodiscard]] bool intersects(const glm::vec3& boundsMin,
+                                const glm::vec3& boundsMax) const;
+
+ private:
+  std::array<glm::vec4, 6> m_planes{};
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include "inputrecording.hpp"
+
+#include <algorithm>
+#include <span>
+
+#include "meshcache.hpp"
+
+namespace {
+
+// Sections of a recording file
+constexpr auto headerTag{makeCacheTag('R', 'H', 'D', 'R')};
+constexpr auto changesTag{makeCacheTag('R', 'C', 'H', 'G')};
+constexpr auto framesTag{makeCacheTag('R', 'F', 'R', 'M')};
+
+// Recordings have their own format, so mesh cache bumps don't affect them.
+// They have no source asset; the key only tells them apart from mesh caches.
+constexpr CacheFormat recordingFormat{makeCacheTag('L', 'M', 'T', 'R'), 1};
+constexpr MeshCacheKey recordingKey{.options = makeCacheTag('R', 'E', 'C',
+                                                            '1')};
+
+struct RecordingHeader {
+  CameraKeyframe start;
+  float timestep{};
+};
+
+}  // namespace
+
+void InputRecorder::start(const CameraKeyframe& pose, float timestep) {
+  m_recording = {};
+  m_recording.start = pose;
+  m_recording.timestep = timestep;
+  m_step = 0;
+}
+
+void InputRecorder::recordFrame(const CameraInput& input,
+                                std::size_t numSteps) {
+  auto& changes{m_recording.changes};
+  if (changes.empty() || changes.back().input != input) {
+    changes.push_back({m_step, input});
+  }
+
+  // Frames are short; a long stall is split into frames of at most 65535
+  do {
+    const auto frameSteps{std::min<std::size_t>(numSteps, 65535)};
+    m_recording.stepsPerFrame.push_back(
+        static_cast<std::uint16_t>(frameSteps));
+    m_step += static_cast<std::uint32_t>(frameSteps);
+    numSteps -= frameSteps;
+  } while (numSteps > 0);
+}
+
+void InputReplay::start(const InputRecording& recording) {
+  m_recording = &recording;
+  m_frame = 0;
+  m_change = 0;
+  m_step = 0;
+  m_input = {};
+}
+
+bool saveInputRecording(const InputRecording& recording,
+                        std::string_view path) {
+  const RecordingHeader header{recording.start, recording.timestep};
+
+  MeshCacheWriter writer;
+  writer.addSection(headerTag, std::span{&header, 1});
+  writer.addSection(changesTag, std::span{recording.changes});
+  writer.addSection(framesTag, std::span{recording.stepsPerFrame});
+  return writer.write(path, recordingKey, recordingFormat);
+}
+
+bool loadInputRecording(InputRecording& recording, std::string_view path) {
+  MeshCacheReader reader;
+  if (!reader.open(path, recordingKey, recordingFormat)) return false;
+
+  const auto header{reader.section<RecordingHeader>(headerTag)};
+  if (header.empty()) return false;
+  const auto changes{reader.section<InputRecording::Change>(changesTag)};
+  const auto frames{reader.section<std::uint16_t>(framesTag)};
+
+  recording.start = header.front().start;
+  recording.timestep = header.front().timestep;
+  recording.changes.assign(changes.begin(), changes.end());
+  recording.stepsPerFrame.assign(frames.begin(), frames.end());
+  return true;
+}
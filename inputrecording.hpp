@@ -0,0 +1,90 @@
+#ifndef INPUTRECORDING_HPP_
+#define INPUTRECORDING_HPP_
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "benchmark.hpp"
+
+// Speeds driving the camera during one fixed timestep
+struct CameraInput {
+  float dollySpeed{};
+  float truckSpeed{};
+  float panSpeed{};
+
+  bool operator==(const CameraInput& other) const = default;
+};
+
+// Camera inputs of a tour, sampled at a fixed timestep. Stepping a camera
+// from start with the same inputs and frame pacing reproduces the camera
+// state of every recorded frame.
+struct InputRecording {
+  struct Change {
+    std::uint32_t step{};  // Input applies from this step on
+    CameraInput input;
+  };
+
+  CameraKeyframe start;
+  float timestep{1.0f / 120.0f};
+  std::vector<Change> changes;
+  std::vector<std::uint16_t> stepsPerFrame;
+};
+
+// Builds a recording one rendered frame at a time
+class InputRecorder {
+ public:
+  void start(const CameraKeyframe& pose, float timestep);
+  // The input is constant within a frame: events are handled between frames
+  void recordFrame(const CameraInput& input, std::size_t numSteps);
+
+  [[nodiscard]] const InputRecording& getRecording() const {
+    return m_recording;
+  }
+
+ private:
+  InputRecording m_recording;
+  std::uint32_t m_step{};
+};
+
+// Hands out the inputs of a recording frame by frame. The recording must
+// outlive the replay.
+class InputReplay {
+ public:
+  void start(const InputRecording& recording);
+
+  // Calls step with the input of each fixed step of the next frame
+  template <typename Step>
+  void nextFrame(Step&& step) {
+    const auto numSteps{m_recording->stepsPerFrame[m_frame++]};
+    for (std::uint16_t index{}; index < numSteps; ++index) {
+      const auto& changes{m_recording->changes};
+      while (m_change < changes.size() && changes[m_change].step <= m_step) {
+        m_input = changes[m_change++].input;
+      }
+      step(m_input);
+      ++m_step;
+    }
+  }
+
+  [[nodiscard]] bool isDone() const {
+    return m_recording == nullptr ||
+           m_frame >= m_recording->stepsPerFrame.size();
+  }
+
+ private:
+  const InputRecording* m_recording{};
+  std::size_t m_frame{};
+  std::size_t m_change{};
+  std::uint32_t m_step{};
+  CameraInput m_input;
+};
+
+// Stored in the tagged-section format of the mesh cache, with a magic and
+// version of their own. Save returns false if the file can't be written;
+// load returns false if it's missing or of another version.
+bool saveInputRecording(const InputRecording& recording,
+                        std::string_view path);
+bool loadInputRecording(InputRecording& recording, std::string_view path);
+
+#endif
@@ -0,0 +1,46 @@
+#include "loadprogress.hpp"
+
+#include <algorithm>
+
+void LoadProgress::setExpectedPhases(std::size_t count) {
+  const std::scoped_lock lock{m_mutex};
+  m_expectedPhases = std::max<std::size_t>(count, 1);
+}
+
+void LoadProgress::beginPhase(std::string_view name) {
+  const std::scoped_lock lock{m_mutex};
+  finishPhase();
+  m_phases.push_back({std::string{name}});
+  m_phaseStart = Clock::now();
+}
+
+void LoadProgress::finish() {
+  const std::scoped_lock lock{m_mutex};
+  finishPhase();
+}
+
+std::vector<LoadProgress::Phase> LoadProgress::getPhases() const {
+  const std::scoped_lock lock{m_mutex};
+  auto phases{m_phases};
+  if (!phases.empty() && !phases.back().done) {
+    const std::chrono::duration<double> elapsed{Clock::now() - m_phaseStart};
+    phases.back().seconds = elapsed.count();
+  }
+  return phases;
+}
+
+float LoadProgress::getFraction() const {
+  const std::scoped_lock lock{m_mutex};
+  const auto done{std::ranges::count_if(
+      m_phases, [](const Phase& phase) { return phase.done; })};
+  return std::min(1.0f, static_cast<float>(done) /
+                            static_cast<float>(m_expectedPhases));
+}
+
+void LoadProgress::finishPhase() {
+  if (m_phases.empty() || m_phases.back().done) return;
+
+  const std::chrono::duration<double> elapsed{Clock::now() - m_phaseStart};
+  m_phases.back().seconds = elapsed.count();
+  m_phases.back().done = true;
+}
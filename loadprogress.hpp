@@ -0,0 +1,41 @@
+#ifndef LOADPROGRESS_HPP_
+#define LOADPROGRESS_HPP_
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Named phases of a model load and their durations. Written by the loading
+// thread and read by the UI thread.
+class LoadProgress {
+ public:
+  struct Phase {
+    std::string name;
+    double seconds{};  // So far, for the running phase
+    bool done{false};
+  };
+
+  // Number of phases the load will have, for getFraction
+  void setExpectedPhases(std::size_t count);
+
+  // Finishes the running phase, if any, and starts another
+  void beginPhase(std::string_view name);
+  void finish();
+
+  [[nodiscard]] std::vector<Phase> getPhases() const;
+  [[nodiscard]] float getFraction() const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  mutable std::mutex m_mutex;
+  std::vector<Phase> m_phases;
+  std::size_t m_expectedPhases{1};
+  Clock::time_point m_phaseStart;
+
+  void finishPhase();
+};
+
+#endif
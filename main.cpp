@@ -1,16 +1,59 @@
 #include <fmt/core.h>
 
+#include <string_view>
+
 #include "abcg.hpp"
+#include "benchmark.hpp"
+#include "inputrecording.hpp"
 #include "openglwindow.hpp"
 
 int main(int argc, char **argv) {
   try {
+    // --benchmark <camera path or recording>
+    // [--benchmark-output <path without extension>]
+    // --record <recording> | --replay <recording>
+    std::string benchmarkPath;
+    std::string benchmarkOutput{"benchmark"};
+    std::string recordPath;
+    std::string replayPath;
+    for (int i{1}; i < argc; ++i) {
+      const std::string_view argument{argv[i]};
+      if (argument == "--benchmark" && i + 1 < argc) {
+        benchmarkPath = argv[++i];
+      } else if (argument == "--benchmark-output" && i + 1 < argc) {
+        benchmarkOutput = argv[++i];
+      } else if (argument == "--record" && i + 1 < argc) {
+        recordPath = argv[++i];
+      } else if (argument == "--replay" && i + 1 < argc) {
+        replayPath = argv[++i];
+      }
+    }
+
+#if !defined(__EMSCRIPTEN__)
+    // Render without a visible window (EGL, llvmpipe without a GPU) unless
+    // SDL_VIDEODRIVER already picks a driver
+    if (!benchmarkPath.empty()) SDL_setenv("SDL_VIDEODRIVER", "offscreen", 0);
+#endif
+
     abcg::Application app(argc, argv);
 
     auto window{std::make_unique<OpenGLWindow>()};
     window->setOpenGLSettings({.samples = 4});
     window->setWindowSettings(
         {.width = 1000, .height = 600, .title = "Museu"});
+    if (!benchmarkPath.empty()) {
+      if (InputRecording recording;
+          loadInputRecording(recording, benchmarkPath)) {
+        window->enableBenchmark(recording, benchmarkOutput);
+      } else {
+        window->enableBenchmark(loadCameraPath(benchmarkPath),
+                                benchmarkOutput);
+      }
+    } else if (!replayPath.empty()) {
+      window->enableInputReplay(replayPath);
+    } else if (!recordPath.empty()) {
+      window->enableInputRecording(recordPath);
+    }
 
     app.run(std::move(window));
   } catch (const abcg::Exception &exception) {
@@ -18,4 +61,4 @@ int main(int argc, char **argv) {
     return -1;
   }
   return 0;
-}
\ No newline at end of file
+}
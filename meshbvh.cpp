@@ -0,0 +1,466 @@
+#include "meshbvh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cppitertools/itertools.hpp>
+#include <glm/geometric.hpp>
+#include <limits>
+
+#include "meshgeometry.hpp"
+
+namespace {
+
+constexpr std::size_t numBins{16};
+// Deeper ranges become leaves, so queries need a bounded stack
+constexpr std::size_t maxDepth{48};
+constexpr std::size_t maxSlideSteps{64};
+constexpr std::size_t maxPushIterations{8};
+constexpr float pushTolerance{1e-3f};  // Relative to the radius
+
+struct TriangleBox {
+  glm::vec3 min{};
+  glm::vec3 max{};
+  glm::vec3 centroid{};
+};
+
+float surfaceArea(const glm::vec3& min, const glm::vec3& max) {
+  const auto size{max - min};
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+float squaredDistanceToBox(const glm::vec3& point, const BvhNode& node) {
+  const auto offset{point - glm::clamp(point, node.boundsMin, node.boundsMax)};
+  return glm::dot(offset, offset);
+}
+
+// Distance along the ray to where it enters the box, or infinity if it
+// misses it within maxDistance
+float rayEntersBox(const glm::vec3& origin, const glm::vec3& inverseDirection,
+                   float maxDistance, const BvhNode& node) {
+  const auto t0{(node.boundsMin - origin) * inverseDirection};
+  const auto t1{(node.boundsMax - origin) * inverseDirection};
+  const auto tMin{glm::min(t0, t1)};
+  const auto tMax{glm::max(t0, t1)};
+  const auto enter{std::max({tMin.x, tMin.y, tMin.z, 0.0f})};
+  const auto exit{std::min({tMax.x, tMax.y, tMax.z, maxDistance})};
+  return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+}
+
+// Moller-Trumbore, from either side. Returns the distance along the ray,
+// or infinity if it misses.
+float intersectTriangle(const glm::vec3& origin, const glm::vec3& direction,
+                        const std::array<glm::vec3, 3>& triangle) {
+  constexpr auto miss{std::numeric_limits<float>::infinity()};
+  const auto edge1{triangle[1] - triangle[0]};
+  const auto edge2{triangle[2] - triangle[0]};
+  const auto p{glm::cross(direction, edge2)};
+  const auto determinant{glm::dot(edge1, p)};
+  if (determinant == 0.0f) return miss;
+
+  const auto inverseDeterminant{1.0f / determinant};
+  const auto s{origin - triangle[0]};
+  const auto u{glm::dot(s, p) * inverseDeterminant};
+  if (u < 0.0f || u > 1.0f) return miss;
+
+  const auto q{glm::cross(s, edge1)};
+  const auto v{glm::dot(direction, q) * inverseDeterminant};
+  if (v < 0.0f || u + v > 1.0f) return miss;
+
+  const auto t{glm::dot(edge2, q) * inverseDeterminant};
+  return t >= 0.0f ? t : miss;
+}
+
+// From Ericson, Real-Time Collision Detection, 5.1.5
+glm::vec3 closestPointOnTriangle(const glm::vec3& p,
+                                 const std::array<glm::vec3, 3>& triangle) {
+  const auto& [a, b, c]{triangle};
+  const auto ab{b - a};
+  const auto ac{c - a};
+
+  const auto ap{p - a};
+  const auto d1{glm::dot(ab, ap)};
+  const auto d2{glm::dot(ac, ap)};
+  if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+  const auto bp{p - b};
+  const auto d3{glm::dot(ab, bp)};
+  const auto d4{glm::dot(ac, bp)};
+  if (d3 >= 0.0f && d4 <= d3) return b;
+
+  const auto vc{d1 * d4 - d3 * d2};
+  if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+    return a + ab * (d1 / (d1 - d3));
+  }
+
+  const auto cp{p - c};
+  const auto d5{glm::dot(ab, cp)};
+  const auto d6{glm::dot(ac, cp)};
+  if (d6 >= 0.0f && d5 <= d6) return c;
+
+  const auto vb{d5 * d2 - d1 * d6};
+  if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+    return a + ac * (d2 / (d2 - d6));
+  }
+
+  const auto va{d3 * d6 - d5 * d4};
+  if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+    return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+  }
+
+  const auto denominator{1.0f / (va + vb + vc)};
+  return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+}  // namespace
+
+void MeshBvh::build(std::span<const Vertex> vertices,
+                    std::span<const std::uint32_t> indices,
+                    std::size_t maxLeafTriangles) {
+  clear();
+  maxLeafTriangles = std::max(maxLeafTriangles, std::size_t{1});
+
+  const auto numTriangles{indices.size() / 3};
+  std::vector<TriangleBox> boxes(numTriangles);
+  for (const auto triangle : iter::range(numTriangles)) {
+    const auto& a{vertices[indices[3 * triangle + 0]].position};
+    const auto& b{vertices[indices[3 * triangle + 1]].position};
+    const auto& c{vertices[indices[3 * triangle + 2]].position};
+    const auto normal{glm::cross(b - a, c - a)};
+    if (glm::dot(normal, normal) == 0.0f) continue;
+
+    const auto min{glm::min(a, glm::min(b, c))};
+    const auto max{glm::max(a, glm::max(b, c))};
+    boxes[triangle] = {min, max, (min + max) * 0.5f};
+    m_triangleOrder.push_back(static_cast<std::uint32_t>(triangle));
+  }
+  if (m_triangleOrder.empty()) return;
+
+  struct Task {
+    std::size_t node{};
+    std::size_t begin{};
+    std::size_t end{};
+    std::size_t depth{};
+  };
+  std::vector<Task> tasks{{0, 0, m_triangleOrder.size(), 0}};
+  m_nodes.emplace_back();
+  while (!tasks.empty()) {
+    const auto task{tasks.back()};
+    tasks.pop_back();
+    const auto range{std::span{m_triangleOrder}.subspan(
+        task.begin, task.end - task.begin)};
+
+    Bounds bounds;
+    Bounds centroidBounds;
+    for (const auto triangle : range) {
+      const auto& box{boxes[triangle]};
+      bounds.min = glm::min(bounds.min, box.min);
+      bounds.max = glm::max(bounds.max, box.max);
+      centroidBounds.min = glm::min(centroidBounds.min, box.centroid);
+      centroidBounds.max = glm::max(centroidBounds.max, box.centroid);
+    }
+    m_nodes[task.node].boundsMin = bounds.min;
+    m_nodes[task.node].boundsMax = bounds.max;
+    m_nodes[task.node].first = static_cast<std::uint32_t>(task.begin);
+    m_nodes[task.node].count = static_cast<std::uint32_t>(range.size());
+
+    // Split along the axis where the centroids spread the most
+    const auto extent{centroidBounds.max - centroidBounds.min};
+    const auto axis{extent.x >= extent.y && extent.x >= extent.z ? 0
+                    : extent.y >= extent.z                       ? 1
+                                                                 : 2};
+    if (range.size() <= maxLeafTriangles || task.depth >= maxDepth ||
+        extent[axis] <= 0.0f) {
+      continue;
+    }
+
+    const auto binScale{static_cast<float>(numBins) / extent[axis]};
+    const auto binOf{[&](std::uint32_t triangle) {
+      const auto bin{(boxes[triangle].centroid[axis] -
+                      centroidBounds.min[axis]) *
+                     binScale};
+      return std::min(static_cast<std::size_t>(bin), numBins - 1);
+    }};
+
+    std::array<Bounds, numBins> binBounds;
+    std::array<std::size_t, numBins> binCounts{};
+    for (const auto triangle : range) {
+      const auto bin{binOf(triangle)};
+      binBounds[bin].min = glm::min(binBounds[bin].min, boxes[triangle].min);
+      binBounds[bin].max = glm::max(binBounds[bin].max, boxes[triangle].max);
+      ++binCounts[bin];
+    }
+
+    // Cost of splitting after each bin: area times triangles on each side
+    std::array<float, numBins - 1> leftCosts{};
+    Bounds side;
+    std::size_t sideCount{};
+    for (const auto bin : iter::range(numBins - 1)) {
+      side.min = glm::min(side.min, binBounds[bin].min);
+      side.max = glm::max(side.max, binBounds[bin].max);
+      sideCount += binCounts[bin];
+      leftCosts[bin] = sideCount == 0 ? 0.0f
+                                      : surfaceArea(side.min, side.max) *
+                                            static_cast<float>(sideCount);
+    }
+    side = {};
+    sideCount = 0;
+    auto bestSplit{std::size_t{}};
+    auto bestCost{std::numeric_limits<float>::max()};
+    for (auto bin{numBins - 1}; bin > 0; --bin) {
+      side.min = glm::min(side.min, binBounds[bin].min);
+      side.max = glm::max(side.max, binBounds[bin].max);
+      sideCount += binCounts[bin];
+      const auto cost{leftCosts[bin - 1] +
+                      (sideCount == 0 ? 0.0f
+                                      : surfaceArea(side.min, side.max) *
+                                            static_cast<float>(sideCount))};
+      if (cost <= bestCost) {
+        bestCost = cost;
+        bestSplit = bin - 1;
+      }
+    }
+
+    const auto middle{static_cast<std::size_t>(
+        std::partition(range.begin(), range.end(),
+                       [&](std::uint32_t triangle) {
+                         return binOf(triangle) <= bestSplit;
+                       }) -
+        range.begin())};
+    if (middle == 0 || middle == range.size()) continue;
+
+    const auto left{m_nodes.size()};
+    m_nodes.resize(left + 2);
+    m_nodes[task.node].first = static_cast<std::uint32_t>(left);
+    m_nodes[task.node].count = 0;
+    tasks.push_back({left, task.begin, task.begin + middle, task.depth + 1});
+    tasks.push_back({left + 1, task.begin + middle, task.end, task.depth + 1});
+  }
+
+  gatherTriangles(vertices, indices);
+}
+
+bool MeshBvh::assign(std::span<const Vertex> vertices,
+                     std::span<const std::uint32_t> indices,
+                     std::span<const BvhNode> nodes,
+                     std::span<const std::uint32_t> triangleOrder) {
+  clear();
+
+  const auto numTriangles{indices.size() / 3};
+  const auto validTriangle{[&](std::uint32_t triangle) {
+    return triangle < numTriangles &&
+           std::all_of(&indices[3 * triangle], &indices[3 * triangle + 3],
+                       [&](std::uint32_t index) {
+                         return index < vertices.size();
+                       });
+  }};
+  if (!std::all_of(triangleOrder.begin(), triangleOrder.end(),
+                   validTriangle)) {
+    return false;
+  }
+
+  // Children come after their parent, as build lays them out, so there are
+  // no cycles and one pass finds every depth. Traversals keep fixed stacks
+  // that only fit trees up to maxDepth deep.
+  std::vector<std::size_t> depths(nodes.size());
+  for (const auto index : iter::range(nodes.size())) {
+    const auto& node{nodes[index]};
+    if (node.count != 0) {
+      if (std::size_t{node.first} + node.count > triangleOrder.size()) {
+        return false;
+      }
+      continue;
+    }
+    if (node.first <= index || std::size_t{node.first} + 1 >= nodes.size() ||
+        depths[index] >= maxDepth) {
+      return false;
+    }
+    for (const auto child : {node.first, node.first + 1}) {
+      depths[child] = std::max(depths[child], depths[index] + 1);
+    }
+  }
+
+  m_nodes.assign(nodes.begin(), nodes.end());
+  m_triangleOrder.assign(triangleOrder.begin(), triangleOrder.end());
+  gatherTriangles(vertices, indices);
+  return true;
+}
+
+void MeshBvh::clear() {
+  m_nodes.clear();
+  m_triangleOrder.clear();
+  m_triangles.clear();
+}
+
+void MeshBvh::gatherTriangles(std::span<const Vertex> vertices,
+                              std::span<const std::uint32_t> indices) {
+  m_triangles.resize(m_triangleOrder.size());
+  for (const auto slot : iter::range(m_triangleOrder.size())) {
+    const auto* corners{&indices[3 * m_triangleOrder[slot]]};
+    for (const auto corner : iter::range(3)) {
+      m_triangles[slot][corner] = vertices[corners[corner]].position;
+    }
+  }
+}
+
+glm::vec3 MeshBvh::slideSphere(const glm::vec3& from, const glm::vec3& to,
+                               float radius) const {
+  if (m_nodes.empty() || radius <= 0.0f) return to;
+
+  // A center that moves less than the radius per step can't cross a surface
+  // it was clear of
+  const auto distance{glm::distance(from, to)};
+  const auto numSteps{std::clamp(
+      static_cast<std::size_t>(std::ceil(distance / (0.5f * radius))),
+      std::size_t{1}, maxSlideSteps)};
+  const auto step{(to - from) / static_cast<float>(numSteps)};
+
+  auto center{from};
+  for ([[maybe_unused]] const auto index : iter::range(numSteps)) {
+    const auto previous{center};
+    center = pushOutSphere(center + step, previous, radius);
+  }
+  return center;
+}
+
+bool MeshBvh::raycast(const glm::vec3& origin, const glm::vec3& direction,
+                      float maxDistance, RayHit& hit) const {
+  if (m_nodes.empty()) return false;
+
+  // Zero components give infinities, which the slab test handles
+  const auto inverseDirection{1.0f / direction};
+  auto nearest{maxDistance};
+  auto nearestSlot{std::numeric_limits<std::size_t>::max()};
+
+  // Nearer children first, so farther ones are mostly skipped
+  std::array<std::uint32_t, maxDepth + 2> stack{};
+  std::size_t stackSize{};
+  stack[stackSize++] = 0;
+  while (stackSize > 0) {
+    const auto& node{m_nodes[stack[--stackSize]]};
+    if (rayEntersBox(origin, inverseDirection, nearest, node) > nearest) {
+      continue;
+    }
+    if (node.count == 0) {
+      auto near{node.first};
+      auto far{node.first + 1};
+      auto nearDistance{
+          rayEntersBox(origin, inverseDirection, nearest, m_nodes[near])};
+      auto farDistance{
+          rayEntersBox(origin, inverseDirection, nearest, m_nodes[far])};
+      if (farDistance < nearDistance) {
+        std::swap(near, far);
+        std::swap(nearDistance, farDistance);
+      }
+      if (farDistance <= nearest) stack[stackSize++] = far;
+      if (nearDistance <= nearest) stack[stackSize++] = near;
+      continue;
+    }
+
+    for (const auto slot : iter::range(node.first, node.first + node.count)) {
+      const auto distance{
+          intersectTriangle(origin, direction, m_triangles[slot])};
+      if (distance <= nearest) {
+        nearest = distance;
+        nearestSlot = slot;
+      }
+    }
+  }
+  if (nearestSlot == std::numeric_limits<std::size_t>::max()) return false;
+
+  hit.distance = nearest;
+  hit.triangle = m_triangleOrder[nearestSlot];
+  hit.point = origin + direction * nearest;
+  return true;
+}
+
+bool MeshBvh::isOccluded(const glm::vec3& origin, const glm::vec3& direction,
+                         float maxDistance) const {
+  if (m_nodes.empty()) return false;
+
+  const auto inverseDirection{1.0f / direction};
+  std::array<std::uint32_t, maxDepth + 2> stack{};
+  std::size_t stackSize{};
+  stack[stackSize++] = 0;
+  while (stackSize > 0) {
+    const auto& node{m_nodes[stack[--stackSize]]};
+    if (rayEntersBox(origin, inverseDirection, maxDistance, node) >
+        maxDistance) {
+      continue;
+    }
+    if (node.count == 0) {
+      stack[stackSize++] = node.first;
+      stack[stackSize++] = node.first + 1;
+      continue;
+    }
+
+    for (const auto slot : iter::range(node.first, node.first + node.count)) {
+      if (intersectTriangle(origin, direction, m_triangles[slot]) <=
+          maxDistance) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+glm::vec3 MeshBvh::pushOutSphere(glm::vec3 center, const glm::vec3& previous,
+                                 float radius) const {
+  // Pushing out of the nearest triangle first keeps a flat surface made of
+  // many triangles from nudging the sphere along their shared edges
+  std::array<std::uint32_t, maxDepth + 2> stack{};
+  for ([[maybe_unused]] const auto iteration :
+       iter::range(maxPushIterations)) {
+    // Overlaps within the tolerance count as touching
+    auto nearestDistance{radius * (1.0f - pushTolerance)};
+    glm::vec3 nearestPoint{};
+    const std::array<glm::vec3, 3>* nearestTriangle{};
+
+    // Nearer children first, so the search radius shrinks early
+    std::size_t stackSize{};
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+      const auto& node{m_nodes[stack[--stackSize]]};
+      const auto limit{nearestDistance * nearestDistance};
+      if (squaredDistanceToBox(center, node) >= limit) continue;
+      if (node.count == 0) {
+        auto near{node.first};
+        auto far{node.first + 1};
+        auto nearDistance{squaredDistanceToBox(center, m_nodes[near])};
+        auto farDistance{squaredDistanceToBox(center, m_nodes[far])};
+        if (farDistance < nearDistance) {
+          std::swap(near, far);
+          std::swap(nearDistance, farDistance);
+        }
+        if (farDistance < limit) stack[stackSize++] = far;
+        if (nearDistance < limit) stack[stackSize++] = near;
+        continue;
+      }
+
+      for (const auto slot : iter::range(node.first, node.first + node.count)) {
+        const auto& triangle{m_triangles[slot]};
+        const auto closest{closestPointOnTriangle(center, triangle)};
+        const auto distance{glm::distance(center, closest)};
+        if (distance < nearestDistance) {
+          nearestDistance = distance;
+          nearestPoint = closest;
+          nearestTriangle = &triangle;
+        }
+      }
+    }
+    if (nearestTriangle == nullptr) return center;
+
+    // A center right on the surface leaves toward the side it came from
+    auto direction{center - nearestPoint};
+    if (nearestDistance <= radius * 1e-4f) {
+      const auto& triangle{*nearestTriangle};
+      direction =
+          glm::cross(triangle[1] - triangle[0], triangle[2] - triangle[0]);
+      if (glm::dot(direction, previous - nearestPoint) < 0.0f) {
+        direction = -direction;
+      }
+    }
+    center = nearestPoint + glm::normalize(direction) * radius;
+  }
+  // Wedged between surfaces: stay put rather than end up inside one
+  return previous;
+}
@@ -0,0 +1,86 @@
+#ifndef MESHBVH_HPP_
+#define MESHBVH_HPP_
+
+#include <array>
+#include <cstdint>
+#include <glm/vec3.hpp>
+#include <span>
+#include <vector>
+
+#include "vertex.hpp"
+
+// Node of a bounding volume hierarchy. Inner nodes have count zero and
+// their children at first and first + 1; leaves hold count triangles of
+// the triangle order from first on.
+struct BvhNode {
+  glm::vec3 boundsMin{};
+  std::uint32_t first{};
+  glm::vec3 boundsMax{};
+  std::uint32_t count{};
+};
+
+// Nearest intersection of a ray with a mesh
+struct RayHit {
+  float distance{};          // In multiples of the ray direction
+  std::uint32_t triangle{};  // Triangle of the mesh (index / 3)
+  glm::vec3 point{};
+};
+
+// Bounding volume hierarchy over the triangles of a mesh, for collision
+// and picking queries on the CPU. Degenerate triangles are left out.
+class MeshBvh {
+ public:
+  // Splits by the surface area heuristic, binning centroids along the
+  // longest axis, until at most maxLeafTriangles remain per leaf
+  void build(std::span<const Vertex> vertices,
+             std::span<const std::uint32_t> indices,
+             std::size_t maxLeafTriangles = 4);
+  // Restores a hierarchy built over the same mesh. Returns false if the
+  // nodes and order don't fit it.
+  bool assign(std::span<const Vertex> vertices,
+              std::span<const std::uint32_t> indices,
+              std::span<const BvhNode> nodes,
+              std::span<const std::uint32_t> triangleOrder);
+  void clear();
+
+  // Moves a sphere from from toward to, in steps short enough that it
+  // can't pass through a surface. Wherever it overlaps the mesh it is
+  // pushed out along the shortest way, so it slides along walls instead of
+  // stopping. Returns where the center ends up.
+  [[nodiscard]] glm::vec3 slideSphere(const glm::vec3& from,
+                                      const glm::vec3& to,
+                                      float radius) const;
+
+  // Finds the nearest triangle, from either side, hit by origin + t *
+  // direction for t in [0, maxDistance]
+  [[nodiscard]] bool raycast(const glm::vec3& origin,
+                             const glm::vec3& direction, float maxDistance,
+                             RayHit& hit) const;
+
+  // Whether the ray hits any triangle for t in [0, maxDistance]. Stops at
+  // the first hit found, so it is cheaper than raycast.
+  [[nodiscard]] bool isOccluded(const glm::vec3& origin,
+                                const glm::vec3& direction,
+                                float maxDistance) const;
+
+  [[nodiscard]] bool empty() const { return m_nodes.empty(); }
+  [[nodiscard]] std::span<const BvhNode> getNodes() const { return m_nodes; }
+  // Triangle of the mesh (index / 3) at each leaf slot
+  [[nodiscard]] std::span<const std::uint32_t> getTriangleOrder() const {
+    return m_triangleOrder;
+  }
+
+ private:
+  std::vector<BvhNode> m_nodes;
+  std::vector<std::uint32_t> m_triangleOrder;
+  // Corner positions in leaf order, so leaves read contiguous memory
+  std::vector<std::array<glm::vec3, 3>> m_triangles;
+
+  void gatherTriangles(std::span<const Vertex> vertices,
+                       std::span<const std::uint32_t> indices);
+  [[nodiscard]] glm::vec3 pushOutSphere(glm::vec3 center,
+                                        const glm::vec3& previous,
+                                        float radius) const;
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include "meshcache.hpp"
+
+#include <array>
+#include <cppitertools/itertools.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr std::size_t sectionAlignment{16};
+
+struct FileHeader {
+  std::uint32_t magic{};
+  std::uint32_t version{};
+  MeshCacheKey key{};
+  std::uint32_t sectionCount{};
+};
+
+struct SectionEntry {
+  std::uint32_t tag{};
+  std::uint32_t reserved{};
+  std::uint64_t offset{};
+  std::uint64_t size{};
+};
+
+std::size_t alignUp(std::size_t value) {
+  return (value + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+}
+
+// FNV-1a over a few windows of the file. Hashing all of a 100+ MB asset on
+// every launch would cost more than the cache saves, so together with size
+// and mtime this only needs to catch in-place edits.
+std::uint64_t sampledHash(const std::filesystem::path& path,
+                          std::uint64_t fileSize) {
+  constexpr std::uint64_t windowSize{64 * 1024};
+  std::uint64_t hash{14695981039346656037ULL};
+
+  std::ifstream stream{path, std::ios::binary};
+  if (!stream) return 0;
+
+  std::vector<char> window(windowSize);
+  const std::array<std::uint64_t, 3> starts{
+      0, fileSize / 2, fileSize > windowSize ? fileSize - windowSize : 0};
+  for (const auto start : starts) {
+    stream.clear();
+    stream.seekg(static_cast<std::streamoff>(start));
+    stream.read(window.data(), static_cast<std::streamsize>(windowSize));
+    const auto count{stream.gcount()};
+    for (std::streamsize i{}; i < count; ++i) {
+      hash ^= static_cast<unsigned char>(window[i]);
+      hash *= 1099511628211ULL;
+    }
+  }
+  return hash;
+}
+
+}  // namespace
+
+MeshCacheKey MeshCacheKey::fromFile(std::string_view path,
+                                    std::uint32_t options) {
+  const std::filesystem::path sourcePath{path};
+  std::error_code error;
+
+  MeshCacheKey key{};
+  key.options = options;
+  key.fileSize = std::filesystem::file_size(sourcePath, error);
+  if (error) return key;
+
+  const auto modified{std::filesystem::last_write_time(sourcePath, error)};
+  if (!error) key.modifiedTime = modified.time_since_epoch().count();
+
+  key.contentHash = sampledHash(sourcePath, key.fileSize);
+  return key;
+}
+
+std::string meshCachePath(std::string_view sourcePath) {
+  return std::string{sourcePath} + ".cache";
+}
+
+MeshCacheReader::~MeshCacheReader() { close(); }
+
+bool MeshCacheReader::open(std::string_view path, const MeshCacheKey& key,
+                           const CacheFormat& format) {
+  close();
+
+#if defined(_WIN32)
+  std::ifstream stream{std::filesystem::path{path}, std::ios::binary};
+  if (!stream) return false;
+  stream.seekg(0, std::ios::end);
+  m_buffer.resize(static_cast<std::size_t>(stream.tellg()));
+  stream.seekg(0);
+  stream.read(reinterpret_cast<char*>(m_buffer.data()),
+              static_cast<std::streamsize>(m_buffer.size()));
+  if (!stream) {
+    close();
+    return false;
+  }
+  m_data = m_buffer.data();
+  m_size = m_buffer.size();
+#else
+  const std::string pathString{path};
+  const int fd{::open(pathString.c_str(), O_RDONLY)};
+  if (fd < 0) return false;
+
+  struct stat status {};
+  if (::fstat(fd, &status) != 0 || status.st_size <= 0) {
+    ::close(fd);
+    return false;
+  }
+
+  auto* mapping{::mmap(nullptr, static_cast<std::size_t>(status.st_size),
+                       PROT_READ, MAP_PRIVATE, fd, 0)};
+  ::close(fd);
+  if (mapping == MAP_FAILED) return false;
+
+  m_data = static_cast<const std::byte*>(mapping);
+  m_size = static_cast<std::size_t>(status.st_size);
+#endif
+
+  // Validate header and section table
+  FileHeader header{};
+  if (m_size < sizeof(header)) {
+    close();
+    return false;
+  }
+  std::memcpy(&header, m_data, sizeof(header));
+
+  const auto tableEnd{sizeof(header) +
+                      std::size_t{header.sectionCount} * sizeof(SectionEntry)};
+  if (header.magic != format.magic || header.version != format.version ||
+      header.key != key || m_size < tableEnd) {
+    close();
+    return false;
+  }
+
+  const auto* entries{
+      reinterpret_cast<const SectionEntry*>(m_data + sizeof(header))};
+  for (const auto& entry :
+       std::span<const SectionEntry>{entries, header.sectionCount}) {
+    if (entry.offset > m_size || entry.size > m_size - entry.offset) {
+      close();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void MeshCacheReader::close() {
+#if !defined(_WIN32)
+  if (m_data != nullptr && m_buffer.empty()) {
+    ::munmap(const_cast<std::byte*>(m_data), m_size);
+  }
+#endif
+  m_buffer.clear();
+  m_data = nullptr;
+  m_size = 0;
+}
+
+std::span<const std::byte> MeshCacheReader::sectionBytes(
+    std::uint32_t tag) const {
+  if (m_data == nullptr) return {};
+
+  FileHeader header{};
+  std::memcpy(&header, m_data, sizeof(header));
+  const auto* entries{
+      reinterpret_cast<const SectionEntry*>(m_data + sizeof(header))};
+  for (const auto& entry :
+       std::span<const SectionEntry>{entries, header.sectionCount}) {
+    if (entry.tag == tag) {
+      return {m_data + entry.offset, static_cast<std::size_t>(entry.size)};
+    }
+  }
+  return {};
+}
+
+bool MeshCacheWriter::write(std::string_view path, const MeshCacheKey& key,
+                            const CacheFormat& format) const {
+  FileHeader header{};
+  header.magic = format.magic;
+  header.version = format.version;
+  header.key = key;
+  header.sectionCount = static_cast<std::uint32_t>(m_sections.size());
+
+  // Lay out sections after the table, each aligned for direct mapping
+  std::vector<SectionEntry> entries;
+  entries.reserve(m_sections.size());
+  auto offset{alignUp(sizeof(header) + m_sections.size() * sizeof(SectionEntry))};
+  for (const auto& section : m_sections) {
+    entries.push_back({section.tag, 0, offset, section.bytes.size()});
+    offset = alignUp(offset + section.bytes.size());
+  }
+
+  // Write to a temporary file and rename, so readers never see partial data
+  const std::filesystem::path finalPath{path};
+  auto tempPath{finalPath};
+  tempPath += ".tmp";
+
+  {
+    std::ofstream stream{tempPath, std::ios::binary | std::ios::trunc};
+    if (!stream) return false;
+
+    const std::array<char, sectionAlignment> padding{};
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(entries.data()),
+                 static_cast<std::streamsize>(entries.size() *
+                                              sizeof(SectionEntry)));
+    for (const auto index : iter::range(entries.size())) {
+      const auto position{static_cast<std::size_t>(stream.tellp())};
+      stream.write(padding.data(),
+                   static_cast<std::streamsize>(entries[index].offset - position));
+      stream.write(reinterpret_cast<const char*>(m_sections[index].bytes.data()),
+                   static_cast<std::streamsize>(m_sections[index].bytes.size()));
+    }
+    if (!stream) {
+      stream.close();
+      std::error_code error;
+      std::filesystem::remove(tempPath, error);
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(tempPath, finalPath, error);
+  if (error) {
+    std::filesystem::remove(tempPath, error);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,102 @@
+#ifndef MESHCACHE_HPP_
+#define MESHCACHE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Four-character code identifying a section of the cache file
+constexpr std::uint32_t makeCacheTag(char a, char b, char c, char d) {
+  return static_cast<std::uint32_t>(static_cast<unsigned char>(a)) |
+         static_cast<std::uint32_t>(static_cast<unsigned char>(b)) << 8 |
+         static_cast<std::uint32_t>(static_cast<unsigned char>(c)) << 16 |
+         static_cast<std::uint32_t>(static_cast<unsigned char>(d)) << 24;
+}
+
+// Magic and version in the header of a file in the tagged-section format.
+// Each kind of file has its own, so that its version only moves when its
+// own sections change.
+struct CacheFormat {
+  std::uint32_t magic{};
+  std::uint32_t version{};
+};
+
+// Bump the version whenever the layout or content of any mesh section
+// changes. Changing the header or section table itself needs a bump of
+// every format.
+constexpr CacheFormat meshCacheFormat{makeCacheTag('L', 'M', 'T', 'C'), 12};
+
+// Identifies the source asset (and load options) a cache was built from
+struct MeshCacheKey {
+  std::uint64_t fileSize{};
+  std::int64_t modifiedTime{};
+  std::uint64_t contentHash{};
+  std::uint32_t options{};
+
+  static MeshCacheKey fromFile(std::string_view path, std::uint32_t options);
+
+  bool operator==(const MeshCacheKey& other) const = default;
+};
+
+// Path of the cache file stored next to a source asset
+std::string meshCachePath(std::string_view sourcePath);
+
+// Memory-maps a cache file and exposes its sections without copying
+class MeshCacheReader {
+ public:
+  MeshCacheReader() = default;
+  MeshCacheReader(const MeshCacheReader&) = delete;
+  MeshCacheReader& operator=(const MeshCacheReader&) = delete;
+  ~MeshCacheReader();
+
+  // Returns false if the file is missing, stale or of another version
+  bool open(std::string_view path, const MeshCacheKey& key,
+            const CacheFormat& format = meshCacheFormat);
+  void close();
+
+  template <typename T>
+  [[nodiscard]] std::span<const T> section(std::uint32_t tag) const {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const auto bytes{sectionBytes(tag)};
+    return {reinterpret_cast<const T*>(bytes.data()), bytes.size() / sizeof(T)};
+  }
+
+  [[nodiscard]] bool hasSection(std::uint32_t tag) const {
+    return sectionBytes(tag).data() != nullptr;
+  }
+
+ private:
+  const std::byte* m_data{};
+  std::size_t m_size{};
+  std::vector<std::byte> m_buffer;  // Used where mmap is unavailable
+
+  [[nodiscard]] std::span<const std::byte> sectionBytes(
+      std::uint32_t tag) const;
+};
+
+// Collects sections and writes them atomically to a cache file
+class MeshCacheWriter {
+ public:
+  template <typename T>
+  void addSection(std::uint32_t tag, std::span<const T> data) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    m_sections.push_back({tag, std::as_bytes(data)});
+  }
+
+  // Returns false (and leaves no partial file) if the cache can't be written
+  bool write(std::string_view path, const MeshCacheKey& key,
+             const CacheFormat& format = meshCacheFormat) const;
+
+ private:
+  struct Section {
+    std::uint32_t tag{};
+    std::span<const std::byte> bytes;
+  };
+  std::vector<Section> m_sections;
+};
+
+#endif
@@ -0,0 +1,146 @@
+#include "meshcluster.hpp"
+
+#include <algorithm>
+#include <cppitertools/itertools.hpp>
+#include <limits>
+#include <numeric>
+
+#include "meshsimplify.hpp"
+#include "threadpool.hpp"
+
+std::vector<MeshCluster> buildClusters(std::span<const Vertex> vertices,
+                                       std::span<std::uint32_t> indices,
+                                       std::size_t maxTriangles) {
+  const auto numTriangles{indices.size() / 3};
+  maxTriangles = std::max<std::size_t>(maxTriangles, 1);
+
+  std::vector<glm::vec3> centroids(numTriangles);
+  for (const auto triangle : iter::range(numTriangles)) {
+    centroids[triangle] = (vertices[indices[3 * triangle + 0]].position +
+                           vertices[indices[3 * triangle + 1]].position +
+                           vertices[indices[3 * triangle + 2]].position) /
+                          3.0f;
+  }
+
+  std::vector<std::uint32_t> order(numTriangles);
+  std::iota(order.begin(), order.end(), 0);
+
+  // Depth-first median split; the left half is visited first
+  struct Range {
+    std::size_t begin{};
+    std::size_t end{};
+  };
+  std::vector<Range> leaves;
+  std::vector<Range> stack{{0, numTriangles}};
+  while (!stack.empty()) {
+    const auto range{stack.back()};
+    stack.pop_back();
+
+    if (range.end - range.begin <= maxTriangles) {
+      if (range.end > range.begin) leaves.push_back(range);
+      continue;
+    }
+
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(std::numeric_limits<float>::lowest());
+    for (const auto i : iter::range(range.begin, range.end)) {
+      min = glm::min(min, centroids[order[i]]);
+      max = glm::max(max, centroids[order[i]]);
+    }
+    const auto extent{max - min};
+    const int axis{extent.x >= extent.y && extent.x >= extent.z ? 0
+                   : extent.y >= extent.z                       ? 1
+                                                                : 2};
+
+    const auto middle{range.begin + (range.end - range.begin) / 2};
+    std::nth_element(order.begin() + static_cast<std::ptrdiff_t>(range.begin),
+                     order.begin() + static_cast<std::ptrdiff_t>(middle),
+                     order.begin() + static_cast<std::ptrdiff_t>(range.end),
+                     [&](std::uint32_t a, std::uint32_t b) {
+                       return centroids[a][axis] < centroids[b][axis];
+                     });
+
+    stack.push_back({middle, range.end});
+    stack.push_back({range.begin, middle});
+  }
+
+  // Rebuild the index buffer in cluster order
+  std::vector<std::uint32_t> sortedIndices;
+  sortedIndices.reserve(indices.size());
+  std::vector<MeshCluster> clusters;
+  clusters.reserve(leaves.size());
+  for (const auto& leaf : leaves) {
+    MeshCluster cluster{};
+    cluster.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    cluster.boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+    cluster.firstIndex = static_cast<std::uint32_t>(sortedIndices.size());
+
+    for (const auto i : iter::range(leaf.begin, leaf.end)) {
+      for (const auto corner : iter::range(3)) {
+        const auto index{indices[3 * order[i] + corner]};
+        sortedIndices.push_back(index);
+        cluster.boundsMin = glm::min(cluster.boundsMin, vertices[index].position);
+        cluster.boundsMax = glm::max(cluster.boundsMax, vertices[index].position);
+      }
+    }
+
+    cluster.indexCount =
+        static_cast<std::uint32_t>(sortedIndices.size()) - cluster.firstIndex;
+    clusters.push_back(cluster);
+  }
+
+  std::ranges::copy(sortedIndices, indices.begin());
+  return clusters;
+}
+
+std::vector<MeshClusterLod> buildClusterLods(
+    std::span<const Vertex> vertices, std::span<const std::uint32_t> indices,
+    std::span<const MeshCluster> clusters,
+    std::vector<std::uint32_t>& lodIndices, ThreadPool& pool) {
+  // Simplify clusters independently; their borders are locked
+  std::vector<std::vector<std::uint32_t>> levels(clusters.size() *
+                                                 (numClusterLods - 1));
+  std::vector<float> errors(levels.size());
+  pool.parallelFor(clusters.size(), [&](std::size_t cluster) {
+    auto source{indices.subspan(clusters[cluster].firstIndex,
+                                clusters[cluster].indexCount)};
+    float sourceError{};
+    for (const auto level : iter::range<std::size_t>(1, numClusterLods)) {
+      const auto slot{cluster * (numClusterLods - 1) + level - 1};
+      const auto target{source.size() / 6 * 3};
+
+      float error{};
+      auto simplified{simplifyMesh(vertices, source, target, error)};
+
+      // Stop when the cluster no longer shrinks noticeably
+      if (simplified.size() * 10 > source.size() * 9) break;
+
+      levels[slot] = std::move(simplified);
+      errors[slot] = sourceError + error;
+      source = levels[slot];
+      sourceError = errors[slot];
+    }
+  });
+
+  std::vector<MeshClusterLod> lods;
+  lods.reserve(clusters.size() * numClusterLods);
+  lodIndices.clear();
+  for (const auto cluster : iter::range(clusters.size())) {
+    lods.push_back(
+        {clusters[cluster].firstIndex, clusters[cluster].indexCount, 0.0f});
+    for (const auto level : iter::range<std::size_t>(1, numClusterLods)) {
+      const auto slot{cluster * (numClusterLods - 1) + level - 1};
+      if (levels[slot].empty()) {
+        lods.push_back(lods.back());
+        continue;
+      }
+      lods.push_back({static_cast<std::uint32_t>(indices.size() +
+                                                 lodIndices.size()),
+                      static_cast<std::uint32_t>(levels[slot].size()),
+                      errors[slot]});
+      lodIndices.insert(lodIndices.end(), levels[slot].begin(),
+                        levels[slot].end());
+    }
+  }
+  return lods;
+}
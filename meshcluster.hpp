@@ -0,0 +1,50 @@
+#ifndef MESHCLUSTER_HPP_
+#define MESHCLUSTER_HPP_
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "vertex.hpp"
+
+class ThreadPool;
+
+// A spatially coherent range of triangles of an index buffer
+struct MeshCluster {
+  glm::vec3 boundsMin{};
+  std::uint32_t firstIndex{};
+  glm::vec3 boundsMax{};
+  std::uint32_t indexCount{};
+};
+
+// Number of levels of detail per cluster, including the full-detail level
+constexpr std::size_t numClusterLods{4};
+
+// One simplified version of a cluster
+struct MeshClusterLod {
+  std::uint32_t firstIndex{};
+  std::uint32_t indexCount{};
+  float error{};  // Largest deviation from the full-detail cluster
+};
+
+// Reorders the triangles of indices so that each cluster is contiguous.
+// Triangles are split recursively at the median centroid along the longest
+// axis until at most maxTriangles remain; clusters are returned in that
+// depth-first order, so neighbors in the list are also close in space.
+// Cluster ranges are relative to the start of indices.
+std::vector<MeshCluster> buildClusters(std::span<const Vertex> vertices,
+                                       std::span<std::uint32_t> indices,
+                                       std::size_t maxTriangles = 4096);
+
+// Builds a chain of numClusterLods levels per cluster (numClusterLods
+// entries per cluster, in cluster order), each with about half the
+// triangles of the previous one. Level 0 is the cluster itself. The indices
+// of the other levels are written to lodIndices, and their ranges assume
+// lodIndices is uploaded right after indices in the same buffer. A level
+// that can't be simplified further repeats the previous one.
+std::vector<MeshClusterLod> buildClusterLods(
+    std::span<const Vertex> vertices, std::span<const std::uint32_t> indices,
+    std::span<const MeshCluster> clusters,
+    std::vector<std::uint32_t>& lodIndices, ThreadPool& pool);
+
+#endif
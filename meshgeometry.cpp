@@ -0,0 +1,197 @@
+#include "meshgeometry.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cppitertools/itertools.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <limits>
+#include <vector>
+
+#include "threadpool.hpp"
+
+namespace {
+
+void computeNormals(std::span<Vertex> vertices,
+                    std::span<const std::uint32_t> indices,
+                    NormalWeighting weighting, ThreadPool* pool) {
+  const auto numVertices{vertices.size()};
+  const auto numCorners{indices.size() - indices.size() % 3};
+  const auto numTriangles{numCorners / 3};
+
+  // Calls function(begin, end) over blocks of [0, count), on the pool if
+  // there is one
+  const auto numBlocks{pool == nullptr ? std::size_t{1} : pool->size() * 4};
+  const auto forEachBlock{[&](std::size_t count, const auto& function) {
+    const auto blockSize{(count + numBlocks - 1) / numBlocks};
+    const auto run{[&](std::size_t block) {
+      const auto begin{std::min(block * blockSize, count)};
+      function(begin, std::min(begin + blockSize, count));
+    }};
+    if (pool == nullptr) {
+      run(0);
+    } else {
+      pool->parallelFor(numBlocks, run);
+    }
+  }};
+
+  // Positions on their own, so the gathers below touch fewer cache lines
+  std::vector<glm::vec3> positions(numVertices);
+  forEachBlock(numVertices, [&](std::size_t begin, std::size_t end) {
+    for (const auto vertex : iter::range(begin, end)) {
+      positions[vertex] = vertices[vertex].position;
+    }
+  });
+
+  // Face normals, with their length twice the area for area weighting or
+  // unit length and an angle per corner for angle weighting
+  const auto angleWeighted{weighting == NormalWeighting::Angle};
+  std::vector<glm::vec3> faceNormals(numTriangles);
+  std::vector<float> cornerAngles(angleWeighted ? numCorners : 0);
+  forEachBlock(numTriangles, [&](std::size_t begin, std::size_t end) {
+    for (const auto triangle : iter::range(begin, end)) {
+      const auto* corners{&indices[3 * triangle]};
+      const std::array<glm::vec3, 3> p{positions[corners[0]],
+                                       positions[corners[1]],
+                                       positions[corners[2]]};
+      auto normal{glm::cross(p[1] - p[0], p[2] - p[0])};
+      if (angleWeighted) {
+        const auto length{glm::length(normal)};
+        normal = length > 0.0f ? normal / length : glm::vec3{};
+        for (const auto corner : iter::range(3)) {
+          if (length == 0.0f) {
+            cornerAngles[3 * triangle + corner] = 0.0f;
+            continue;
+          }
+          // atan2 stays accurate for angles near 0 and pi, unlike acos
+          const auto edge1{p[(corner + 1) % 3] - p[corner]};
+          const auto edge2{p[(corner + 2) % 3] - p[corner]};
+          cornerAngles[3 * triangle + corner] =
+              std::atan2(glm::length(glm::cross(edge1, edge2)),
+                         glm::dot(edge1, edge2));
+        }
+      }
+      faceNormals[triangle] = normal;
+    }
+  });
+
+  const auto contribution{[&](std::size_t corner) {
+    const auto& faceNormal{faceNormals[corner / 3]};
+    return angleWeighted ? faceNormal * cornerAngles[corner] : faceNormal;
+  }};
+  const auto setNormal{[&](std::size_t vertex, const glm::vec3& sum) {
+    const auto length{glm::length(sum)};
+    vertices[vertex].normal = length > 0.0f ? sum / length : glm::vec3{};
+  }};
+
+  // On one thread, scatter in corner order. That adds up the same terms in
+  // the same order as the gather below.
+  if (pool == nullptr || pool->size() == 1) {
+    std::vector<glm::vec3> sums(numVertices);
+    for (const auto corner : iter::range(numCorners)) {
+      sums[indices[corner]] += contribution(corner);
+    }
+    for (const auto vertex : iter::range(numVertices)) {
+      setNormal(vertex, sums[vertex]);
+    }
+    return;
+  }
+
+  // Corners of each vertex, as ranges of one array
+  std::vector<std::uint32_t> firstCorner(numVertices + 1);
+  forEachBlock(numCorners, [&](std::size_t begin, std::size_t end) {
+    for (const auto corner : iter::range(begin, end)) {
+      std::atomic_ref<std::uint32_t>{firstCorner[indices[corner] + 1]}
+          .fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+  for (const auto vertex : iter::range(numVertices)) {
+    firstCorner[vertex + 1] += firstCorner[vertex];
+  }
+  std::vector<std::uint32_t> adjacentCorners(numCorners);
+  {
+    std::vector<std::uint32_t> next(firstCorner.begin(),
+                                     firstCorner.end() - 1);
+    forEachBlock(numCorners, [&](std::size_t begin, std::size_t end) {
+      for (const auto corner : iter::range(begin, end)) {
+        const auto slot{
+            std::atomic_ref<std::uint32_t>{next[indices[corner]]}.fetch_add(
+                1, std::memory_order_relaxed)};
+        adjacentCorners[slot] = static_cast<std::uint32_t>(corner);
+      }
+    });
+  }
+
+  // Gather, in corner order so that the sum doesn't depend on scheduling
+  forEachBlock(numVertices, [&](std::size_t begin, std::size_t end) {
+    for (const auto vertex : iter::range(begin, end)) {
+      const std::span corners{
+          adjacentCorners.begin() + firstCorner[vertex],
+          adjacentCorners.begin() + firstCorner[vertex + 1]};
+      std::ranges::sort(corners);
+
+      glm::vec3 sum{};
+      for (const auto corner : corners) sum += contribution(corner);
+      setNormal(vertex, sum);
+    }
+  });
+}
+
+// Scales by 2 / size around the center of the bounds
+glm::mat4 centerAndScale(const Bounds& bounds, float size) {
+  if (bounds.min.x > bounds.max.x) return glm::mat4{1.0f};  // Empty
+
+  const auto center{(bounds.min + bounds.max) / 2.0f};
+  const auto scaling{size > 0.0f ? 2.0f / size : 1.0f};
+  return glm::translate(glm::scale(glm::mat4{1.0f}, glm::vec3{scaling}),
+                        -center);
+}
+
+}  // namespace
+
+void computeVertexNormals(std::span<Vertex> vertices,
+                          std::span<const std::uint32_t> indices,
+                          NormalWeighting weighting) {
+  computeNormals(vertices, indices, weighting, nullptr);
+}
+
+void computeVertexNormals(std::span<Vertex> vertices,
+                          std::span<const std::uint32_t> indices,
+                          ThreadPool& pool, NormalWeighting weighting) {
+  computeNormals(vertices, indices, weighting, &pool);
+}
+
+Bounds computeBounds(std::span<const Vertex> vertices, ThreadPool& pool) {
+  const auto numVertices{vertices.size()};
+  const auto numBlocks{pool.size() * 4};
+  const auto blockSize{(numVertices + numBlocks - 1) / numBlocks};
+  std::vector<Bounds> blockBounds(numBlocks);
+  pool.parallelFor(numBlocks, [&](std::size_t block) {
+    const auto begin{std::min(block * blockSize, numVertices)};
+    const auto end{std::min(begin + blockSize, numVertices)};
+    Bounds bounds;
+    for (const auto vertex : iter::range(begin, end)) {
+      bounds.min = glm::min(bounds.min, vertices[vertex].position);
+      bounds.max = glm::max(bounds.max, vertices[vertex].position);
+    }
+    blockBounds[block] = bounds;
+  });
+
+  Bounds bounds;
+  for (const auto& block : blockBounds) {
+    bounds.min = glm::min(bounds.min, block.min);
+    bounds.max = glm::max(bounds.max, block.max);
+  }
+  return bounds;
+}
+
+glm::mat4 standardizeTransform(const Bounds& bounds) {
+  return centerAndScale(bounds, glm::length(bounds.max - bounds.min));
+}
+
+glm::mat4 quantizeTransform(const Bounds& bounds) {
+  const auto size{bounds.max - bounds.min};
+  return centerAndScale(bounds, std::max({size.x, size.y, size.z}));
+}
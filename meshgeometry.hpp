@@ -0,0 +1,50 @@
+#ifndef MESHGEOMETRY_HPP_
+#define MESHGEOMETRY_HPP_
+
+#include <cstdint>
+#include <glm/mat4x4.hpp>
+#include <limits>
+#include <span>
+
+#include "vertex.hpp"
+
+class ThreadPool;
+
+// How the normals of the triangles around a vertex add up to its normal
+enum class NormalWeighting {
+  Area,   // By triangle area, favoring large triangles
+  Angle,  // By the triangle's angle at the vertex, so the result doesn't
+          // depend on how the surface is triangulated
+};
+
+// Sets each vertex normal to the normalized weighted sum of the normals of
+// the triangles that use it. Vertices that no triangle uses, or only
+// degenerate ones, get a zero normal. Each vertex gathers its triangles
+// through an adjacency list in triangle order, so the result is the same
+// with and without a pool.
+void computeVertexNormals(std::span<Vertex> vertices,
+                          std::span<const std::uint32_t> indices,
+                          NormalWeighting weighting = NormalWeighting::Area);
+void computeVertexNormals(std::span<Vertex> vertices,
+                          std::span<const std::uint32_t> indices,
+                          ThreadPool& pool,
+                          NormalWeighting weighting = NormalWeighting::Area);
+
+// Axis-aligned bounds of a set of points; empty bounds have min > max
+struct Bounds {
+  glm::vec3 min{std::numeric_limits<float>::max()};
+  glm::vec3 max{std::numeric_limits<float>::lowest()};
+};
+
+// Bounds of the vertex positions, reduced per block on the pool
+Bounds computeBounds(std::span<const Vertex> vertices, ThreadPool& pool);
+
+// Centers the bounds on the origin and scales them so that their diagonal
+// has length 2, which keeps them within [-1, 1]
+glm::mat4 standardizeTransform(const Bounds& bounds);
+
+// Centers the bounds on the origin and scales them uniformly so that their
+// longest side spans [-1, 1], to quantize positions at full precision
+glm::mat4 quantizeTransform(const Bounds& bounds);
+
+#endif
@@ -0,0 +1,357 @@
+#include "meshoptimize.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cppitertools/itertools.hpp>
+#include <glm/geometric.hpp>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+constexpr auto noTriangle{std::numeric_limits<std::uint32_t>::max()};
+
+// Renumbers the vertices referenced by indices as 0..numVertices-1
+struct LocalIndices {
+  std::vector<std::uint32_t> globalIds;
+  std::vector<std::uint32_t> indices;
+
+  explicit LocalIndices(std::span<const std::uint32_t> source)
+      : globalIds(source.begin(), source.end()), indices(source.size()) {
+    std::ranges::sort(globalIds);
+    globalIds.erase(std::unique(globalIds.begin(), globalIds.end()),
+                    globalIds.end());
+    for (const auto i : iter::range(source.size())) {
+      indices[i] = static_cast<std::uint32_t>(
+          std::ranges::lower_bound(globalIds, source[i]) - globalIds.begin());
+    }
+  }
+};
+
+// FIFO post-transform cache. A vertex is cached if fewer than cacheSize
+// misses happened since it was loaded.
+class FifoCache {
+ public:
+  FifoCache(std::size_t numVertices, std::size_t cacheSize)
+      : m_loadedAt(numVertices), m_cacheSize{cacheSize}, m_misses{cacheSize} {}
+
+  // Returns the number of vertices of the triangle that missed
+  unsigned triangle(const std::uint32_t* corners) {
+    unsigned misses{};
+    for (const auto corner : iter::range(3)) {
+      const auto vertex{corners[corner]};
+      if (m_misses - m_loadedAt[vertex] >= m_cacheSize) {
+        m_loadedAt[vertex] = ++m_misses;
+        ++misses;
+      }
+    }
+    return misses;
+  }
+
+  void flush() { m_misses += m_cacheSize; }
+
+ private:
+  std::vector<std::size_t> m_loadedAt;
+  std::size_t m_cacheSize{};
+  std::size_t m_misses{};
+};
+
+// Forsyth's scoring, with an LRU cache of 32 vertices
+constexpr std::size_t scoringCacheSize{32};
+
+const auto cachePositionScores{[] {
+  std::array<float, scoringCacheSize> scores{};
+  for (const auto position : iter::range(scoringCacheSize)) {
+    // The last triangle's vertices score the same regardless of order
+    scores[position] =
+        position < 3
+            ? 0.75f
+            : std::pow(1.0f - static_cast<float>(position - 3) /
+                                  static_cast<float>(scoringCacheSize - 3),
+                       1.5f);
+  }
+  return scores;
+}()};
+
+float vertexScore(int cachePosition, std::uint32_t liveTriangles) {
+  // Vertices without triangles left must not attract any
+  if (liveTriangles == 0) return -1.0f;
+
+  const auto cacheScore{cachePosition < 0 ? 0.0f
+                                          : cachePositionScores[cachePosition]};
+  // Favor vertices with few triangles left, to finish them off
+  return cacheScore +
+         2.0f / std::sqrt(static_cast<float>(liveTriangles));
+}
+
+}  // namespace
+
+VertexCacheStats analyzeVertexCache(std::span<const std::uint32_t> indices,
+                                    std::size_t cacheSize) {
+  if (indices.empty()) return {};
+
+  const LocalIndices local{indices};
+  FifoCache cache{local.globalIds.size(), cacheSize};
+  std::size_t misses{};
+  for (const auto offset : iter::range<std::size_t>(0, indices.size(), 3)) {
+    misses += cache.triangle(&local.indices[offset]);
+  }
+
+  return {static_cast<float>(misses) / static_cast<float>(indices.size() / 3),
+          static_cast<float>(misses) /
+              static_cast<float>(local.globalIds.size())};
+}
+
+void optimizeVertexCache(std::span<std::uint32_t> indices) {
+  const auto numTriangles{indices.size() / 3};
+  if (numTriangles == 0) return;
+
+  const LocalIndices local{indices};
+  const auto numVertices{local.globalIds.size()};
+
+  // Triangles around each vertex (CSR layout). The live ones are kept at the
+  // front of each list.
+  std::vector<std::uint32_t> adjacencyBegin(numVertices + 1);
+  for (const auto vertex : local.indices) ++adjacencyBegin[vertex + 1];
+  for (const auto vertex : iter::range(numVertices)) {
+    adjacencyBegin[vertex + 1] += adjacencyBegin[vertex];
+  }
+  std::vector<std::uint32_t> adjacency(local.indices.size());
+  std::vector<std::uint32_t> liveTriangles(numVertices);
+  for (const auto i : iter::range(local.indices.size())) {
+    const auto vertex{local.indices[i]};
+    adjacency[adjacencyBegin[vertex] + liveTriangles[vertex]++] =
+        static_cast<std::uint32_t>(i / 3);
+  }
+
+  std::vector<int> cachePositions(numVertices, -1);
+  std::vector<float> vertexScores(numVertices);
+  for (const auto vertex : iter::range(numVertices)) {
+    vertexScores[vertex] = vertexScore(-1, liveTriangles[vertex]);
+  }
+
+  const auto* corners{local.indices.data()};
+  const auto triangleScore{[&](std::uint32_t triangle) {
+    return vertexScores[corners[3 * triangle + 0]] +
+           vertexScores[corners[3 * triangle + 1]] +
+           vertexScores[corners[3 * triangle + 2]];
+  }};
+
+  std::vector<bool> emitted(numTriangles, false);
+  auto bestTriangle{std::uint32_t{}};
+  auto bestScore{-std::numeric_limits<float>::max()};
+  for (const auto triangle : iter::range<std::uint32_t>(numTriangles)) {
+    if (const auto score{triangleScore(triangle)}; score > bestScore) {
+      bestScore = score;
+      bestTriangle = triangle;
+    }
+  }
+
+  // The cache briefly holds the three new vertices on top of its capacity
+  std::vector<std::uint32_t> cache;
+  std::vector<std::uint32_t> nextCache;
+  cache.reserve(scoringCacheSize + 3);
+  nextCache.reserve(scoringCacheSize + 3);
+
+  std::vector<std::uint32_t> output;
+  output.reserve(indices.size());
+  std::size_t cursor{};
+
+  while (bestTriangle != noTriangle) {
+    emitted[bestTriangle] = true;
+    const std::array triangleCorners{corners[3 * bestTriangle + 0],
+                                     corners[3 * bestTriangle + 1],
+                                     corners[3 * bestTriangle + 2]};
+    for (const auto vertex : triangleCorners) {
+      output.push_back(vertex);
+
+      // Remove the triangle from the vertex's live list
+      const auto begin{adjacency.begin() + adjacencyBegin[vertex]};
+      const auto end{begin + liveTriangles[vertex]};
+      std::iter_swap(std::find(begin, end, bestTriangle), end - 1);
+      --liveTriangles[vertex];
+    }
+
+    // The emitted vertices move to the front of the cache
+    nextCache.assign(triangleCorners.begin(), triangleCorners.end());
+    for (const auto vertex : cache) {
+      if (std::ranges::find(triangleCorners, vertex) == triangleCorners.end()) {
+        nextCache.push_back(vertex);
+      }
+    }
+
+    for (const auto position : iter::range(nextCache.size())) {
+      const auto vertex{nextCache[position]};
+      cachePositions[vertex] =
+          position < scoringCacheSize ? static_cast<int>(position) : -1;
+      vertexScores[vertex] =
+          vertexScore(cachePositions[vertex], liveTriangles[vertex]);
+    }
+
+    // Only triangles around cached vertices changed score
+    bestTriangle = noTriangle;
+    bestScore = -std::numeric_limits<float>::max();
+    for (const auto vertex : nextCache) {
+      const auto begin{adjacencyBegin[vertex]};
+      for (const auto triangle :
+           std::span{adjacency}.subspan(begin, liveTriangles[vertex])) {
+        if (const auto score{triangleScore(triangle)}; score > bestScore) {
+          bestScore = score;
+          bestTriangle = triangle;
+        }
+      }
+    }
+
+    if (nextCache.size() > scoringCacheSize) {
+      nextCache.resize(scoringCacheSize);
+    }
+    std::swap(cache, nextCache);
+
+    // Dead end: continue with the next triangle in the original order
+    if (bestTriangle == noTriangle) {
+      while (cursor < numTriangles && emitted[cursor]) ++cursor;
+      if (cursor < numTriangles) {
+        bestTriangle = static_cast<std::uint32_t>(cursor);
+      }
+    }
+  }
+
+  for (const auto i : iter::range(indices.size())) {
+    indices[i] = local.globalIds[output[i]];
+  }
+}
+
+void optimizeOverdraw(std::span<std::uint32_t> indices,
+                      std::span<const Vertex> vertices, float threshold) {
+  const auto numTriangles{indices.size() / 3};
+  if (numTriangles == 0) return;
+
+  constexpr std::size_t cacheSize{16};
+  const LocalIndices local{indices};
+  const auto numVertices{local.globalIds.size()};
+  const auto* corners{local.indices.data()};
+
+  // Hard boundaries: triangles where the order restarts in a cold region
+  std::vector<std::size_t> hardBoundaries;
+  {
+    FifoCache cache{numVertices, cacheSize};
+    for (const auto triangle : iter::range(numTriangles)) {
+      if (cache.triangle(&corners[3 * triangle]) == 3) {
+        hardBoundaries.push_back(triangle);
+      }
+    }
+    hardBoundaries.push_back(numTriangles);
+  }
+
+  // Soft boundaries: split each hard patch where the miss rate so far is
+  // already close to the patch's average, so splitting costs little
+  std::vector<std::size_t> patchBegins;
+  for (const auto hard : iter::range(hardBoundaries.size() - 1)) {
+    const auto begin{hardBoundaries[hard]};
+    const auto end{hardBoundaries[hard + 1]};
+
+    FifoCache cache{numVertices, cacheSize};
+    std::size_t misses{};
+    for (const auto triangle : iter::range(begin, end)) {
+      misses += cache.triangle(&corners[3 * triangle]);
+    }
+    const auto limit{threshold * static_cast<float>(misses) /
+                     static_cast<float>(end - begin)};
+
+    cache.flush();
+    patchBegins.push_back(begin);
+    std::size_t patchMisses{};
+    std::size_t patchTriangles{};
+    for (const auto triangle : iter::range(begin, end)) {
+      patchMisses += cache.triangle(&corners[3 * triangle]);
+      ++patchTriangles;
+      if (triangle + 1 < end &&
+          static_cast<float>(patchMisses) <=
+              limit * static_cast<float>(patchTriangles)) {
+        patchBegins.push_back(triangle + 1);
+        cache.flush();
+        patchMisses = 0;
+        patchTriangles = 0;
+      }
+    }
+  }
+  patchBegins.push_back(numTriangles);
+  const auto numPatches{patchBegins.size() - 1};
+
+  // Area-weighted centroid and normal of each patch
+  std::vector<glm::vec3> centroids(numPatches);
+  std::vector<glm::vec3> normals(numPatches);
+  std::vector<float> areas(numPatches);
+  glm::vec3 meshCentroid{};
+  float meshArea{};
+  for (const auto patch : iter::range(numPatches)) {
+    glm::vec3 weightedSum{};
+    glm::vec3 plainSum{};
+    for (const auto triangle :
+         iter::range(patchBegins[patch], patchBegins[patch + 1])) {
+      const auto& a{vertices[indices[3 * triangle + 0]].position};
+      const auto& b{vertices[indices[3 * triangle + 1]].position};
+      const auto& c{vertices[indices[3 * triangle + 2]].position};
+      const auto normal{glm::cross(b - a, c - a)};
+      const auto area{glm::length(normal)};
+      const auto centroid{(a + b + c) / 3.0f};
+
+      normals[patch] += normal;
+      weightedSum += centroid * area;
+      plainSum += centroid;
+      areas[patch] += area;
+    }
+    const auto count{
+        static_cast<float>(patchBegins[patch + 1] - patchBegins[patch])};
+    centroids[patch] =
+        areas[patch] > 0.0f ? weightedSum / areas[patch] : plainSum / count;
+    meshCentroid += weightedSum;
+    meshArea += areas[patch];
+  }
+  if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+  // Patches pointing away from the center first
+  std::vector<float> keys(numPatches);
+  for (const auto patch : iter::range(numPatches)) {
+    const auto length{glm::length(normals[patch])};
+    keys[patch] = length > 0.0f ? glm::dot(centroids[patch] - meshCentroid,
+                                           normals[patch] / length)
+                                : 0.0f;
+  }
+  std::vector<std::size_t> order(numPatches);
+  std::iota(order.begin(), order.end(), 0);
+  std::ranges::stable_sort(order, std::ranges::greater{},
+                           [&](std::size_t patch) { return keys[patch]; });
+
+  std::vector<std::uint32_t> output;
+  output.reserve(indices.size());
+  for (const auto patch : order) {
+    output.insert(output.end(), indices.begin() + 3 * patchBegins[patch],
+                  indices.begin() + 3 * patchBegins[patch + 1]);
+  }
+  std::ranges::copy(output, indices.begin());
+}
+
+std::vector<std::uint32_t> optimizeVertexFetch(
+    std::vector<Vertex>& vertices, std::span<std::uint32_t> indices) {
+  constexpr auto unused{std::numeric_limits<std::uint32_t>::max()};
+
+  std::vector<std::uint32_t> remap(vertices.size(), unused);
+  std::uint32_t next{};
+  for (auto& index : indices) {
+    if (remap[index] == unused) remap[index] = next++;
+    index = remap[index];
+  }
+  for (auto& position : remap) {
+    if (position == unused) position = next++;
+  }
+
+  std::vector<Vertex> reordered(vertices.size());
+  for (const auto vertex : iter::range(vertices.size())) {
+    reordered[remap[vertex]] = vertices[vertex];
+  }
+  vertices = std::move(reordered);
+
+  return remap;
+}
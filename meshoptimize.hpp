@@ -0,0 +1,42 @@
+#ifndef MESHOPTIMIZE_HPP_
+#define MESHOPTIMIZE_HPP_
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "vertex.hpp"
+
+// Post-transform vertex cache efficiency of a triangle list, simulated with
+// a FIFO cache of cacheSize vertices
+struct VertexCacheStats {
+  float acmr{};  // Average cache misses per triangle; 0.5 is the ideal
+  float atvr{};  // Average transforms per referenced vertex; 1 is the ideal
+};
+
+VertexCacheStats analyzeVertexCache(std::span<const std::uint32_t> indices,
+                                    std::size_t cacheSize = 16);
+
+// Reorders triangles for the post-transform cache using Forsyth's linear
+// speed algorithm: the next triangle is the one whose vertices score best
+// from their position in a simulated LRU cache and from how many
+// triangles still use them.
+void optimizeVertexCache(std::span<std::uint32_t> indices);
+
+// Splits an index buffer ordered by optimizeVertexCache into patches at the
+// points where the simulated cache restarts or its miss rate falls within
+// threshold times the average, and sorts the patches so that the ones
+// facing away from the center of the mesh are drawn first, as in Tipsify.
+// Those are the least likely to be occluded, so early depth tests reject
+// more of what follows.
+void optimizeOverdraw(std::span<std::uint32_t> indices,
+                      std::span<const Vertex> vertices,
+                      float threshold = 1.05f);
+
+// Reorders vertices by first use in indices and rewrites them. Returns the
+// new position of each old vertex, to remap other index buffers that share
+// the vertices. Vertices that indices doesn't use are kept at the end.
+std::vector<std::uint32_t> optimizeVertexFetch(
+    std::vector<Vertex>& vertices, std::span<std::uint32_t> indices);
+
+#endif
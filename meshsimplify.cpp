@@ -0,0 +1,238 @@
+#include "meshsimplify.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cppitertools/itertools.hpp>
+#include <glm/geometric.hpp>
+#include <numeric>
+
+namespace {
+
+// Symmetric 4x4 matrix accumulating squared distances to planes
+struct Quadric {
+  double a2{}, ab{}, ac{}, ad{}, b2{}, bc{}, bd{}, c2{}, cd{}, d2{};
+
+  void addPlane(const glm::dvec3& normal, double distance) {
+    a2 += normal.x * normal.x;
+    ab += normal.x * normal.y;
+    ac += normal.x * normal.z;
+    ad += normal.x * distance;
+    b2 += normal.y * normal.y;
+    bc += normal.y * normal.z;
+    bd += normal.y * distance;
+    c2 += normal.z * normal.z;
+    cd += normal.z * distance;
+    d2 += distance * distance;
+  }
+
+  Quadric& operator+=(const Quadric& other) {
+    a2 += other.a2;
+    ab += other.ab;
+    ac += other.ac;
+    ad += other.ad;
+    b2 += other.b2;
+    bc += other.bc;
+    bd += other.bd;
+    c2 += other.c2;
+    cd += other.cd;
+    d2 += other.d2;
+    return *this;
+  }
+
+  [[nodiscard]] double evaluate(const glm::vec3& point) const {
+    const double x{point.x};
+    const double y{point.y};
+    const double z{point.z};
+    return std::max(0.0, a2 * x * x + 2 * ab * x * y + 2 * ac * x * z +
+                             2 * ad * x + b2 * y * y + 2 * bc * y * z +
+                             2 * bd * y + c2 * z * z + 2 * cd * z + d2);
+  }
+};
+
+struct Collapse {
+  double cost{};
+  std::uint32_t from{};
+  std::uint32_t to{};
+};
+
+glm::vec3 faceNormal(const glm::vec3& a, const glm::vec3& b,
+                     const glm::vec3& c) {
+  return glm::cross(b - a, c - a);
+}
+
+}  // namespace
+
+std::vector<std::uint32_t> simplifyMesh(std::span<const Vertex> vertices,
+                                        std::span<const std::uint32_t> indices,
+                                        std::size_t targetIndexCount,
+                                        float& error) {
+  error = 0.0f;
+
+  // Work on a compact local numbering of the referenced vertices
+  std::vector<std::uint32_t> globalIds(indices.begin(), indices.end());
+  std::ranges::sort(globalIds);
+  globalIds.erase(std::unique(globalIds.begin(), globalIds.end()),
+                  globalIds.end());
+  const auto numVertices{globalIds.size()};
+
+  std::vector<std::uint32_t> current(indices.size());
+  for (const auto i : iter::range(indices.size())) {
+    current[i] = static_cast<std::uint32_t>(
+        std::ranges::lower_bound(globalIds, indices[i]) - globalIds.begin());
+  }
+  const auto position{[&](std::uint32_t local) -> const glm::vec3& {
+    return vertices[globalIds[local]].position;
+  }};
+
+  // Quadrics of the planes around each vertex
+  std::vector<Quadric> quadrics(numVertices);
+  for (const auto offset : iter::range<std::size_t>(0, current.size(), 3)) {
+    const auto normal{faceNormal(position(current[offset + 0]),
+                                 position(current[offset + 1]),
+                                 position(current[offset + 2]))};
+    const auto length{glm::length(normal)};
+    if (length <= 0.0f) continue;
+
+    const glm::dvec3 unitNormal{normal / length};
+    const auto distance{
+        -glm::dot(unitNormal, glm::dvec3(position(current[offset])))};
+    for (const auto corner : iter::range(3)) {
+      quadrics[current[offset + corner]].addPlane(unitNormal, distance);
+    }
+  }
+
+  // Lock vertices of edges used by a single triangle
+  std::vector<bool> locked(numVertices, false);
+  {
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> edges;
+    edges.reserve(current.size());
+    for (const auto offset : iter::range<std::size_t>(0, current.size(), 3)) {
+      for (const auto corner : iter::range(3)) {
+        const auto a{current[offset + corner]};
+        const auto b{current[offset + (corner + 1) % 3]};
+        edges.emplace_back(std::min(a, b), std::max(a, b));
+      }
+    }
+    std::ranges::sort(edges);
+    for (std::size_t i{}; i < edges.size();) {
+      auto j{i + 1};
+      while (j < edges.size() && edges[j] == edges[i]) ++j;
+      if (j - i == 1) {
+        locked[edges[i].first] = true;
+        locked[edges[i].second] = true;
+      }
+      i = j;
+    }
+  }
+
+  double maxCost{};
+  std::vector<std::uint32_t> remap(numVertices);
+  std::vector<bool> touched(numVertices);
+  std::vector<std::uint32_t> adjacencyBegin(numVertices + 1);
+  std::vector<std::uint32_t> adjacency;
+  std::vector<Collapse> collapses;
+
+  while (current.size() > targetIndexCount) {
+    // Triangles around each vertex (CSR layout)
+    std::ranges::fill(adjacencyBegin, 0);
+    for (const auto vertex : current) ++adjacencyBegin[vertex + 1];
+    for (const auto vertex : iter::range(numVertices)) {
+      adjacencyBegin[vertex + 1] += adjacencyBegin[vertex];
+    }
+    adjacency.resize(current.size());
+    {
+      auto next{adjacencyBegin};
+      for (const auto i : iter::range(current.size())) {
+        adjacency[next[current[i]]++] = static_cast<std::uint32_t>(i / 3);
+      }
+    }
+
+    // Candidate half-edge collapses, cheapest first
+    collapses.clear();
+    for (const auto offset : iter::range<std::size_t>(0, current.size(), 3)) {
+      for (const auto corner : iter::range(3)) {
+        const auto a{current[offset + corner]};
+        const auto b{current[offset + (corner + 1) % 3]};
+        for (const auto& [from, to] : {std::pair{a, b}, std::pair{b, a}}) {
+          if (locked[from]) continue;
+          auto quadric{quadrics[from]};
+          quadric += quadrics[to];
+          collapses.push_back({quadric.evaluate(position(to)), from, to});
+        }
+      }
+    }
+    if (collapses.empty()) break;
+    std::ranges::sort(collapses, {}, &Collapse::cost);
+
+    // Apply independent collapses; each one removes about two triangles
+    std::iota(remap.begin(), remap.end(), 0);
+    std::fill(touched.begin(), touched.end(), false);
+    const auto maxCollapses{(current.size() - targetIndexCount) / 6 + 1};
+    std::size_t numCollapses{};
+    for (const auto& collapse : collapses) {
+      if (numCollapses == maxCollapses) break;
+      if (touched[collapse.from] || touched[collapse.to]) continue;
+
+      // Reject if any triangle that keeps its area would flip
+      bool flips{false};
+      for (const auto triangle :
+           std::span{adjacency}.subspan(adjacencyBegin[collapse.from],
+                                        adjacencyBegin[collapse.from + 1] -
+                                            adjacencyBegin[collapse.from])) {
+        std::array<std::uint32_t, 3> corners{current[3 * triangle + 0],
+                                             current[3 * triangle + 1],
+                                             current[3 * triangle + 2]};
+        if (std::ranges::find(corners, collapse.to) != corners.end()) continue;
+
+        const auto before{faceNormal(position(corners[0]), position(corners[1]),
+                                     position(corners[2]))};
+        std::ranges::replace(corners, collapse.from, collapse.to);
+        const auto after{faceNormal(position(corners[0]), position(corners[1]),
+                                    position(corners[2]))};
+        if (glm::dot(before, after) <= 0.0f) {
+          flips = true;
+          break;
+        }
+      }
+      if (flips) continue;
+
+      // Neighbors can't collapse in this pass: their flip test assumed the
+      // current positions
+      for (const auto triangle :
+           std::span{adjacency}.subspan(adjacencyBegin[collapse.from],
+                                        adjacencyBegin[collapse.from + 1] -
+                                            adjacencyBegin[collapse.from])) {
+        for (const auto corner : iter::range(3)) {
+          touched[current[3 * triangle + corner]] = true;
+        }
+      }
+
+      remap[collapse.from] = collapse.to;
+      quadrics[collapse.to] += quadrics[collapse.from];
+      maxCost = std::max(maxCost, collapse.cost);
+      ++numCollapses;
+    }
+    if (numCollapses == 0) break;
+
+    // Rewrite triangles, dropping the ones that became degenerate
+    std::size_t size{};
+    for (const auto offset : iter::range<std::size_t>(0, current.size(), 3)) {
+      const auto a{remap[current[offset + 0]]};
+      const auto b{remap[current[offset + 1]]};
+      const auto c{remap[current[offset + 2]]};
+      if (a == b || b == c || c == a) continue;
+      current[size++] = a;
+      current[size++] = b;
+      current[size++] = c;
+    }
+    current.resize(size);
+  }
+
+  error = static_cast<float>(std::sqrt(maxCost));
+
+  for (auto& index : current) {
+    index = globalIds[index];
+  }
+  return current;
+}
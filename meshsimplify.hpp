@@ -0,0 +1,22 @@
+#ifndef MESHSIMPLIFY_HPP_
+#define MESHSIMPLIFY_HPP_
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "vertex.hpp"
+
+// Simplifies a triangle list towards targetIndexCount by collapsing edges
+// onto one of their existing vertices, cheapest quadric error first, so the
+// result indexes the same vertex buffer. Vertices on open edges are locked;
+// this keeps the border shared with neighboring pieces of the mesh and the
+// UV seams (where vertices are split) intact. Collapses that would flip a
+// triangle are rejected. error receives an estimate of the largest
+// geometric deviation introduced, in model units.
+std::vector<std::uint32_t> simplifyMesh(std::span<const Vertex> vertices,
+                                        std::span<const std::uint32_t> indices,
+                                        std::size_t targetIndexCount,
+                                        float& error);
+
+#endif
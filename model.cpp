@@ -1,217 +1,657 @@
 #include "model.hpp"
 
 #include <fmt/core.h>
-#include <tiny_obj_loader.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <cppitertools/itertools.hpp>
 #include <filesystem>
-#include <glm/gtx/hash.hpp>
-#include <unordered_map>
-
-// Explicit specialization of std::hash for Vertex
-namespace std {
-template <>
-struct hash<Vertex> {
-  size_t operator()(Vertex const& vertex) const noexcept {
-    const std::size_t h1{std::hash<glm::vec3>()(vertex.position)};
-    const std::size_t h2{std::hash<glm::vec3>()(vertex.normal)};
-    const std::size_t h3{std::hash<glm::vec2>()(vertex.texCoord)};
-    return h1 ^ h2 ^ h3;
-  }
+#include <utility>
+
+#include "ambientocclusion.hpp"
+#include "meshcache.hpp"
+#include "meshgeometry.hpp"
+#include "meshoptimize.hpp"
+#include "objparser.hpp"
+#include "potentiallyvisible.hpp"
+#include "renderstate.hpp"
+#include "texturecache.hpp"
+#include "threadpool.hpp"
+#include "vertexwelder.hpp"
+
+namespace {
+
+// Sections of the binary mesh cache
+constexpr auto verticesTag{makeCacheTag('V', 'E', 'R', 'T')};
+constexpr auto indicesTag{makeCacheTag('I', 'N', 'D', 'X')};
+constexpr auto flagsTag{makeCacheTag('F', 'L', 'A', 'G')};
+constexpr auto materialsTag{makeCacheTag('M', 'A', 'T', 'L')};
+constexpr auto diffuseTexNamesTag{makeCacheTag('T', 'E', 'X', 'N')};
+constexpr auto clustersTag{makeCacheTag('C', 'L', 'U', 'S')};
+constexpr auto clusterLodsTag{makeCacheTag('L', 'O', 'D', 'S')};
+constexpr auto lodIndicesTag{makeCacheTag('L', 'I', 'D', 'X')};
+constexpr auto boundsTag{makeCacheTag('B', 'N', 'D', 'S')};
+constexpr auto bvhNodesTag{makeCacheTag('B', 'V', 'H', 'N')};
+constexpr auto bvhOrderTag{makeCacheTag('B', 'V', 'H', 'T')};
+constexpr auto occlusionTag{makeCacheTag('A', 'O', 'C', 'C')};
+constexpr auto pvsGridTag{makeCacheTag('P', 'V', 'S', 'G')};
+constexpr auto pvsCellsTag{makeCacheTag('P', 'V', 'S', 'C')};
+constexpr auto pvsSetsTag{makeCacheTag('P', 'V', 'S', 'S')};
+
+// Reach of the occlusion rays, relative to the diagonal of the bounds
+constexpr float occlusionDistance{0.02f};
+// Growth of the view regions covered by visibility sets, relative to the
+// diagonal of the bounds
+constexpr float visibilityMargin{0.02f};
+
+struct CachedFlags {
+  std::uint32_t hasNormals{};
+  std::uint32_t hasTexCoords{};
 };
-}  // namespace std
 
-void Model::computeNormals() {
-  // Clear previous vertex normals
-  for (auto& vertex : m_vertices) {
-    vertex.normal = glm::zero<glm::vec3>();
-  }
+// Key options for what the visibility sets cover. View regions are in shown
+// positions, so whether the mesh is standardized matters too.
+std::uint32_t hashViewRegions(std::span<const Bounds> viewRegions,
+                              bool standardize) {
+  if (viewRegions.empty()) return 0;
+
+  // FNV-1a
+  std::uint32_t hash{2166136261U};
+  const auto add{[&](std::span<const std::byte> bytes) {
+    for (const auto byte : bytes) {
+      hash = (hash ^ std::to_integer<std::uint32_t>(byte)) * 16777619U;
+    }
+  }};
+  add(std::as_bytes(viewRegions));
+  add(std::as_bytes(std::span{&standardize, 1}));
+  return hash;
+}
 
-  // Compute face normals
-  for (const auto offset : iter::range<int>(0, m_indices.size(), 3)) {
-    // Get face vertices
-    Vertex& a{m_vertices.at(m_indices.at(offset + 0))};
-    Vertex& b{m_vertices.at(m_indices.at(offset + 1))};
-    Vertex& c{m_vertices.at(m_indices.at(offset + 2))};
+}  // namespace
 
-    // Compute normal
-    const auto edge1{b.position - a.position};
-    const auto edge2{c.position - b.position};
-    const glm::vec3 normal{glm::cross(edge1, edge2)};
+void Model::bindForDrawing() const {
+  abcg::glBindVertexArray(m_VAO);
 
-    // Accumulate on vertices
-    a.normal += normal;
-    b.normal += normal;
-    c.normal += normal;
-  }
+  abcg::glActiveTexture(GL_TEXTURE0 + diffuseTextureUnit);
+  abcg::glBindTexture(GL_TEXTURE_2D_ARRAY, m_diffuseTexture);
+  abcg::glBindSampler(diffuseTextureUnit, m_sampler);
+}
 
-  // Normalize
-  for (auto& vertex : m_vertices) {
-    vertex.normal = glm::normalize(vertex.normal);
-  }
+void Model::bindMaterials(std::size_t block) const {
+  constexpr auto blockSize{sizeof(MaterialUniforms) * materialsPerBlock};
+  abcg::glBindBufferRange(GL_UNIFORM_BUFFER, materialBlockBinding,
+                          m_materialUBO,
+                          static_cast<GLintptr>(block * blockSize),
+                          blockSize);
+}
 
-  m_hasNormals = true;
+void Model::computeTransforms(bool standardize) {
+  m_standardizeMatrix =
+      standardize ? standardizeTransform(m_bounds) : glm::mat4{1.0f};
+
+  // Packed positions are quantized against the bounds
+  m_vertexMatrix = m_vertexFormat == VertexFormat::Packed
+                       ? m_standardizeMatrix *
+                             glm::inverse(quantizeTransform(m_bounds))
+                       : m_standardizeMatrix;
+}
+
+void Model::createSampler() {
+  abcg::glGenSamplers(1, &m_sampler);
+
+  // Trilinear minification over the mip chain
+  abcg::glSamplerParameteri(m_sampler, GL_TEXTURE_MIN_FILTER,
+                            GL_LINEAR_MIPMAP_LINEAR);
+  abcg::glSamplerParameteri(m_sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  // Set texture wrapping parameters
+  abcg::glSamplerParameteri(m_sampler, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  abcg::glSamplerParameteri(m_sampler, GL_TEXTURE_WRAP_T, GL_REPEAT);
 }
 
 void Model::createBuffers() {
   // Delete previous buffers
+  abcg::glDeleteBuffers(1, &m_materialUBO);
   abcg::glDeleteBuffers(1, &m_EBO);
   abcg::glDeleteBuffers(1, &m_VBO);
-
-  // VBO
+  abcg::glDeleteBuffers(1, &m_occlusionVBO);
+  abcg::glDeleteBuffers(1, &m_materialVBO);
+
+  // Full MaterialData blocks of materialsPerBlock materials each, since a
+  // bound range must cover the whole block
+  const auto numBlocks{
+      (m_materials.size() + materialsPerBlock - 1) / materialsPerBlock};
+  std::vector<MaterialUniforms> materialData(numBlocks * materialsPerBlock);
+  for (const auto index : iter::range(m_materials.size())) {
+    const auto& material{m_materials[index]};
+    materialData[index] = {.Ka = material.Ka,
+                           .Kd = material.Kd,
+                           .Ks = material.Ks,
+                           .shininess = material.shininess,
+                           .diffuseLayer = material.diffuseLayer};
+  }
+  abcg::glGenBuffers(1, &m_materialUBO);
+  abcg::glBindBuffer(GL_UNIFORM_BUFFER, m_materialUBO);
+  abcg::glBufferData(GL_UNIFORM_BUFFER,
+                     static_cast<GLsizeiptr>(sizeof(MaterialUniforms) *
+                                             materialData.size()),
+                     materialData.data(), GL_STATIC_DRAW);
+  abcg::glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  // Allocate at full size; streamGeometry fills them in
   abcg::glGenBuffers(1, &m_VBO);
   abcg::glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
-  abcg::glBufferData(GL_ARRAY_BUFFER, sizeof(m_vertices[0]) * m_vertices.size(),
-                     m_vertices.data(), GL_STATIC_DRAW);
+  abcg::glBufferData(GL_ARRAY_BUFFER,
+                     static_cast<GLsizeiptr>(getVertexBufferSize()), nullptr,
+                     GL_STATIC_DRAW);
+  abcg::glGenBuffers(1, &m_occlusionVBO);
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, m_occlusionVBO);
+  abcg::glBufferData(GL_ARRAY_BUFFER,
+                     static_cast<GLsizeiptr>(m_vertexOcclusion.size()),
+                     nullptr, GL_STATIC_DRAW);
+  abcg::glGenBuffers(1, &m_materialVBO);
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, m_materialVBO);
+  abcg::glBufferData(GL_ARRAY_BUFFER,
+                     static_cast<GLsizeiptr>(m_vertexMaterials.size()),
+                     nullptr, GL_STATIC_DRAW);
   abcg::glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-  // EBO
+  // EBO: full-detail indices followed by the simplified levels
   abcg::glGenBuffers(1, &m_EBO);
   abcg::glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
-  abcg::glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                     sizeof(m_indices[0]) * m_indices.size(), m_indices.data(),
-                     GL_STATIC_DRAW);
+  abcg::glBufferData(
+      GL_ELEMENT_ARRAY_BUFFER,
+      static_cast<GLsizeiptr>(sizeof(GLuint) *
+                              (m_indices.size() + m_lodIndices.size())),
+      nullptr, GL_STATIC_DRAW);
   abcg::glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  // Nothing is resident yet
+  m_clusterResidentLevel.assign(m_clusters.size(),
+                                static_cast<std::uint8_t>(numClusterLods));
+  m_streamStep = 0;
+  m_numResidentVertices = 0;
+  m_numResidentTriangles = 0;
 }
 
-void Model::loadDiffuseTexture(std::string_view path) {
-  if (!std::filesystem::exists(path)) return;
+void Model::computeStreamTiers() {
+  // Vertices are ordered by first use from the coarsest level to the
+  // finest, so each level needs a prefix of the VBO
+  std::uint32_t end{};
+  for (auto level{numClusterLods}; level-- > 0;) {
+    for (const auto cluster : iter::range(m_clusters.size())) {
+      for (const auto index :
+           lodIndices(m_clusterLods[cluster * numClusterLods + level])) {
+        end = std::max(end, index + 1);
+      }
+    }
+    m_levelVertexEnd[level] = end;
+  }
+}
+
+void Model::computeVertexMaterials() {
+  // Vertices are split between materials, so every use of one agrees
+  m_vertexMaterials.assign(m_vertices.size(), 0);
+  for (const auto index : iter::range(m_materials.size())) {
+    const auto& material{m_materials[index]};
+    const auto value{static_cast<std::uint8_t>(index % materialsPerBlock)};
+    for (const auto cluster :
+         iter::range(material.firstCluster,
+                     material.firstCluster + material.numClusters)) {
+      for (const auto level : iter::range(numClusterLods)) {
+        for (const auto vertex :
+             lodIndices(m_clusterLods[cluster * numClusterLods + level])) {
+          m_vertexMaterials[vertex] = value;
+        }
+      }
+    }
+  }
+}
 
+void Model::loadDiffuseTextures() {
   abcg::glDeleteTextures(1, &m_diffuseTexture);
-  m_diffuseTexture = abcg::opengl::loadTexture(path);
+  m_diffuseTexture = 0;
+  m_textureMemorySize = 0;
+  if (m_diffuseTexNames.empty()) return;
+
+  std::vector<std::string> paths;
+  for (const auto& name : m_diffuseTexNames) {
+    paths.push_back(m_basePath + name);
+  }
+  m_diffuseTexture = loadTextureArrayCached(paths, &m_textureMemorySize);
+
+  if (m_sampler == 0) createSampler();
 }
 
-void Model::loadObj(std::string_view path, bool standardize) {
-  const auto basePath{std::filesystem::path{path}.parent_path().string() + "/"};
+bool Model::loadCache(std::string_view path, const MeshCacheKey& key) {
+  MeshCacheReader reader;
+  if (!reader.open(path, key)) return false;
+
+  const auto vertices{reader.section<Vertex>(verticesTag)};
+  const auto indices{reader.section<GLuint>(indicesTag)};
+  const auto flags{reader.section<CachedFlags>(flagsTag)};
+  const auto materials{reader.section<ModelMaterial>(materialsTag)};
+  const auto diffuseTexNames{reader.section<char>(diffuseTexNamesTag)};
+  const auto clusters{reader.section<MeshCluster>(clustersTag)};
+  const auto clusterLods{reader.section<MeshClusterLod>(clusterLodsTag)};
+  const auto lodIndices{reader.section<GLuint>(lodIndicesTag)};
+  const auto bounds{reader.section<Bounds>(boundsTag)};
+  const auto bvhNodes{reader.section<BvhNode>(bvhNodesTag)};
+  const auto bvhOrder{reader.section<std::uint32_t>(bvhOrderTag)};
+  const auto occlusion{reader.section<std::uint8_t>(occlusionTag)};
+  const auto pvsGrid{reader.section<PvsGrid>(pvsGridTag)};
+  const auto pvsCells{reader.section<std::uint32_t>(pvsCellsTag)};
+  const auto pvsSets{reader.section<std::uint64_t>(pvsSetsTag)};
+  if (vertices.empty() || indices.empty() || flags.size() != 1 ||
+      occlusion.size() != vertices.size() ||
+      bounds.size() != 1 || pvsGrid.size() != 1 ||
+      materials.empty() || clusters.empty() ||
+      clusterLods.size() != clusters.size() * numClusterLods) {
+    return false;
+  }
+
+  // Every index and range must stay within the data it refers to. Sums are
+  // taken in 64 bits so that they can't wrap.
+  const auto validIndex{[&](GLuint index) { return index < vertices.size(); }};
+  const auto fitsIn{[](std::uint64_t first, std::uint64_t count,
+                       std::size_t size) { return first + count <= size; }};
+  const auto validLod{[&](const MeshClusterLod& lod) {
+    // A level lies entirely in the full-detail or the simplified indices
+    return lod.firstIndex < indices.size()
+               ? fitsIn(lod.firstIndex, lod.indexCount, indices.size())
+               : fitsIn(lod.firstIndex, lod.indexCount,
+                        indices.size() + lodIndices.size());
+  }};
+  const auto validCluster{[&](const MeshCluster& cluster) {
+    return fitsIn(cluster.firstIndex, cluster.indexCount, indices.size());
+  }};
+  const auto validMaterial{[&](const ModelMaterial& material) {
+    return fitsIn(material.firstCluster, material.numClusters,
+                  clusters.size());
+  }};
+  if (!std::ranges::all_of(indices, validIndex) ||
+      !std::ranges::all_of(lodIndices, validIndex) ||
+      !std::ranges::all_of(clusterLods, validLod) ||
+      !std::ranges::all_of(clusters, validCluster) ||
+      !std::ranges::all_of(materials, validMaterial)) {
+    return false;
+  }
 
-  tinyobj::ObjReaderConfig readerConfig;
-  readerConfig.mtl_search_path = basePath;  // Path to material files
+  m_vertices.assign(vertices.begin(), vertices.end());
+  m_bounds = bounds.front();
+  m_vertexOcclusion.assign(occlusion.begin(), occlusion.end());
+  m_indices.assign(indices.begin(), indices.end());
+  m_clusters.assign(clusters.begin(), clusters.end());
+  m_clusterLods.assign(clusterLods.begin(), clusterLods.end());
+  m_lodIndices.assign(lodIndices.begin(), lodIndices.end());
+  if (!m_collisionBvh.assign(m_vertices, m_indices, bvhNodes, bvhOrder) ||
+      !m_visibilitySets.assign(pvsGrid.front(), pvsCells, pvsSets,
+                               m_clusters.size())) {
+    return false;
+  }
 
-  tinyobj::ObjReader reader;
+  m_materials.assign(materials.begin(), materials.end());
+  m_hasNormals = flags.front().hasNormals != 0;
+  m_hasTexCoords = flags.front().hasTexCoords != 0;
+
+  // Texture names are separated by newlines
+  m_diffuseTexNames.clear();
+  for (auto remaining{std::string_view{diffuseTexNames.data(),
+                                       diffuseTexNames.size()}};
+       !remaining.empty();) {
+    const auto end{std::min(remaining.find('\n'), remaining.size())};
+    m_diffuseTexNames.emplace_back(remaining.substr(0, end));
+    remaining.remove_prefix(std::min(end + 1, remaining.size()));
+  }
 
-  if (!reader.ParseFromFile(path.data(), readerConfig)) {
-    if (!reader.Error().empty()) {
-      throw abcg::Exception{abcg::Exception::Runtime(
-          fmt::format("Failed to load model {} ({})", path, reader.Error()))};
-    }
-    throw abcg::Exception{
-        abcg::Exception::Runtime(fmt::format("Failed to load model {}", path))};
+  applyFirstMaterial();
+  computeStreamTiers();
+  computeVertexMaterials();
+
+  return true;
+}
+
+void Model::saveCache(std::string_view path, const MeshCacheKey& key) const {
+  const CachedFlags flags{m_hasNormals ? 1U : 0U, m_hasTexCoords ? 1U : 0U};
+
+  std::string diffuseTexNames;
+  for (const auto& name : m_diffuseTexNames) {
+    if (!diffuseTexNames.empty()) diffuseTexNames += '\n';
+    diffuseTexNames += name;
+  }
+
+  MeshCacheWriter writer;
+  writer.addSection(verticesTag, std::span{m_vertices});
+  writer.addSection(boundsTag, std::span{&m_bounds, 1});
+  writer.addSection(occlusionTag, std::span{m_vertexOcclusion});
+  writer.addSection(indicesTag, std::span{m_indices});
+  writer.addSection(flagsTag, std::span{&flags, 1});
+  writer.addSection(materialsTag, std::span{m_materials});
+  writer.addSection(diffuseTexNamesTag,
+                    std::span{std::as_const(diffuseTexNames)});
+  writer.addSection(clustersTag, std::span{m_clusters});
+  writer.addSection(clusterLodsTag, std::span{m_clusterLods});
+  writer.addSection(lodIndicesTag, std::span{m_lodIndices});
+  writer.addSection(bvhNodesTag, m_collisionBvh.getNodes());
+  writer.addSection(bvhOrderTag, m_collisionBvh.getTriangleOrder());
+  writer.addSection(pvsGridTag, std::span{&m_visibilitySets.getGrid(), 1});
+  writer.addSection(pvsCellsTag, m_visibilitySets.getCellSets());
+  writer.addSection(pvsSetsTag, m_visibilitySets.getSets());
+
+  if (!writer.write(path, key)) {
+    fmt::print("Warning: could not write mesh cache {}\n", path);
   }
+}
+
+void Model::loadObj(std::string_view path, bool standardize,
+                    VertexFormat format) {
+  processObj(path, standardize, format);
+  uploadToGL();
+  streamGeometry();
+}
 
-  if (!reader.Warning().empty()) {
-    fmt::print("Warning: {}\n", reader.Warning());
+void Model::processObj(std::string_view path, bool standardize,
+                       VertexFormat format, LoadProgress* progress,
+                       std::span<const Bounds> viewRegions) {
+  const auto beginPhase{[&](std::string_view name) {
+    if (progress != nullptr) progress->beginPhase(name);
+  }};
+
+  const auto basePath{std::filesystem::path{path}.parent_path().string() + "/"};
+  m_basePath = basePath;
+
+  m_vertexFormat = format;
+
+  // Reuse the processed mesh from a previous run if the source is unchanged.
+  // Other than the view regions, load options only change the transforms,
+  // so they aren't part of the key.
+  const auto cachePath{meshCachePath(path)};
+  const auto cacheKey{
+      MeshCacheKey::fromFile(path, hashViewRegions(viewRegions, standardize))};
+  if (progress != nullptr) progress->setExpectedPhases(2);
+  beginPhase("Reading cache");
+  if (loadCache(cachePath, cacheKey)) {
+    computeTransforms(standardize);
+    if (progress != nullptr) progress->finish();
+    return;
   }
 
-  const auto& attrib{reader.GetAttrib()};
-  const auto& shapes{reader.GetShapes()};
-  const auto& materials{reader.GetMaterials()};
+  // Parse, weld, normals, clusters, LODs, reorder, BVH, AO, PVS, cache and
+  // upload
+  if (progress != nullptr) progress->setExpectedPhases(12);
+  beginPhase("Parsing");
+  const auto data{parseObj(path, basePath, m_threadPool)};
 
-  m_vertices.clear();
-  m_indices.clear();
+  if (!data.warning.empty()) {
+    fmt::print("Warning: {}\n", data.warning);
+  }
 
-  m_hasNormals = false;
-  m_hasTexCoords = false;
+  const auto& attrib{data.attrib};
+  const auto& materials{data.materials};
 
-  // A key:value map with key=Vertex and value=index
-  std::unordered_map<Vertex, GLuint> hash{};
+  m_vertices.clear();
+  m_indices.clear();
 
-  // Loop over shapes
-  for (const auto& shape : shapes) {
-    // Loop over indices
-    for (const auto offset : iter::range(shape.mesh.indices.size())) {
-      // Access to vertex
-      const tinyobj::index_t index{shape.mesh.indices.at(offset)};
+  // Gather the attributes of every face corner. Indices were validated by
+  // the parser.
+  std::vector<Vertex> corners(data.indices.size());
+  std::atomic<bool> hasNormals{false};
+  std::atomic<bool> hasTexCoords{false};
+  const auto numBlocks{m_threadPool.size() * 4};
+  const auto blockSize{(corners.size() + numBlocks - 1) / numBlocks};
+  m_threadPool.parallelFor(numBlocks, [&](std::size_t block) {
+    const auto begin{std::min(block * blockSize, corners.size())};
+    const auto end{std::min(begin + blockSize, corners.size())};
+    for (const auto offset : iter::range(begin, end)) {
+      const tinyobj::index_t index{data.indices[offset]};
+      auto& vertex{corners[offset]};
 
       // Vertex position
       const int startIndex{3 * index.vertex_index};
-      const float vx{attrib.vertices.at(startIndex + 0)};
-      const float vy{attrib.vertices.at(startIndex + 1)};
-      const float vz{attrib.vertices.at(startIndex + 2)};
+      vertex.position = {attrib.vertices[startIndex + 0],
+                         attrib.vertices[startIndex + 1],
+                         attrib.vertices[startIndex + 2]};
 
       // Vertex normal
-      float nx{};
-      float ny{};
-      float nz{};
       if (index.normal_index >= 0) {
-        m_hasNormals = true;
+        hasNormals.store(true, std::memory_order_relaxed);
         const int normalStartIndex{3 * index.normal_index};
-        nx = attrib.normals.at(normalStartIndex + 0);
-        ny = attrib.normals.at(normalStartIndex + 1);
-        nz = attrib.normals.at(normalStartIndex + 2);
+        vertex.normal = {attrib.normals[normalStartIndex + 0],
+                         attrib.normals[normalStartIndex + 1],
+                         attrib.normals[normalStartIndex + 2]};
       }
 
       // Vertex texture coordinates
-      float tu{};
-      float tv{};
       if (index.texcoord_index >= 0) {
-        m_hasTexCoords = true;
+        hasTexCoords.store(true, std::memory_order_relaxed);
         const int texCoordsStartIndex{2 * index.texcoord_index};
-        tu = attrib.texcoords.at(texCoordsStartIndex + 0);
-        tv = attrib.texcoords.at(texCoordsStartIndex + 1);
+        vertex.texCoord = {attrib.texcoords[texCoordsStartIndex + 0],
+                           attrib.texcoords[texCoordsStartIndex + 1]};
       }
-
-      Vertex vertex{};
-      vertex.position = {vx, vy, vz};
-      vertex.normal = {nx, ny, nz};
-      vertex.texCoord = {tu, tv};
-
-      // If hash doesn't contain this vertex
-      if (hash.count(vertex) == 0) {
-        // Add this index (size of m_vertices)
-        hash[vertex] = m_vertices.size();
-        // Add this vertex
-        m_vertices.push_back(vertex);
+    }
+  });
+  m_hasNormals = hasNormals;
+  m_hasTexCoords = hasTexCoords;
+
+  // Merge corners sharing the same attributes into vertices
+  beginPhase("Welding");
+  const VertexWelder welder;
+  welder.weld(corners, m_vertices, m_indices, m_threadPool);
+
+  // Group triangles by material, with faces without one last
+  const auto numMaterialSlots{materials.size() + 1};
+  std::vector<std::size_t> slotBegin(numMaterialSlots + 1);
+  const auto slotOf{[&](std::size_t triangle) {
+    const auto id{data.materialIds[triangle]};
+    return id >= 0 && static_cast<std::size_t>(id) < materials.size()
+               ? static_cast<std::size_t>(id)
+               : materials.size();
+  }};
+  const auto numTriangles{m_indices.size() / 3};
+  for (const auto triangle : iter::range(numTriangles)) {
+    ++slotBegin[slotOf(triangle) + 1];
+  }
+  for (const auto slot : iter::range(numMaterialSlots)) {
+    slotBegin[slot + 1] += slotBegin[slot];
+  }
+  {
+    std::vector<GLuint> groupedIndices(m_indices.size());
+    auto next{slotBegin};
+    for (const auto triangle : iter::range(numTriangles)) {
+      const auto position{next[slotOf(triangle)]++};
+      for (const auto corner : iter::range(3)) {
+        groupedIndices[3 * position + corner] =
+            m_indices[3 * triangle + corner];
       }
-
-      m_indices.push_back(hash[vertex]);
     }
+    m_indices = std::move(groupedIndices);
   }
 
-  // Use properties of first material, if available
-  if (!materials.empty()) {
-    const auto& mat{materials.at(0)};  // First material
-    m_Ka = glm::vec4(mat.ambient[0], mat.ambient[1], mat.ambient[2], 1);
-    m_Kd = glm::vec4(mat.diffuse[0], mat.diffuse[1], mat.diffuse[2], 1);
-    m_Ks = glm::vec4(mat.specular[0], mat.specular[1], mat.specular[2], 1);
-    m_shininess = mat.shininess;
+  beginPhase("Normals");
+  m_bounds = computeBounds(m_vertices, m_threadPool);
+  computeTransforms(standardize);
 
-    if (!mat.diffuse_texname.empty())
-      loadDiffuseTexture(basePath + mat.diffuse_texname);
-  } else {
-    // Default values
-    m_Ka = {0.1f, 0.1f, 0.1f, 1.0f};
-    m_Kd = {0.7f, 0.7f, 0.7f, 1.0f};
-    m_Ks = {1.0f, 1.0f, 1.0f, 1.0f};
-    m_shininess = 25.0f;
+  if (!m_hasNormals) {
+    computeVertexNormals(m_vertices, m_indices, m_threadPool);
+    m_hasNormals = true;
   }
 
-  if (standardize) {
-    this->standardize();
+  // Give faces of later materials their own copy of the vertices they share
+  // with earlier ones, so that each vertex has a single material
+  beginPhase("Clustering");
+  {
+    constexpr auto none{std::numeric_limits<std::size_t>::max()};
+    std::vector<std::size_t> ownerSlot(m_vertices.size(), none);
+    std::vector<std::size_t> copySlot(m_vertices.size(), none);
+    std::vector<GLuint> copies(m_vertices.size());
+    for (const auto slot : iter::range(numMaterialSlots)) {
+      for (const auto offset :
+           iter::range(3 * slotBegin[slot], 3 * slotBegin[slot + 1])) {
+        auto& index{m_indices[offset]};
+        if (ownerSlot[index] == none) ownerSlot[index] = slot;
+        if (ownerSlot[index] == slot) continue;
+
+        if (copySlot[index] != slot) {
+          copySlot[index] = slot;
+          copies[index] = static_cast<GLuint>(m_vertices.size());
+          const auto vertex{m_vertices[index]};
+          m_vertices.push_back(vertex);
+        }
+        index = copies[index];
+      }
+    }
   }
 
-  if (!m_hasNormals) {
-    computeNormals();
+  // Split each material's triangles into spatial clusters for frustum
+  // culling. Materials sharing a diffuse map share its texture array layer.
+  m_materials.clear();
+  m_diffuseTexNames.clear();
+  m_clusters.clear();
+  for (const auto slot : iter::range(numMaterialSlots)) {
+    const auto begin{3 * slotBegin[slot]};
+    const auto end{3 * slotBegin[slot + 1]};
+    if (begin == end) continue;
+
+    ModelMaterial material;
+    if (slot < materials.size()) {
+      const auto& mat{materials[slot]};
+      material.Ka =
+          glm::vec4(mat.ambient[0], mat.ambient[1], mat.ambient[2], 1);
+      material.Kd =
+          glm::vec4(mat.diffuse[0], mat.diffuse[1], mat.diffuse[2], 1);
+      material.Ks =
+          glm::vec4(mat.specular[0], mat.specular[1], mat.specular[2], 1);
+      material.shininess = mat.shininess;
+
+      const auto& name{mat.diffuse_texname};
+      if (!name.empty() && std::filesystem::exists(basePath + name)) {
+        auto layer{std::ranges::find(m_diffuseTexNames, name)};
+        if (layer == m_diffuseTexNames.end()) {
+          layer = m_diffuseTexNames.insert(layer, name);
+        }
+        material.diffuseLayer =
+            static_cast<std::int32_t>(layer - m_diffuseTexNames.begin());
+      }
+    }
+
+    auto clusters{buildClusters(
+        m_vertices, std::span{m_indices}.subspan(begin, end - begin))};
+    material.firstCluster = static_cast<std::uint32_t>(m_clusters.size());
+    material.numClusters = static_cast<std::uint32_t>(clusters.size());
+    for (auto& cluster : clusters) {
+      cluster.firstIndex += static_cast<std::uint32_t>(begin);
+      m_clusters.push_back(cluster);
+    }
+    m_materials.push_back(material);
+  }
+  applyFirstMaterial();
+
+  beginPhase("Simplifying");
+  m_clusterLods = buildClusterLods(m_vertices, m_indices, m_clusters,
+                                   m_lodIndices, m_threadPool);
+
+  // Reorder the triangles of every cluster and level for the post-transform
+  // cache and overdraw, then the vertices for fetch locality
+  beginPhase("Reordering");
+  m_threadPool.parallelFor(m_clusterLods.size(), [&](std::size_t index) {
+    const auto& lod{m_clusterLods[index]};
+    const auto level{index % numClusterLods};
+
+    // Levels that repeat the previous one share its range
+    if (level > 0 && lod.firstIndex == m_clusterLods[index - 1].firstIndex) {
+      return;
+    }
+    const auto range{level == 0
+                         ? std::span{m_indices}.subspan(lod.firstIndex,
+                                                        lod.indexCount)
+                         : std::span{m_lodIndices}.subspan(
+                               lod.firstIndex - m_indices.size(),
+                               lod.indexCount)};
+    optimizeVertexCache(range);
+    optimizeOverdraw(range, m_vertices);
+  });
+
+  // Order vertices by first use from the coarsest level to the finest, so
+  // that streaming a level only needs a prefix of the VBO. Each tier is
+  // still in first-use order for fetch locality.
+  std::vector<GLuint> streamOrder;
+  streamOrder.reserve(m_indices.size() + m_lodIndices.size());
+  for (auto level{numClusterLods}; level-- > 0;) {
+    for (const auto cluster : iter::range(m_clusters.size())) {
+      const auto range{
+          lodIndices(m_clusterLods[cluster * numClusterLods + level])};
+      streamOrder.insert(streamOrder.end(), range.begin(), range.end());
+    }
   }
+  const auto remap{optimizeVertexFetch(m_vertices, streamOrder)};
+  for (auto& index : m_indices) {
+    index = remap[index];
+  }
+  for (auto& index : m_lodIndices) {
+    index = remap[index];
+  }
+  computeStreamTiers();
+  computeVertexMaterials();
+
+  beginPhase("Collision BVH");
+  m_collisionBvh.build(m_vertices, m_indices);
+
+  beginPhase("Ambient occlusion");
+  m_vertexOcclusion = bakeAmbientOcclusion(
+      m_vertices, m_collisionBvh,
+      occlusionDistance * glm::distance(m_bounds.min, m_bounds.max),
+      m_threadPool);
+
+  // Cells go only where the eye can be, in the view regions grown by a
+  // margin; everywhere else every cluster counts as visible
+  beginPhase("Visibility sets");
+  auto visibilityRegion{m_bounds};
+  if (!viewRegions.empty()) {
+    const auto toModel{glm::inverse(m_standardizeMatrix)};
+    const auto margin{visibilityMargin *
+                      glm::distance(m_bounds.min, m_bounds.max)};
+    Bounds visited;
+    for (const auto& view : viewRegions) {
+      const glm::vec3 a{toModel * glm::vec4(view.min, 1.0f)};
+      const glm::vec3 b{toModel * glm::vec4(view.max, 1.0f)};
+      // Unbounded axes are clipped to the mesh; regions missing it are
+      // skipped
+      const auto low{glm::max(glm::min(a, b) - margin, m_bounds.min)};
+      const auto high{glm::min(glm::max(a, b) + margin, m_bounds.max)};
+      if (low.x > high.x || low.y > high.y || low.z > high.z) continue;
+      visited.min = glm::min(visited.min, low);
+      visited.max = glm::max(visited.max, high);
+    }
+    if (visited.min.x <= visited.max.x) visibilityRegion = visited;
+  }
+  m_visibilitySets.bake(m_vertices, m_indices, m_clusters, m_collisionBvh,
+                        visibilityRegion, m_threadPool);
 
-  createBuffers();
+  beginPhase("Writing cache");
+  saveCache(cachePath, cacheKey);
+
+  if (progress != nullptr) progress->finish();
 }
 
 void Model::render(int numTriangles) const {
-  abcg::glBindVertexArray(m_VAO);
-
-  abcg::glActiveTexture(GL_TEXTURE0);
-  abcg::glBindTexture(GL_TEXTURE_2D, m_diffuseTexture);
-
-  // Set minification and magnification parameters
-  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  // Full-detail clusters are resident in order once level 0 streams
+  const auto numSteps{m_clusters.size() * numClusterLods};
+  const auto level0Step{numSteps - m_clusters.size()};
+  std::size_t numResidentIndices{};
+  if (m_streamStep >= numSteps) {
+    numResidentIndices = m_indices.size();
+  } else if (m_streamStep > level0Step) {
+    numResidentIndices = m_clusters[m_streamStep - level0Step].firstIndex;
+  }
 
-  // Set texture wrapping parameters
-  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  abcg::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  bindForDrawing();
+  if (!m_materials.empty()) bindMaterials(0);
 
-  const auto numIndices{(numTriangles < 0) ? m_indices.size()
-                                           : numTriangles * 3};
+  const auto numIndices{std::min(
+      numResidentIndices, (numTriangles < 0)
+                              ? m_indices.size()
+                              : static_cast<std::size_t>(numTriangles) * 3)};
 
   abcg::glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(numIndices),
                        GL_UNSIGNED_INT, nullptr);
@@ -219,6 +659,125 @@ void Model::render(int numTriangles) const {
   abcg::glBindVertexArray(0);
 }
 
+void Model::render(const Frustum& frustum, const LodSelection& lodSelection,
+                   const DepthPyramid* occlusion,
+                   std::span<const std::uint64_t> potentiallyVisible) {
+  // Collect visible clusters per block of materials, merging ranges that
+  // are adjacent in the EBO
+  m_drawCounts.clear();
+  m_drawOffsets.clear();
+  m_drawBatches.clear();
+  m_numVisibleClusters = 0;
+  m_numOccludedClusters = 0;
+  m_numPvsCulledClusters = 0;
+  m_numRenderedTriangles = 0;
+  const auto numBlocks{
+      (m_materials.size() + materialsPerBlock - 1) / materialsPerBlock};
+  for (const auto block : iter::range(numBlocks)) {
+    // Clusters are stored in material order
+    const auto& first{m_materials[block * materialsPerBlock]};
+    const auto& last{m_materials[std::min(
+        (block + 1) * materialsPerBlock, m_materials.size()) - 1]};
+    const auto firstDraw{m_drawCounts.size()};
+    GLuint previousEnd{};
+    for (const auto index :
+         iter::range(first.firstCluster,
+                     last.firstCluster + last.numClusters)) {
+      const auto& cluster{m_clusters[index]};
+      const auto residentLevel{
+          static_cast<std::size_t>(m_clusterResidentLevel[index])};
+      if (residentLevel >= numClusterLods) continue;
+      if (!PotentiallyVisibleSets::contains(potentiallyVisible, index)) {
+        ++m_numPvsCulledClusters;
+        continue;
+      }
+      if (!frustum.intersects(cluster.boundsMin, cluster.boundsMax)) continue;
+      if (occlusion != nullptr &&
+          occlusion->isOccluded(cluster.boundsMin, cluster.boundsMax)) {
+        ++m_numOccludedClusters;
+        continue;
+      }
+
+      // Coarsest level whose error, projected at the distance of the
+      // nearest point of the bounds, stays within the limit
+      const auto* lods{&m_clusterLods[index * numClusterLods]};
+      auto level{std::size_t{}};
+      if (lodSelection.pixelsPerUnit > 0.0f) {
+        const auto nearest{
+            glm::clamp(lodSelection.eye, cluster.boundsMin, cluster.boundsMax)};
+        const auto distance{glm::distance(lodSelection.eye, nearest)};
+        for (level = numClusterLods - 1; level > 0; --level) {
+          if (lods[level].error * lodSelection.pixelsPerUnit <=
+              lodSelection.maxPixelError * distance) {
+            break;
+          }
+        }
+      }
+      // Finer levels may not have streamed in yet
+      level = std::max(level, residentLevel);
+      const auto& lod{lods[level]};
+
+      ++m_numVisibleClusters;
+      m_numRenderedTriangles += lod.indexCount / 3;
+      if (m_drawCounts.size() > firstDraw && previousEnd == lod.firstIndex) {
+        m_drawCounts.back() += static_cast<GLsizei>(lod.indexCount);
+      } else {
+        m_drawCounts.push_back(static_cast<GLsizei>(lod.indexCount));
+        m_drawOffsets.push_back(reinterpret_cast<const void*>(
+            std::size_t{lod.firstIndex} * sizeof(GLuint)));
+      }
+      previousEnd = lod.firstIndex + lod.indexCount;
+    }
+
+    if (m_drawCounts.size() > firstDraw) {
+      m_drawBatches.push_back({block, firstDraw,
+                               m_drawCounts.size() - firstDraw});
+    }
+  }
+  if (m_drawBatches.empty()) return;
+
+  bindForDrawing();
+
+  // One multi-draw per block of materials, usually the only one
+  for (const auto& batch : m_drawBatches) {
+    bindMaterials(batch.materialBlock);
+
+#if defined(__EMSCRIPTEN__)
+    // WebGL 2 has no multi-draw without extensions
+    for (const auto draw :
+         iter::range(batch.firstDraw, batch.firstDraw + batch.numDraws)) {
+      abcg::glDrawElements(GL_TRIANGLES, m_drawCounts[draw], GL_UNSIGNED_INT,
+                           m_drawOffsets[draw]);
+    }
+#else
+    // Not in OpenGL ES, so abcg has no wrapper for it
+    glMultiDrawElements(GL_TRIANGLES, &m_drawCounts[batch.firstDraw],
+                        GL_UNSIGNED_INT, &m_drawOffsets[batch.firstDraw],
+                        static_cast<GLsizei>(batch.numDraws));
+#endif
+  }
+
+  abcg::glBindVertexArray(0);
+}
+
+void Model::renderOccluders() const {
+  if (m_drawCounts.empty()) return;
+
+  abcg::glBindVertexArray(m_VAO);
+#if defined(__EMSCRIPTEN__)
+  for (const auto draw : iter::range(m_drawCounts.size())) {
+    abcg::glDrawElements(GL_TRIANGLES, m_drawCounts[draw], GL_UNSIGNED_INT,
+                         m_drawOffsets[draw]);
+  }
+#else
+  // Materials don't matter for depth, so one multi-draw covers all batches
+  glMultiDrawElements(GL_TRIANGLES, m_drawCounts.data(), GL_UNSIGNED_INT,
+                      m_drawOffsets.data(),
+                      static_cast<GLsizei>(m_drawCounts.size()));
+#endif
+  abcg::glBindVertexArray(0);
+}
+
 void Model::setupVAO(GLuint program) {
   // Release previous VAO
   abcg::glDeleteVertexArrays(1, &m_VAO);
@@ -232,31 +791,70 @@ void Model::setupVAO(GLuint program) {
   abcg::glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
 
   // Bind vertex attributes
+  const bool packed{m_vertexFormat == VertexFormat::Packed};
+  const auto stride{static_cast<GLsizei>(packed ? sizeof(PackedVertex)
+                                                : sizeof(Vertex))};
+
   const GLint positionAttribute{
       abcg::glGetAttribLocation(program, "inPosition")};
   if (positionAttribute >= 0) {
     abcg::glEnableVertexAttribArray(positionAttribute);
-    abcg::glVertexAttribPointer(positionAttribute, 3, GL_FLOAT, GL_FALSE,
-                                sizeof(Vertex), nullptr);
+    if (packed) {
+      abcg::glVertexAttribPointer(positionAttribute, 3, GL_SHORT, GL_TRUE,
+                                  stride, nullptr);
+    } else {
+      abcg::glVertexAttribPointer(positionAttribute, 3, GL_FLOAT, GL_FALSE,
+                                  stride, nullptr);
+    }
   }
 
   const GLint normalAttribute{abcg::glGetAttribLocation(program, "inNormal")};
   if (normalAttribute >= 0) {
     abcg::glEnableVertexAttribArray(normalAttribute);
-    GLsizei offset{sizeof(glm::vec3)};
-    abcg::glVertexAttribPointer(normalAttribute, 3, GL_FLOAT, GL_FALSE,
-                                sizeof(Vertex),
-                                reinterpret_cast<void*>(offset));
+    if (packed) {
+      // Octahedral encoding, decoded in the vertex shader
+      GLsizei offset{offsetof(PackedVertex, normal)};
+      abcg::glVertexAttribPointer(normalAttribute, 2, GL_SHORT, GL_TRUE,
+                                  stride, reinterpret_cast<void*>(offset));
+    } else {
+      GLsizei offset{sizeof(glm::vec3)};
+      abcg::glVertexAttribPointer(normalAttribute, 3, GL_FLOAT, GL_FALSE,
+                                  stride, reinterpret_cast<void*>(offset));
+    }
   }
 
   const GLint texCoordAttribute{
       abcg::glGetAttribLocation(program, "inTexCoord")};
   if (texCoordAttribute >= 0) {
     abcg::glEnableVertexAttribArray(texCoordAttribute);
-    GLsizei offset{sizeof(glm::vec3) + sizeof(glm::vec3)};
-    abcg::glVertexAttribPointer(texCoordAttribute, 2, GL_FLOAT, GL_FALSE,
-                                sizeof(Vertex),
-                                reinterpret_cast<void*>(offset));
+    if (packed) {
+      GLsizei offset{offsetof(PackedVertex, texCoord)};
+      abcg::glVertexAttribPointer(texCoordAttribute, 2, GL_HALF_FLOAT,
+                                  GL_FALSE, stride,
+                                  reinterpret_cast<void*>(offset));
+    } else {
+      GLsizei offset{sizeof(glm::vec3) + sizeof(glm::vec3)};
+      abcg::glVertexAttribPointer(texCoordAttribute, 2, GL_FLOAT, GL_FALSE,
+                                  stride, reinterpret_cast<void*>(offset));
+    }
+  }
+
+  const GLint occlusionAttribute{
+      abcg::glGetAttribLocation(program, "inOcclusion")};
+  if (occlusionAttribute >= 0) {
+    abcg::glBindBuffer(GL_ARRAY_BUFFER, m_occlusionVBO);
+    abcg::glEnableVertexAttribArray(occlusionAttribute);
+    abcg::glVertexAttribPointer(occlusionAttribute, 1, GL_UNSIGNED_BYTE,
+                                GL_TRUE, 0, nullptr);
+  }
+
+  const GLint materialAttribute{
+      abcg::glGetAttribLocation(program, "inMaterial")};
+  if (materialAttribute >= 0) {
+    abcg::glBindBuffer(GL_ARRAY_BUFFER, m_materialVBO);
+    abcg::glEnableVertexAttribArray(materialAttribute);
+    abcg::glVertexAttribIPointer(materialAttribute, 1, GL_UNSIGNED_BYTE, 0,
+                                 nullptr);
   }
 
   // End of binding
@@ -264,32 +862,148 @@ void Model::setupVAO(GLuint program) {
   abcg::glBindVertexArray(0);
 }
 
-void Model::standardize() {
-  // Center to origin and normalize largest bound to [-1, 1]
+void Model::applyFirstMaterial() {
+  if (m_materials.empty()) return;
+
+  m_Ka = m_materials.front().Ka;
+  m_Kd = m_materials.front().Kd;
+  m_Ks = m_materials.front().Ks;
+  m_shininess = m_materials.front().shininess;
+}
+
+void Model::uploadToGL(LoadProgress* progress) {
+  if (progress != nullptr) progress->beginPhase("Uploading");
+
+  loadDiffuseTextures();
+  createBuffers();
+
+  // Make the coarsest level renderable right away. Its exact size as the
+  // budget stops streaming where the next level starts.
+  const auto coarsestLevel{numClusterLods - 1};
+  auto coarsestBytes{m_levelVertexEnd[coarsestLevel] *
+                     (m_vertexFormat == VertexFormat::Packed
+                          ? sizeof(PackedVertex)
+                          : sizeof(Vertex))};
+  for (const auto cluster : iter::range(m_clusters.size())) {
+    coarsestBytes += sizeof(GLuint) *
+                     m_clusterLods[cluster * numClusterLods + coarsestLevel]
+                         .indexCount;
+  }
+  streamGeometry(coarsestBytes);
+
+  if (progress != nullptr) progress->finish();
+}
+
+bool Model::streamGeometry(std::size_t byteBudget) {
+  const auto numSteps{m_clusters.size() * numClusterLods};
+  if (m_streamStep >= numSteps) return true;
+
+  const auto vertexSize{m_vertexFormat == VertexFormat::Packed
+                            ? sizeof(PackedVertex)
+                            : sizeof(Vertex)};
+  std::size_t uploadedBytes{};
 
-  // Get bounds
-  glm::vec3 max(std::numeric_limits<float>::lowest());
-  glm::vec3 min(std::numeric_limits<float>::max());
-  for (const auto& vertex : m_vertices) {
-    max.x = std::max(max.x, vertex.position.x);
-    max.y = std::max(max.y, vertex.position.y);
-    max.z = std::max(max.z, vertex.position.z);
-    min.x = std::min(min.x, vertex.position.x);
-    min.y = std::min(min.y, vertex.position.y);
-    min.z = std::min(min.z, vertex.position.z);
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+  abcg::glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+  while (m_streamStep < numSteps && uploadedBytes < byteBudget) {
+    // All clusters at one level, from the coarsest to full detail
+    const auto level{numClusterLods - 1 - m_streamStep / m_clusters.size()};
+    const auto cluster{m_streamStep % m_clusters.size()};
+
+    // The vertices of a level go first, split to fit the budget
+    if (m_numResidentVertices < m_levelVertexEnd[level]) {
+      const auto remaining{(byteBudget - uploadedBytes) / vertexSize};
+      const auto end{std::min<std::size_t>(
+          m_levelVertexEnd[level],
+          m_numResidentVertices + std::max<std::size_t>(remaining, 1))};
+      uploadVertices(m_numResidentVertices, end);
+      uploadedBytes += (end - m_numResidentVertices) * vertexSize;
+      m_numResidentVertices = end;
+      continue;
+    }
+
+    // A level repeating the coarser one is already there
+    const auto* lods{&m_clusterLods[cluster * numClusterLods]};
+    const auto& lod{lods[level]};
+    if (level + 1 == numClusterLods ||
+        lod.firstIndex != lods[level + 1].firstIndex) {
+      const auto indices{lodIndices(lod)};
+      abcg::glBufferSubData(
+          GL_ELEMENT_ARRAY_BUFFER,
+          static_cast<GLintptr>(sizeof(GLuint) * lod.firstIndex),
+          static_cast<GLsizeiptr>(indices.size_bytes()), indices.data());
+      uploadedBytes += indices.size_bytes();
+    }
+
+    auto& residentLevel{m_clusterResidentLevel[cluster]};
+    if (residentLevel < numClusterLods) {
+      m_numResidentTriangles -= lods[residentLevel].indexCount / 3;
+    }
+    residentLevel = static_cast<std::uint8_t>(level);
+    m_numResidentTriangles += lod.indexCount / 3;
+    ++m_streamStep;
+  }
+  abcg::glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  return m_streamStep >= numSteps;
+}
+
+void Model::uploadVertices(std::size_t begin, std::size_t end) {
+  const auto count{end - begin};
+  if (m_vertexFormat == VertexFormat::Packed) {
+    const auto quantize{quantizeTransform(m_bounds)};
+    std::vector<PackedVertex> packedVertices(count);
+    const auto numBlocks{m_threadPool.size() * 4};
+    const auto blockSize{(count + numBlocks - 1) / numBlocks};
+    m_threadPool.parallelFor(numBlocks, [&](std::size_t block) {
+      const auto blockBegin{std::min(block * blockSize, count)};
+      const auto blockEnd{std::min(blockBegin + blockSize, count)};
+      for (const auto index : iter::range(blockBegin, blockEnd)) {
+        auto vertex{m_vertices[begin + index]};
+        vertex.position =
+            glm::vec3(quantize * glm::vec4(vertex.position, 1.0f));
+        packedVertices[index] = packVertex(vertex);
+      }
+    });
+    abcg::glBufferSubData(
+        GL_ARRAY_BUFFER, static_cast<GLintptr>(sizeof(PackedVertex) * begin),
+        static_cast<GLsizeiptr>(sizeof(PackedVertex) * count),
+        packedVertices.data());
+  } else {
+    abcg::glBufferSubData(GL_ARRAY_BUFFER,
+                          static_cast<GLintptr>(sizeof(Vertex) * begin),
+                          static_cast<GLsizeiptr>(sizeof(Vertex) * count),
+                          &m_vertices[begin]);
   }
 
-  // Center and scale
-  const auto center{(min + max) / 2.0f};
-  const auto scaling{2.0f / glm::length(max - min)};
-  for (auto& vertex : m_vertices) {
-    vertex.position = (vertex.position - center) * scaling;
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, m_occlusionVBO);
+  abcg::glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(begin),
+                        static_cast<GLsizeiptr>(count),
+                        &m_vertexOcclusion[begin]);
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, m_materialVBO);
+  abcg::glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(begin),
+                        static_cast<GLsizeiptr>(count),
+                        &m_vertexMaterials[begin]);
+  abcg::glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+}
+
+std::span<const GLuint> Model::lodIndices(const MeshClusterLod& lod) const {
+  if (lod.firstIndex < m_indices.size()) {
+    return std::span{m_indices}.subspan(lod.firstIndex, lod.indexCount);
   }
+  return std::span{m_lodIndices}.subspan(lod.firstIndex - m_indices.size(),
+                                         lod.indexCount);
 }
 
 void Model::terminateGL() {
+  abcg::glDeleteSamplers(1, &m_sampler);
+  m_sampler = 0;
   abcg::glDeleteTextures(1, &m_diffuseTexture);
+  abcg::glDeleteBuffers(1, &m_materialUBO);
   abcg::glDeleteBuffers(1, &m_EBO);
   abcg::glDeleteBuffers(1, &m_VBO);
+  abcg::glDeleteBuffers(1, &m_occlusionVBO);
+  abcg::glDeleteBuffers(1, &m_materialVBO);
   abcg::glDeleteVertexArrays(1, &m_VAO);
 }
\ No newline at end of file
@@ -1,28 +1,82 @@
 #ifndef MODEL_HPP_
 #define MODEL_HPP_
 
+#include <array>
+#include <limits>
+#include <span>
+#include <string>
 #include <vector>
 
 #include "abcg.hpp"
+#include "depthpyramid.hpp"
+#include "frustum.hpp"
+#include "loadprogress.hpp"
+#include "meshbvh.hpp"
+#include "meshcache.hpp"
+#include "meshcluster.hpp"
+#include "meshgeometry.hpp"
+#include "potentiallyvisible.hpp"
+#include "vertex.hpp"
 
-struct Vertex {
-  glm::vec3 position{};
-  glm::vec3 normal{};
-  glm::vec2 texCoord{};
+class ThreadPool;
 
-  bool operator==(const Vertex& other) const noexcept {
-    static const auto epsilon{std::numeric_limits<float>::epsilon()};
-    return glm::all(glm::epsilonEqual(position, other.position, epsilon)) &&
-           glm::all(glm::epsilonEqual(normal, other.normal, epsilon)) &&
-           glm::all(glm::epsilonEqual(texCoord, other.texCoord, epsilon));
-  }
+// Parameters for picking a level of detail per cluster from its projected
+// error. A zero pixelsPerUnit always selects full detail.
+struct LodSelection {
+  glm::vec3 eye{};             // Camera position in model space
+  float pixelsPerUnit{};       // Screen size of one unit at distance one
+  float maxPixelError{1.0f};   // Largest acceptable error on screen
+};
+
+// Material of a contiguous range of clusters. Faces without a material
+// get the default one.
+struct ModelMaterial {
+  glm::vec4 Ka{0.1f, 0.1f, 0.1f, 1.0f};
+  glm::vec4 Kd{0.7f, 0.7f, 0.7f, 1.0f};
+  glm::vec4 Ks{1.0f, 1.0f, 1.0f, 1.0f};
+  float shininess{25.0f};
+  std::int32_t diffuseLayer{-1};  // Layer of the diffuse texture array
+  std::uint32_t firstCluster{};
+  std::uint32_t numClusters{};
 };
 
 class Model {
  public:
-  void loadDiffuseTexture(std::string_view path);
-  void loadObj(std::string_view path, bool standardize = true);
+  // Loading work is spread over threadPool, which must outlive the model
+  explicit Model(ThreadPool& threadPool) : m_threadPool{threadPool} {}
+
+  // Same as processObj and uploadToGL, then streams the rest of the mesh
+  void loadObj(std::string_view path, bool standardize = true,
+               VertexFormat format = VertexFormat::Float);
+  // Loads and prepares the mesh without calling GL, so it can run on
+  // another thread. uploadToGL must follow on the GL thread. Visibility
+  // sets cover viewRegions, boxes in the positions the model is shown at
+  // (standardized if standardize) that the eye visits, or all of the mesh
+  // if there are none.
+  void processObj(std::string_view path, bool standardize = true,
+                  VertexFormat format = VertexFormat::Float,
+                  LoadProgress* progress = nullptr,
+                  std::span<const Bounds> viewRegions = {});
+  // Loads the textures, allocates the buffers and uploads the coarsest
+  // level of every cluster, so the model can be drawn right away
+  void uploadToGL(LoadProgress* progress = nullptr);
+  // Uploads finer levels, coarsest first, until about byteBudget bytes were
+  // sent. Clusters are drawn at their finest resident level. Returns whether
+  // the whole mesh is resident.
+  bool streamGeometry(
+      std::size_t byteBudget = std::numeric_limits<std::size_t>::max());
   void render(int numTriangles = -1) const;
+  // Draws only the clusters that intersect the frustum and, given a depth
+  // pyramid, aren't hidden behind it, each at the coarsest level of detail
+  // whose error stays within the selection limit. A non-empty
+  // potentiallyVisible set (from getVisibilitySets) also skips the clusters
+  // missing from it.
+  void render(const Frustum& frustum, const LodSelection& lodSelection = {},
+              const DepthPyramid* occlusion = nullptr,
+              std::span<const std::uint64_t> potentiallyVisible = {});
+  // Draws the clusters of the last render(frustum) again with no materials
+  // bound, for a depth-only pass with the program in use
+  void renderOccluders() const;
   void setupVAO(GLuint program);
   void terminateGL();
 
@@ -30,6 +84,76 @@ class Model {
     return static_cast<int>(m_indices.size()) / 3;
   }
 
+  [[nodiscard]] std::size_t getNumResidentTriangles() const {
+    return m_numResidentTriangles;
+  }
+  [[nodiscard]] bool isFullyResident() const {
+    return m_streamStep >= m_clusters.size() * numClusterLods;
+  }
+
+  [[nodiscard]] std::size_t getNumClusters() const { return m_clusters.size(); }
+  [[nodiscard]] std::size_t getNumMaterials() const {
+    return m_materials.size();
+  }
+  [[nodiscard]] std::size_t getNumDrawBatches() const {
+    return m_drawBatches.size();
+  }
+  // Draw calls issued by the last render(frustum)
+  [[nodiscard]] std::size_t getNumDrawCalls() const {
+#if defined(__EMSCRIPTEN__)
+    return m_drawCounts.size();
+#else
+    return m_drawBatches.size();
+#endif
+  }
+  [[nodiscard]] std::size_t getNumVisibleClusters() const {
+    return m_numVisibleClusters;
+  }
+  // In the frustum but hidden behind the depth pyramid
+  [[nodiscard]] std::size_t getNumOccludedClusters() const {
+    return m_numOccludedClusters;
+  }
+  // Missing from the potentially visible set
+  [[nodiscard]] std::size_t getNumPvsCulledClusters() const {
+    return m_numPvsCulledClusters;
+  }
+
+  [[nodiscard]] std::size_t getNumRenderedTriangles() const {
+    return m_numRenderedTriangles;
+  }
+
+  [[nodiscard]] std::size_t getTextureMemorySize() const {
+    return m_textureMemorySize;
+  }
+
+  // Maps model positions, as in the OBJ file, to the [-1, 1] range if the
+  // model was loaded with standardize (identity otherwise). Cluster bounds
+  // and LOD errors are in model positions.
+  [[nodiscard]] const glm::mat4& getStandardizeMatrix() const {
+    return m_standardizeMatrix;
+  }
+  // Maps the positions stored in the VBO to standardized positions
+  [[nodiscard]] const glm::mat4& getVertexMatrix() const {
+    return m_vertexMatrix;
+  }
+
+  // Full-detail triangles in model positions, for collisions
+  [[nodiscard]] const MeshBvh& getCollisionBvh() const {
+    return m_collisionBvh;
+  }
+  // Clusters seen from each cell of a grid over the bounds, in model
+  // positions
+  [[nodiscard]] const PotentiallyVisibleSets& getVisibilitySets() const {
+    return m_visibilitySets;
+  }
+
+  [[nodiscard]] VertexFormat getVertexFormat() const { return m_vertexFormat; }
+  [[nodiscard]] std::size_t getVertexBufferSize() const {
+    return m_vertices.size() * (m_vertexFormat == VertexFormat::Packed
+                                    ? sizeof(PackedVertex)
+                                    : sizeof(Vertex));
+  }
+
   [[nodiscard]] glm::vec4 getKa() const { return m_Ka; }
   [[nodiscard]] glm::vec4 getKd() const { return m_Kd; }
   [[nodiscard]] glm::vec4 getKs() const { return m_Ks; }
@@ -40,23 +164,82 @@ class Model {
  private:
   GLuint m_VAO{};
   GLuint m_VBO{};
+  GLuint m_occlusionVBO{};
+  GLuint m_materialVBO{};
   GLuint m_EBO{};
 
   glm::vec4 m_Ka;
   glm::vec4 m_Kd;
   glm::vec4 m_Ks;
   float m_shininess;
-  GLuint m_diffuseTexture{};
+  GLuint m_diffuseTexture{};  // 2D array, one layer per diffuse map
+  std::size_t m_textureMemorySize{};
+  GLuint m_sampler{};
+  GLuint m_materialUBO{};  // Full MaterialData blocks, back to back
+
+  std::vector<ModelMaterial> m_materials;
+  std::vector<std::string> m_diffuseTexNames;  // In layer order
+  std::string m_basePath;  // Directory of the OBJ, for its textures
 
+  // Vertices keep their positions from the file; standardizing and
+  // quantizing are done through m_standardizeMatrix and m_vertexMatrix
   std::vector<Vertex> m_vertices;
+  Bounds m_bounds;
+  glm::mat4 m_standardizeMatrix{1.0f};
+  glm::mat4 m_vertexMatrix{1.0f};
   std::vector<GLuint> m_indices;
+  std::vector<MeshCluster> m_clusters;
+  std::vector<MeshClusterLod> m_clusterLods;  // numClusterLods per cluster
+  std::vector<GLuint> m_lodIndices;  // Stored after m_indices in the EBO
+  MeshBvh m_collisionBvh;  // Kept on the CPU after the upload
+  PotentiallyVisibleSets m_visibilitySets;
+  // Baked ambient occlusion, unorm8 per vertex, in its own VBO
+  std::vector<std::uint8_t> m_vertexOcclusion;
+  // Material of each vertex within its block, in its own VBO
+  std::vector<std::uint8_t> m_vertexMaterials;
+
+  // Streaming state. Vertices needed up to each level form a prefix of the
+  // VBO; levels stream one cluster at a time, coarsest first.
+  std::array<std::size_t, numClusterLods> m_levelVertexEnd{};
+  std::vector<std::uint8_t> m_clusterResidentLevel;  // numClusterLods: none
+  std::size_t m_streamStep{};
+  std::size_t m_numResidentVertices{};
+  std::size_t m_numResidentTriangles{};
+
+  // Per-frame list of visible index ranges for glMultiDrawElements
+  std::vector<GLsizei> m_drawCounts;
+  std::vector<const void*> m_drawOffsets;
+  struct DrawBatch {
+    std::size_t materialBlock{};
+    std::size_t firstDraw{};
+    std::size_t numDraws{};
+  };
+  std::vector<DrawBatch> m_drawBatches;
+  std::size_t m_numVisibleClusters{};
+  std::size_t m_numOccludedClusters{};
+  std::size_t m_numPvsCulledClusters{};
+  std::size_t m_numRenderedTriangles{};
 
   bool m_hasNormals{false};
   bool m_hasTexCoords{false};
+  VertexFormat m_vertexFormat{VertexFormat::Float};
+
+  ThreadPool& m_threadPool;
 
-  void computeNormals();
+  void applyFirstMaterial();
+  void bindForDrawing() const;
+  void bindMaterials(std::size_t block) const;
+  void computeStreamTiers();
+  void computeVertexMaterials();
+  void computeTransforms(bool standardize);
+  void createSampler();
   void createBuffers();
-  void standardize();
+  bool loadCache(std::string_view path, const MeshCacheKey& key);
+  void loadDiffuseTextures();
+  [[nodiscard]] std::span<const GLuint> lodIndices(
+      const MeshClusterLod& lod) const;
+  void saveCache(std::string_view path, const MeshCacheKey& key) const;
+  void uploadVertices(std::size_t begin, std::size_t end);
 };
 
 #endif
\ No newline at end of file
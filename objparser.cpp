@@ -0,0 +1,411 @@
+#include "objparser.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cppitertools/itertools.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+#include "abcg.hpp"
+#include "threadpool.hpp"
+
+namespace {
+
+// Smallest chunk worth handing to a thread
+constexpr std::size_t minChunkSize{1 << 20};
+
+// A face corner whose indices are relative to the start of its chunk
+struct RelativeCorner {
+  std::size_t corner{};
+  bool vertex{};
+  bool normal{};
+  bool texCoord{};
+};
+
+struct ChunkResult {
+  std::vector<float> positions;
+  std::vector<float> normals;
+  std::vector<float> texCoords;
+  std::vector<tinyobj::index_t> indices;
+  std::vector<RelativeCorner> relativeCorners;
+
+  // (local triangle index, material name) for every usemtl
+  std::vector<std::pair<std::size_t, std::string>> materialSwitches;
+  std::vector<std::string> materialLibraries;
+
+  std::vector<tinyobj::index_t> polygon;  // Scratch space for one face
+  std::vector<RelativeCorner> polygonRelative;
+};
+
+bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+const char* skipSpace(const char* p, const char* end) {
+  while (p < end && isSpace(*p)) ++p;
+  return p;
+}
+
+const char* skipToken(const char* p, const char* end) {
+  while (p < end && !isSpace(*p)) ++p;
+  return p;
+}
+
+bool startsWith(const char* p, const char* end, std::string_view keyword) {
+  const auto length{keyword.size()};
+  return static_cast<std::size_t>(end - p) > length &&
+         std::memcmp(p, keyword.data(), length) == 0 && isSpace(p[length]);
+}
+
+// Parses a decimal float. Mantissas that fit in 53 bits with small decimal
+// exponents are converted exactly with one rounding (the common case for
+// scanner output); anything else falls back to strtod.
+const char* parseReal(const char* p, const char* end, float& value) {
+  static constexpr std::array<double, 23> powersOf10{
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+  p = skipSpace(p, end);
+  const char* const start{p};
+
+  bool negative{false};
+  if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+  std::uint64_t mantissa{};
+  int digits{};
+  int exponent{};
+  bool anyDigit{false};
+  for (; p < end && *p >= '0' && *p <= '9'; ++p, anyDigit = true) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + static_cast<std::uint64_t>(*p - '0');
+      if (mantissa != 0) ++digits;
+    } else {
+      ++exponent;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (++p; p < end && *p >= '0' && *p <= '9'; ++p, anyDigit = true) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + static_cast<std::uint64_t>(*p - '0');
+        if (mantissa != 0) ++digits;
+        --exponent;
+      }
+    }
+  }
+  if (!anyDigit) return nullptr;
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char* q{p + 1};
+    bool negativeExponent{false};
+    if (q < end && (*q == '-' || *q == '+')) negativeExponent = *q++ == '-';
+    if (q < end && *q >= '0' && *q <= '9') {
+      int explicitExponent{};
+      for (; q < end && *q >= '0' && *q <= '9'; ++q) {
+        explicitExponent = std::min(explicitExponent * 10 + (*q - '0'), 9999);
+      }
+      exponent += negativeExponent ? -explicitExponent : explicitExponent;
+      p = q;
+    }
+  }
+
+  if (mantissa < (std::uint64_t{1} << 53) && exponent >= -22 &&
+      exponent <= 22) {
+    auto result{static_cast<double>(mantissa)};
+    result = exponent < 0 ? result / powersOf10.at(-exponent)
+                          : result * powersOf10.at(exponent);
+    value = static_cast<float>(negative ? -result : result);
+    return p;
+  }
+
+  const std::string token{start, skipToken(p, end)};
+  value = std::strtof(token.c_str(), nullptr);
+  return p;
+}
+
+const char* parseInt(const char* p, const char* end, int& value) {
+  bool negative{false};
+  if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+  if (p == end || *p < '0' || *p > '9') return nullptr;
+
+  long long result{};
+  for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+    result = std::min(result * 10 + (*p - '0'), 1LL << 40);
+  }
+  if (result > std::numeric_limits<int>::max()) return nullptr;
+  value = static_cast<int>(negative ? -result : result);
+  return p;
+}
+
+// Converts a 1-based OBJ reference into a 0-based index. Negative
+// references count back from the last element read so far in this chunk.
+int resolveIndex(int reference, std::size_t localCount, bool& relative) {
+  relative = reference < 0;
+  return relative ? static_cast<int>(localCount) + reference : reference - 1;
+}
+
+void parseFace(const char* p, const char* end, ChunkResult& chunk) {
+  chunk.polygon.clear();
+  chunk.polygonRelative.clear();
+
+  while ((p = skipSpace(p, end)) < end) {
+    tinyobj::index_t index{-1, -1, -1};
+    RelativeCorner relative{};
+
+    int reference{};
+    p = parseInt(p, end, reference);
+    if (p == nullptr || reference == 0) {
+      throw abcg::Exception{abcg::Exception::Runtime("Invalid face in OBJ")};
+    }
+    index.vertex_index =
+        resolveIndex(reference, chunk.positions.size() / 3, relative.vertex);
+
+    if (p < end && *p == '/') {
+      ++p;
+      if (p < end && *p != '/') {
+        p = parseInt(p, end, reference);
+        if (p == nullptr || reference == 0) {
+          throw abcg::Exception{abcg::Exception::Runtime("Invalid face in OBJ")};
+        }
+        index.texcoord_index = resolveIndex(
+            reference, chunk.texCoords.size() / 2, relative.texCoord);
+      }
+      if (p < end && *p == '/') {
+        ++p;
+        p = parseInt(p, end, reference);
+        if (p == nullptr || reference == 0) {
+          throw abcg::Exception{abcg::Exception::Runtime("Invalid face in OBJ")};
+        }
+        index.normal_index =
+            resolveIndex(reference, chunk.normals.size() / 3, relative.normal);
+      }
+    }
+
+    chunk.polygon.push_back(index);
+    chunk.polygonRelative.push_back(relative);
+    p = skipToken(p, end);
+  }
+
+  // Fan triangulation
+  for (const auto corner : iter::range<std::size_t>(2, chunk.polygon.size())) {
+    for (const auto source : {std::size_t{}, corner - 1, corner}) {
+      const auto& relative{chunk.polygonRelative[source]};
+      if (relative.vertex || relative.normal || relative.texCoord) {
+        chunk.relativeCorners.push_back({chunk.indices.size(), relative.vertex,
+                                         relative.normal, relative.texCoord});
+      }
+      chunk.indices.push_back(chunk.polygon[source]);
+    }
+  }
+}
+
+void parseVector(const char* p, const char* end, int numComponents,
+                 std::vector<float>& output) {
+  for (const auto component : iter::range(numComponents)) {
+    float value{};
+    const char* next{p < end ? parseReal(p, end, value) : nullptr};
+    if (next == nullptr) {
+      // Missing trailing components default to zero
+      if (component == 0) {
+        throw abcg::Exception{abcg::Exception::Runtime("Invalid vector in OBJ")};
+      }
+      value = 0.0f;
+    } else {
+      p = next;
+    }
+    output.push_back(value);
+  }
+}
+
+void parseLine(const char* p, const char* end, ChunkResult& chunk) {
+  p = skipSpace(p, end);
+  if (p == end || *p == '#') return;
+
+  if (startsWith(p, end, "v")) {
+    parseVector(p + 2, end, 3, chunk.positions);
+  } else if (startsWith(p, end, "vt")) {
+    parseVector(p + 3, end, 2, chunk.texCoords);
+  } else if (startsWith(p, end, "vn")) {
+    parseVector(p + 3, end, 3, chunk.normals);
+  } else if (startsWith(p, end, "f")) {
+    parseFace(p + 2, end, chunk);
+  } else if (startsWith(p, end, "usemtl")) {
+    const auto* name{skipSpace(p + 7, end)};
+    chunk.materialSwitches.emplace_back(chunk.indices.size() / 3,
+                                        std::string{name, skipToken(name, end)});
+  } else if (startsWith(p, end, "mtllib")) {
+    for (p = skipSpace(p + 7, end); p < end; p = skipSpace(p, end)) {
+      const auto* name{p};
+      p = skipToken(p, end);
+      chunk.materialLibraries.emplace_back(name, p);
+    }
+  }
+}
+
+void parseChunk(const char* begin, const char* end, ChunkResult& chunk) {
+  for (const char* p{begin}; p < end;) {
+    const auto* lineEnd{
+        static_cast<const char*>(std::memchr(p, '\n', end - p))};
+    if (lineEnd == nullptr) lineEnd = end;
+    parseLine(p, lineEnd, chunk);
+    p = lineEnd + 1;
+  }
+}
+
+std::vector<tinyobj::material_t> loadMaterials(
+    const std::vector<ChunkResult>& chunks, std::string_view mtlSearchPath,
+    std::map<std::string, int>& materialMap, std::string& warning) {
+  std::vector<tinyobj::material_t> materials;
+  for (const auto& chunk : chunks) {
+    for (const auto& library : chunk.materialLibraries) {
+      std::ifstream stream{std::filesystem::path{mtlSearchPath} / library};
+      if (!stream) {
+        warning += fmt::format("Material file {} not found\n", library);
+        continue;
+      }
+
+      // Same as tinyobj: the first library that opens is used
+      std::string error;
+      tinyobj::LoadMtl(&materialMap, &materials, &stream, &warning, &error);
+      if (!error.empty()) warning += error;
+      return materials;
+    }
+  }
+  return materials;
+}
+
+}  // namespace
+
+ObjData parseObj(std::string_view path, std::string_view mtlSearchPath,
+                 ThreadPool& pool) {
+  // Read whole file
+  std::ifstream stream{std::filesystem::path{path}, std::ios::binary};
+  if (!stream) {
+    throw abcg::Exception{
+        abcg::Exception::Runtime(fmt::format("Failed to open {}", path))};
+  }
+  stream.seekg(0, std::ios::end);
+  std::string contents(static_cast<std::size_t>(stream.tellg()), '\0');
+  stream.seekg(0);
+  stream.read(contents.data(), static_cast<std::streamsize>(contents.size()));
+
+  // Split into chunks at line boundaries
+  const auto* const fileBegin{contents.data()};
+  const auto* const fileEnd{fileBegin + contents.size()};
+  const auto chunkSize{
+      std::max(minChunkSize, contents.size() / (pool.size() * 4) + 1)};
+
+  std::vector<const char*> boundaries{fileBegin};
+  while (boundaries.back() < fileEnd) {
+    const auto* next{boundaries.back() +
+                     std::min<std::size_t>(chunkSize, fileEnd - boundaries.back())};
+    const auto* newline{
+        static_cast<const char*>(std::memchr(next, '\n', fileEnd - next))};
+    boundaries.push_back(newline == nullptr ? fileEnd : newline + 1);
+  }
+  const auto numChunks{boundaries.size() - 1};
+
+  std::vector<ChunkResult> chunks(numChunks);
+  pool.parallelFor(numChunks, [&](std::size_t index) {
+    parseChunk(boundaries[index], boundaries[index + 1], chunks[index]);
+  });
+
+  ObjData data;
+  std::map<std::string, int> materialMap;
+  data.materials =
+      loadMaterials(chunks, mtlSearchPath, materialMap, data.warning);
+
+  // Offsets of each chunk in the merged arrays
+  struct Offsets {
+    std::size_t positions{};
+    std::size_t normals{};
+    std::size_t texCoords{};
+    std::size_t indices{};
+  };
+  std::vector<Offsets> offsets(numChunks + 1);
+  for (const auto index : iter::range(numChunks)) {
+    const auto& chunk{chunks[index]};
+    offsets[index + 1] = {offsets[index].positions + chunk.positions.size(),
+                          offsets[index].normals + chunk.normals.size(),
+                          offsets[index].texCoords + chunk.texCoords.size(),
+                          offsets[index].indices + chunk.indices.size()};
+  }
+  const auto& totals{offsets.back()};
+
+  data.attrib.vertices.resize(totals.positions);
+  data.attrib.normals.resize(totals.normals);
+  data.attrib.texcoords.resize(totals.texCoords);
+  data.indices.resize(totals.indices);
+
+  // Merge chunks, rebasing chunk-relative references
+  pool.parallelFor(numChunks, [&](std::size_t index) {
+    auto& chunk{chunks[index]};
+    const auto& offset{offsets[index]};
+
+    std::ranges::copy(chunk.positions,
+                      data.attrib.vertices.begin() + offset.positions);
+    std::ranges::copy(chunk.normals,
+                      data.attrib.normals.begin() + offset.normals);
+    std::ranges::copy(chunk.texCoords,
+                      data.attrib.texcoords.begin() + offset.texCoords);
+
+    for (const auto& relative : chunk.relativeCorners) {
+      auto& corner{chunk.indices[relative.corner]};
+      if (relative.vertex) {
+        corner.vertex_index += static_cast<int>(offset.positions / 3);
+      }
+      if (relative.normal) {
+        corner.normal_index += static_cast<int>(offset.normals / 3);
+      }
+      if (relative.texCoord) {
+        corner.texcoord_index += static_cast<int>(offset.texCoords / 2);
+      }
+    }
+
+    for (const auto& corner : chunk.indices) {
+      // Unsigned casts also reject references before the first element
+      if (static_cast<std::size_t>(corner.vertex_index) >=
+              totals.positions / 3 ||
+          static_cast<std::size_t>(corner.normal_index + 1) >
+              totals.normals / 3 ||
+          static_cast<std::size_t>(corner.texcoord_index + 1) >
+              totals.texCoords / 2) {
+        throw abcg::Exception{abcg::Exception::Runtime(
+            fmt::format("Face index out of range in {}", path))};
+      }
+    }
+
+    std::ranges::copy(chunk.indices, data.indices.begin() + offset.indices);
+  });
+
+  // Per-triangle material ids; a usemtl stays active across chunks
+  data.materialIds.resize(totals.indices / 3);
+  int currentMaterial{-1};
+  for (const auto index : iter::range(numChunks)) {
+    const auto firstTriangle{offsets[index].indices / 3};
+    auto triangle{firstTriangle};
+    for (const auto& [localTriangle, name] : chunks[index].materialSwitches) {
+      std::fill(data.materialIds.begin() + static_cast<std::ptrdiff_t>(triangle),
+                data.materialIds.begin() +
+                    static_cast<std::ptrdiff_t>(firstTriangle + localTriangle),
+                currentMaterial);
+      triangle = firstTriangle + localTriangle;
+
+      const auto found{materialMap.find(name)};
+      if (found == materialMap.end()) {
+        data.warning += fmt::format("Material {} not found\n", name);
+        currentMaterial = -1;
+      } else {
+        currentMaterial = found->second;
+      }
+    }
+    std::fill(data.materialIds.begin() + static_cast<std::ptrdiff_t>(triangle),
+              data.materialIds.begin() +
+                  static_cast<std::ptrdiff_t>(offsets[index + 1].indices / 3),
+              currentMaterial);
+  }
+
+  return data;
+}
@@ -0,0 +1,29 @@
+#ifndef OBJPARSER_HPP_
+#define OBJPARSER_HPP_
+
+#include <tiny_obj_loader.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+class ThreadPool;
+
+// Contents of an OBJ file in tinyobj's layout. All faces are triangulated
+// and concatenated in file order, which is the order in which
+// tinyobj::ObjReader lists them across its shapes.
+struct ObjData {
+  tinyobj::attrib_t attrib;
+  std::vector<tinyobj::index_t> indices;  // Three per triangle
+  std::vector<int> materialIds;           // One per triangle, -1 if none
+  std::vector<tinyobj::material_t> materials;
+  std::string warning;
+};
+
+// Parses v/vt/vn/f/usemtl/mtllib records of an OBJ file on a thread pool.
+// The file is split into line-aligned chunks that are parsed independently
+// and then merged. Polygons are fan-triangulated.
+ObjData parseObj(std::string_view path, std::string_view mtlSearchPath,
+                 ThreadPool& pool);
+
+#endif
@@ -1,13 +1,42 @@
 #include "openglwindow.hpp"
 
+#include <fmt/core.h>
 #include <imgui.h>
 
+#include <chrono>
 #include <cppitertools/itertools.hpp>
 #include <glm/gtc/matrix_inverse.hpp>
+#include <limits>
 
 #include "imfilebrowser.h"
 
 void OpenGLWindow::handleEvent(SDL_Event& ev) {
+  if (ev.type == SDL_KEYDOWN && ev.key.repeat == 0) {
+    if (ev.key.keysym.sym == SDLK_F5) {
+      if (m_inputMode == InputMode::Recording) {
+        stopInputRecording();
+      } else {
+        startInputRecording();
+      }
+    }
+    if (ev.key.keysym.sym == SDLK_F6) startInputReplay();
+    if (ev.key.keysym.sym == SDLK_F7) m_showProfiler = !m_showProfiler;
+    if (ev.key.keysym.sym == SDLK_F8) m_cameraCollision = !m_cameraCollision;
+    if (ev.key.keysym.sym == SDLK_F9) {
+      m_occlusionCulling = !m_occlusionCulling;
+      m_depthPyramid.invalidate();
+    }
+    if (ev.key.keysym.sym == SDLK_F10) m_pvsCulling = !m_pvsCulling;
+  }
+
+  if (ev.type == SDL_MOUSEBUTTONDOWN && ev.button.button == SDL_BUTTON_LEFT &&
+      !ImGui::GetIO().WantCaptureMouse) {
+    pickExhibit(ev.button.x, ev.button.y);
+  }
+
+  // The replay drives the camera
+  if (m_inputMode == InputMode::Replaying) return;
+
   if (ev.type == SDL_KEYDOWN) {
     if (ev.key.keysym.sym == SDLK_UP || ev.key.keysym.sym == SDLK_w)
       m_dollySpeed = 0.5f;
@@ -42,9 +71,14 @@ void OpenGLWindow::initializeGL() {
   abcg::glClearColor(0, 0, 0, 1);
   abcg::glEnable(GL_DEPTH_TEST);
 
-  // Create programs
-  m_program = createProgramFromFile(getAssetsPath() + "shaders/texture.vert",
-                                    getAssetsPath() + "shaders/texture.frag");
+  // Programs are compiled per variant on first use
+  // Room for the frame block and a few hundred object blocks per frame
+  m_uniformRing.create(64 * 1024);
+
+  // Exhibits come first, as their regions bound the visibility sets
+  m_exhibits = loadExhibits(getAssetsPath() + "hintze-hall.exhibits");
+  m_exhibitGrid.build(m_exhibits);
+  m_exhibitDismissed.assign(m_exhibits.size(), false);
 
   // Load default model
   loadModel(getAssetsPath() + "hintze-hall-1m.obj");
@@ -53,75 +87,324 @@ void OpenGLWindow::initializeGL() {
 }
 
 void OpenGLWindow::loadModel(std::string_view path) {
-  m_model.terminateGL();
-
-  m_model.loadDiffuseTexture(getAssetsPath() + "hintze-hall-1m_u1_v1.jpg");
-  m_model.loadObj(path);
-  m_model.setupVAO(m_program);
-  m_trianglesToDraw = m_model.getNumTriangles();
-
-  // Use material properties from the loaded model
-  m_Ka = m_model.getKa();
-  m_Kd = m_model.getKd();
-  m_Ks = m_model.getKs();
-  m_shininess = m_model.getShininess();
+  // Only one load at a time. Requests made meanwhile are queued, the newest
+  // replacing older ones, and started by finishLoading without blocking.
+  if (m_loadFuture.valid()) {
+    m_queuedModelPath = path;
+    return;
+  }
+
+  m_loadingModel = std::make_unique<Model>(m_threadPool);
+  m_loadProgress = std::make_unique<LoadProgress>();
+
+  // Visitors walk between the exhibits, so visibility sets only cover their
+  // regions. The model matrix is the identity, so these are shown positions.
+  std::vector<Bounds> viewRegions;
+  for (const auto& exhibit : m_exhibits) {
+    viewRegions.push_back({exhibit.regionMin - exhibit.triggerRadius,
+                           exhibit.regionMax + exhibit.triggerRadius});
+  }
+
+#if defined(__EMSCRIPTEN__)
+  // No threads without pthread support: run on the first finishLoading call
+  constexpr auto policy{std::launch::deferred};
+#else
+  constexpr auto policy{std::launch::async};
+#endif
+  m_loadFuture = std::async(
+      policy, [model = m_loadingModel.get(), progress = m_loadProgress.get(),
+               path = std::string{path}, format = m_vertexFormat,
+               viewRegions = std::move(viewRegions)] {
+        model->processObj(path, true, format, progress, viewRegions);
+      });
+}
+
+void OpenGLWindow::finishLoading() {
+  if (!m_loadFuture.valid()) return;
+  if (m_loadFuture.wait_for(std::chrono::seconds{0}) ==
+      std::future_status::timeout) {
+    return;
+  }
+
+  try {
+    m_loadFuture.get();
+  } catch (...) {
+    m_loadingModel.reset();
+    m_loadProgress.reset();
+    throw;
+  }
+
+  m_loadingModel->uploadToGL(m_loadProgress.get());
+  m_loadingModel->setupVAO(
+      getShaderVariant(m_loadingModel->getVertexFormat()).program);
+
+  if (m_model) m_model->terminateGL();
+  m_model = std::move(m_loadingModel);
+  m_depthPyramid.invalidate();
+  m_loadProgress.reset();
+
+  if (m_queuedModelPath) {
+    const auto path{std::move(*m_queuedModelPath)};
+    m_queuedModelPath.reset();
+    loadModel(path);
+  }
 }
 
 
+const ShaderVariant& OpenGLWindow::getShaderVariant(VertexFormat format) {
+  // Indexed by mapping mode
+  static constexpr std::array mappingDefines{
+      "MAPPING_TRIPLANAR", "MAPPING_CYLINDRICAL", "MAPPING_SPHERICAL",
+      "MAPPING_MESH"};
+
+  ShaderVariantKey key{getAssetsPath() + "shaders/texture.vert",
+                       getAssetsPath() + "shaders/texture.frag",
+                       {mappingDefines.at(m_mappingMode)}};
+  if (format == VertexFormat::Packed) {
+    key.defines.emplace_back("OCTAHEDRAL_NORMALS");
+  }
+  return m_shaderVariants.get(key);
+}
+
 void OpenGLWindow::paintGL() {
-  update();
+  const auto frameStart{std::chrono::steady_clock::now()};
+  m_profiler.endGpu(m_uiGpuScope);
+  m_profiler.beginFrame();
+  m_profiler.beginCpu(m_paintGLScope);
+
+  finishLoading();
+  if (!m_benchmarkMode) {
+    m_profiler.beginCpu(m_updateScope);
+    update();
+    m_profiler.endCpu(m_updateScope);
+  }
 
   abcg::glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   abcg::glViewport(0, 0, m_viewportWidth, m_viewportHeight);
 
-  // Use currently selected program
-  abcg::glUseProgram(m_program);
-
-  // Get location of uniform variables
-  const GLint viewMatrixLoc{abcg::glGetUniformLocation(m_program, "viewMatrix")};
-  const GLint projMatrixLoc{abcg::glGetUniformLocation(m_program, "projMatrix")};
-  const GLint modelMatrixLoc{
-      abcg::glGetUniformLocation(m_program, "modelMatrix")};
-  const GLint shininessLoc{abcg::glGetUniformLocation(m_program, "shininess")};
-  const GLint IaLoc{abcg::glGetUniformLocation(m_program, "Ia")};
-  const GLint IdLoc{abcg::glGetUniformLocation(m_program, "Id")};
-  const GLint IsLoc{abcg::glGetUniformLocation(m_program, "Is")};
-  const GLint KaLoc{abcg::glGetUniformLocation(m_program, "Ka")};
-  const GLint KdLoc{abcg::glGetUniformLocation(m_program, "Kd")};
-  const GLint KsLoc{abcg::glGetUniformLocation(m_program, "Ks")};
-  const GLint diffuseTexLoc{abcg::glGetUniformLocation(m_program, "diffuseTex")};
-  const GLint mappingModeLoc{
-      abcg::glGetUniformLocation(m_program, "mappingMode")};
-
-  // Set uniform variables used by every scene object
-  abcg::glUniformMatrix4fv(viewMatrixLoc, 1, GL_FALSE, &m_camera.m_viewMatrix[0][0]);
-  abcg::glUniformMatrix4fv(projMatrixLoc, 1, GL_FALSE, &m_camera.m_projMatrix[0][0]);
-  abcg::glUniform1i(diffuseTexLoc, 0);
-  abcg::glUniform1i(mappingModeLoc, m_mappingMode);
-
-  // abcg::glUniformMatrix3fv(texMatrixLoc, 1, GL_TRUE, &texMatrix[0][0]);
-
-  abcg::glUniform4fv(IaLoc, 1, &m_Ia.x);
-  abcg::glUniform4fv(IdLoc, 1, &m_Id.x);
-  abcg::glUniform4fv(IsLoc, 1, &m_Is.x);
-
-  // Set uniform variables of the current object
-  abcg::glUniformMatrix4fv(modelMatrixLoc, 1, GL_FALSE, &m_modelMatrix[0][0]);
-
-  const auto modelViewMatrix{glm::mat3(m_viewMatrix * m_modelMatrix)};
-
-  abcg::glUniform1f(shininessLoc, m_shininess);
-  abcg::glUniform4fv(KaLoc, 1, &m_Ka.x);
-  abcg::glUniform4fv(KdLoc, 1, &m_Kd.x);
-  abcg::glUniform4fv(KsLoc, 1, &m_Ks.x);
-
-  m_model.render(m_trianglesToDraw);
+  if (!m_model) {
+    m_profiler.endCpu(m_paintGLScope);
+    return;
+  }
+
+  // Refine the mesh a little every frame until it is all resident
+  m_model->streamGeometry(m_streamBytesPerFrame);
+  m_trianglesToDraw = static_cast<int>(m_model->getNumResidentTriangles());
+  if (m_replayOnLoad && m_model->isFullyResident()) {
+    m_replayOnLoad = false;
+    startInputReplay();
+  }
+  const auto benchmarkFrame{beginBenchmarkFrame()};
+
+  // Use the program of the current mapping mode and vertex format
+  abcg::glUseProgram(getShaderVariant(m_model->getVertexFormat()).program);
+  m_uniformRing.beginFrame();
+
+  // Set uniform blocks used by every scene object
+  const FrameUniforms frameUniforms{.viewMatrix = m_camera.m_viewMatrix,
+                                    .projMatrix = m_camera.m_projMatrix,
+                                    .lightDirWorldSpace = m_lightDir,
+                                    .Ia = m_Ia,
+                                    .Id = m_Id,
+                                    .Is = m_Is};
+  m_uniformRing.bind(frameBlockBinding, frameUniforms);
+
+  // Set uniform blocks of the current object. Its vertices keep their
+  // positions from the file, so standardizing is part of the transforms.
+  const auto modelMatrix{m_modelMatrix * m_model->getStandardizeMatrix()};
+  const auto modelViewMatrix{glm::mat3(m_camera.m_viewMatrix * modelMatrix)};
+  const ObjectUniforms objectUniforms{
+      .modelMatrix = m_modelMatrix,
+      .vertexMatrix = m_model->getVertexMatrix(),
+      .normalMatrix = glm::mat4(glm::inverseTranspose(modelViewMatrix))};
+  m_uniformRing.bind(objectBlockBinding, objectUniforms);
+
+  // Cull clusters against the frustum, the depth pyramid and the visibility
+  // set of the eye's cell and pick their LODs in model space
+  const auto clipMatrix{m_camera.m_projMatrix * m_camera.m_viewMatrix *
+                        modelMatrix};
+  const Frustum frustum{clipMatrix};
+  const LodSelection lodSelection{
+      glm::vec3(glm::inverse(modelMatrix) * glm::vec4(m_camera.m_eye, 1.0f)),
+      m_camera.m_projMatrix[1][1] * static_cast<float>(m_viewportHeight) / 2.0f,
+      m_lodMaxPixelError};
+  if (m_occlusionCulling) m_depthPyramid.update(lodSelection.eye);
+  const auto potentiallyVisible{
+      m_pvsCulling ? m_model->getVisibilitySets().find(lodSelection.eye)
+                   : std::span<const std::uint64_t>{}};
+  m_profiler.beginGpu(m_modelGpuScope);
+  m_model->render(frustum, lodSelection,
+                  m_occlusionCulling ? &m_depthPyramid : nullptr,
+                  potentiallyVisible);
+  m_profiler.endGpu(m_modelGpuScope);
+
+#if !defined(__EMSCRIPTEN__)
+  // Redraw what was just drawn depth-only, for culling the next frames
+  if (m_occlusionCulling) {
+    const ShaderVariantKey depthKey{getAssetsPath() + "shaders/depth.vert",
+                                    getAssetsPath() + "shaders/depth.frag",
+                                    {}};
+    m_profiler.beginGpu(m_occluderGpuScope);
+    m_depthPyramid.beginCapture();
+    abcg::glUseProgram(m_shaderVariants.get(depthKey).program);
+    m_model->renderOccluders();
+    m_depthPyramid.endCapture(clipMatrix, lodSelection.eye);
+    m_profiler.endGpu(m_occluderGpuScope);
+  }
+#endif
 
+  m_uniformRing.endFrame();
   abcg::glUseProgram(0);
+  m_profiler.endCpu(m_paintGLScope);
+
+  if (benchmarkFrame) {
+    const std::chrono::duration<double, std::milli> cpuTime{
+        std::chrono::steady_clock::now() - frameStart};
+    endBenchmarkFrame(cpuTime.count());
+  }
+}
+
+void OpenGLWindow::enableBenchmark(std::vector<CameraKeyframe> cameraPath,
+                                   std::string outputPath) {
+  m_benchmarkMode = true;
+  // The recorder times the frame with its own query
+  m_profiler.setGpuEnabled(false);
+  m_benchmarkPath = std::move(cameraPath);
+  m_benchmarkOutput = std::move(outputPath);
+  m_benchmarkFrame = 0;
+}
+
+void OpenGLWindow::enableBenchmark(const InputRecording& recording,
+                                   std::string outputPath) {
+  // The camera can only collide with the model once it is loaded
+  m_benchmarkRecording = recording;
+  enableBenchmark(std::vector<CameraKeyframe>{}, std::move(outputPath));
+}
+
+bool OpenGLWindow::beginBenchmarkFrame() {
+  if (!m_model->isFullyResident()) return false;
+  if (m_benchmarkPath.empty() && !m_benchmarkRecording.stepsPerFrame.empty()) {
+    Camera camera;
+    camera.m_eye = m_benchmarkRecording.start.eye;
+    camera.m_at = m_benchmarkRecording.start.at;
+    camera.m_up = m_benchmarkRecording.start.up;
+
+    InputReplay replay;
+    replay.start(m_benchmarkRecording);
+    while (!replay.isDone()) {
+      replay.nextFrame([&](const CameraInput& input) {
+        stepCamera(camera, input, m_benchmarkRecording.timestep);
+      });
+      m_benchmarkPath.push_back({camera.m_eye, camera.m_at, camera.m_up});
+    }
+    m_benchmarkRecording = {};
+  }
+  if (m_benchmarkPath.empty()) return false;
+
+  // Warm up on the first keyframe, then one frame per keyframe
+  const auto recording{m_benchmarkFrame >= m_benchmarkWarmupFrames};
+  const auto& keyframe{
+      m_benchmarkPath[recording ? m_benchmarkFrame - m_benchmarkWarmupFrames
+                                : 0]};
+  m_camera.m_eye = keyframe.eye;
+  m_camera.m_at = keyframe.at;
+  m_camera.m_up = keyframe.up;
+  m_camera.computeViewMatrix();
+
+  if (recording) m_benchmarkRecorder.beginFrame();
+  return true;
+}
+
+void OpenGLWindow::endBenchmarkFrame(double cpuMilliseconds) {
+  if (m_benchmarkFrame >= m_benchmarkWarmupFrames) {
+    m_benchmarkRecorder.endFrame(cpuMilliseconds,
+                                 m_model->getNumRenderedTriangles(),
+                                 m_model->getNumOccludedClusters(),
+                                 m_model->getNumPvsCulledClusters());
+  }
+
+  ++m_benchmarkFrame;
+  if (m_benchmarkFrame == m_benchmarkWarmupFrames + m_benchmarkPath.size()) {
+    m_benchmarkRecorder.finish(m_benchmarkOutput);
+    m_benchmarkPath.clear();
+
+    SDL_Event quitEvent{};
+    quitEvent.type = SDL_QUIT;
+    SDL_PushEvent(&quitEvent);
+  }
+}
+
+void OpenGLWindow::paintLoadingUI() {
+  if (!m_loadProgress) return;
+
+  const auto phases{m_loadProgress->getPhases()};
+  const auto widgetSize{
+      ImVec2(300, 60 + 18 * static_cast<float>(phases.size()))};
+  ImGui::SetNextWindowPos(ImVec2((m_viewportWidth - widgetSize.x) / 2,
+                                 (m_viewportHeight - widgetSize.y) / 2));
+  ImGui::SetNextWindowSize(widgetSize);
+  ImGui::Begin("Carregando", nullptr, ImGuiWindowFlags_NoDecoration);
+  ImGui::Text("Carregando modelo...");
+  ImGui::ProgressBar(m_loadProgress->getFraction());
+  for (const auto& phase : phases) {
+    ImGui::Text("%s%s: %.2f s", phase.done ? "" : "> ", phase.name.c_str(),
+                phase.seconds);
+  }
+  ImGui::End();
+}
+
+void OpenGLWindow::paintProfilerUI() {
+  if (!m_showProfiler) return;
+
+  ImGui::SetNextWindowPos(ImVec2(10, 10));
+  ImGui::Begin("Profiler", &m_showProfiler,
+               ImGuiWindowFlags_AlwaysAutoResize);
+
+  const auto plot{[](const FrameProfiler::Series& series) {
+    const auto overlay{fmt::format("{:.2f} ms", series.getAverage())};
+    ImGui::PlotLines(series.name.c_str(), series.samples.data(),
+                     static_cast<int>(series.samples.size()),
+                     static_cast<int>(series.next), overlay.c_str(), 0.0f,
+                     std::numeric_limits<float>::max(), ImVec2(200, 40));
+  }};
+  ImGui::Text("CPU");
+  for (const auto& series : m_profiler.getCpuSeries()) plot(series);
+#if defined(__EMSCRIPTEN__)
+  ImGui::Text("GPU: no timer queries in WebGL");
+#else
+  ImGui::Text("GPU");
+  // The UI scope spans the buffer swap, which waits for vsync, so it
+  // would make every frame look GPU-bound
+  auto gpuTime{0.0f};
+  for (const auto scope : iter::range(m_profiler.getGpuSeries().size())) {
+    const auto& series{m_profiler.getGpuSeries()[scope]};
+    plot(series);
+    if (scope != m_uiGpuScope) gpuTime += series.getAverage();
+  }
+  const auto cpuTime{m_profiler.getCpuSeries()[m_paintGLScope].getAverage() +
+                     m_profiler.getCpuSeries()[m_paintUIScope].getAverage()};
+  ImGui::Text("Bound by: %s", gpuTime > cpuTime ? "GPU" : "CPU");
+#endif
+
+  if (m_model) {
+    ImGui::Text("Triangles: %zu", m_model->getNumRenderedTriangles());
+    ImGui::Text("Draw calls: %zu", m_model->getNumDrawCalls());
+    ImGui::Text("Textures: %.1f MB",
+                static_cast<double>(m_model->getTextureMemorySize()) /
+                    (1024.0 * 1024.0));
+  }
+  ImGui::End();
 }
 
 void OpenGLWindow::paintUI() { 
+  // Nothing on screen but the scene while benchmarking
+  if (m_benchmarkMode) return;
+
+  m_profiler.beginCpu(m_paintUIScope);
   abcg::OpenGLWindow::paintUI(); 
+  paintLoadingUI();
+  paintProfilerUI();
+  m_exhibitGrid.query(m_camera.m_eye, m_activeExhibits);
   {
     if(firstExec) {
       auto widgetSize{ImVec2(800, 250)};
@@ -141,235 +424,127 @@ void OpenGLWindow::paintUI() {
 
       ImGui::End();
     }
-    {
-      auto widgetSizeB{ImVec2(222, 100)};
-    // Slider to control light properties
-    ImGui::SetNextWindowPos(ImVec2(m_viewportWidth - widgetSizeB.x - 50,
-                                   m_viewportHeight - widgetSizeB.y - 50));
-    ImGui::SetNextWindowSize(widgetSizeB);
-    ImGui::Begin(" ", nullptr, ImGuiWindowFlags_NoDecoration);
-    ImGui::Text("%f", m_camera.m_eye[0]);
-    ImGui::Text("%f", m_camera.m_eye[1]);
-    ImGui::Text("%f", m_camera.m_eye[2]);
-    if (m_camera.m_eye[1] < 2.90 && m_camera.m_eye[1] > 2.31 && m_camera.m_eye[2] < 1.10 && m_camera.m_eye[2] > -0.51) {
-      ImGui::Text("First Exposition");
-    }
-    ImGui::End();
-    }
-    {
-      // Marlin Azul do Atlantico
-    if (m_camera.m_eye[0] < 0.02 && m_camera.m_eye[0] > -0.02 && m_camera.m_eye[1] < 0.29 && m_camera.m_eye[1] > 0.16) {
-        
-        if(exp5) {
-        auto widgetSize{ImVec2(800, 250)};
-        ImGui::SetNextWindowPos(ImVec2((m_viewportWidth - widgetSize.x) / 2,
-                                      (m_viewportHeight - widgetSize.y) / 2));
-        ImGui::SetNextWindowSize(widgetSize);
-        ImGui::Begin("Exposição 5 - Árvores Fósseis", &exp5);
-        ImGui::Text("Juntos, eles abrangem centenas de milhões de anos de história da Terra, desde a árvore de 358 milhões ");
-        ImGui::Text("de anos na frente da caixa até o espécime comparativamente mais jovem"); 
-        ImGui::Text("na parte traseira, que tem entre 23 e 65 milhões de anos.");
-        ImGui::Text("A girafa é o mais alto de todos os animais vivos. Ele pode atingir quase seis metros acima do solo");
-        ImGui::Text("e pode fazê-lo porque suas pernas e pescoço são muito alongados em comparação com o resto do corpo.");
-        m_truckSpeed=0.0f;
-        m_dollySpeed=0.0f;
-        m_panSpeed=0.0f;
-        ImGui::End();
-      }
-    }
-    if (m_camera.m_eye[0] < -0.32 && m_camera.m_eye[0] > -0.38 && m_camera.m_eye[1] < -0.16 && m_camera.m_eye[1] > -0.35) {
-        
-        if(exp10) {
-        auto widgetSize{ImVec2(800, 250)};
-        ImGui::SetNextWindowPos(ImVec2((m_viewportWidth - widgetSize.x) / 2,
-                                      (m_viewportHeight - widgetSize.y) / 2));
-        ImGui::SetNextWindowSize(widgetSize);
-        ImGui::Begin("Exposição 10 -  Algas marinhas", &exp10);
-
-        ImGui::Text("Eles podem não parecer muito quando levados para a praia, mas as algas marinhas fornecem um ");
-        ImGui::Text("habitat subaquático vital.");
-        ImGui::Text("A professora Juliet Brodie está lançando luz sobre as vastas florestas que crescem em nossos oceanos.");
-        ImGui::Text("Existem muitas espécies de algas marinhas que chamam de lar os mares frios da Grã-Bretanha."); 
-        ImGui::Text("O maior deles são kelps.Essas algas marrons crescem da costa até 20-30 metros, ou mais se a água"); 
-        ImGui::Text(" estiver limpa. Eles formam florestas densas e fornecem um habitat para uma diversidade de vida marinha.");
-        ImGui::Text("Juliet diz: ‘Eles podem ser viveiros de peixes e fornecer serviços para muitos outros tipos diferentes");
-        ImGui::Text("de animais e algas marinhas. A floresta está cheia de toda essa vida incrível.");
-        ImGui::Text("' Até mesmo o holdfast - a estrutura que conecta grandes algas marrons aos fundos");
-        ImGui::Text("marinhos rochosos - sustenta uma grande quantidade de vida.");
-        m_truckSpeed=0.0f;
-        m_dollySpeed=0.0f;
-        m_panSpeed=0.0f;
-        ImGui::End();
-      }
-      }
-      if (m_camera.m_eye[0] < -0.14 && m_camera.m_eye[0] > -0.30 && m_camera.m_eye[1] < 0.30  && m_camera.m_eye[1] > 0.14) {
-        
-        if(exp6) {
-        auto widgetSize{ImVec2(800, 250)};
-        ImGui::SetNextWindowPos(ImVec2((m_viewportWidth - widgetSize.x) / 2,
-                                      (m_viewportHeight - widgetSize.y) / 2));
-        ImGui::SetNextWindowSize(widgetSize);
-        ImGui::Begin("Exposição 6 - Fomaração de ferro em faixas", &exp6);
-
-        ImGui::Text("Formação de ferro em faixas Mais de três bilhões de anos atrás, as bactérias no oceano jovem da Terra ");
-        ImGui::Text("começaram a produzir oxigênio por meio da fotossíntese.");
-        ImGui::Text("Cerca de 2,6 bilhões de anos atrás, as bactérias realmente começaram a florescer e os níveis ");
-        ImGui::Text("de oxigênio seguiram o exemplo."); 
-        ImGui::Text("Esse oxigênio se combinou com o ferro dissolvido no mar para formar óxido de ferro insolúvel,");
-        ImGui::Text("que afundou no fundo do mar. À medida que assentava, folhas de óxido de ferro vermelho ");
-        ImGui::Text("foram colocadas entre camadas de lodo rico em sílica.");
-        ImGui::Text("Ao longo de centenas de milhões de anos, o oxigênio se ligou a todo o ferro solúvel nas águas.");
-        ImGui::Text("O oxigênio livre restante não tinha outro lugar para ir, a não ser para cima e para fora na atmosfera.");
-        ImGui::Text("As camadas intrincadas na formação representam um ponto de viragem na história da Terra conhecido ");
-        ImGui::Text("como o Grande Evento de Oxigenação.");
-        m_truckSpeed=0.0f;
-        m_dollySpeed=0.0f;
-        m_panSpeed=0.0f;
-        ImGui::End();
-      }
-    }
-  if (m_camera.m_eye[0] < 0.35 && m_camera.m_eye[0] > 0.28 && m_camera.m_eye[1] < 0.35 && m_camera.m_eye[1] > 0.13) {
-          
-          if(exp3) {
-          auto widgetSize{ImVec2(800, 250)};
-          ImGui::SetNextWindowPos(ImVec2((m_viewportWidth - widgetSize.x) / 2,
-                                        (m_viewportHeight - widgetSize.y) / 2));
-          ImGui::SetNextWindowSize(widgetSize);
-          ImGui::Begin("Exposição 3 - Missouri Leviathan", &exp3);
-
-          ImGui::Text("O mastodonte americano foi um grande mamífero terrestre que vagou pela América do Norte durante ");
-          ImGui::Text("a Idade do Gelo até 13.000 anos atrás.");
-          ImGui::Text("Mastodontes viviam em florestas de pinheiros e áreas pantanosas cobertas por larício e abetos, ");
-          ImGui::Text("alimentando-se de galhos, folhas e plantas aquáticas.");
-          ImGui::Text("Adaptados para a vida na beira da água, eles tinham pés largos e dedos dos pés atarracados");
-          ImGui::Text(" e bem abertos. Isso permitiu que eles andassem no solo macio e alagado ao lado de lagoas e lagos.");
-          m_truckSpeed=0.0f;
-          m_dollySpeed=0.0f;
-          m_panSpeed=0.0f;
-          ImGui::End();
-        }
-      }
-       if (m_camera.m_eye[0] < -0.47 && m_camera.m_eye[0] > -0.51 && m_camera.m_eye[1] < 0.30 && m_camera.m_eye[1] > 0.14) {
-          
-          if(exp7) {
-          auto widgetSize{ImVec2(800, 250)};
-          ImGui::SetNextWindowPos(ImVec2((m_viewportWidth - widgetSize.x) / 2,
-                                        (m_viewportHeight - widgetSize.y) / 2));
-          ImGui::SetNextWindowSize(widgetSize);
-          ImGui::Begin("Exposição 7 - Meteorito Imilac", &exp7);
-
-          ImGui::Text("Esta peça extraterrestre faz parte de um antigo meteorito palasita. É uma fatia de um dos ");
-          ImGui::Text("maiores espécimes de seu tipo no mundo.");
-          ImGui::Text("Acredita-se que ele tenha feito parte de um meteoro muito maior que pesava até 1.000 kg ");
-          ImGui::Text("e explodiu sobre o Deserto de Atacama, ");
-          ImGui::Text("no norte do Chile, possivelmente no século XIV.Após a explosão, ");
-          ImGui::Text("fragmentos de vários tamanhos foram espalhados por uma ");
-          ImGui::Text("vasta área de deserto árido.");
-          ImGui::Text("O meteorito não é apenas bonito, ele contém informações sobre a história inicial ");
-          ImGui::Text("de nosso próprio planeta, desde o início do sistema solar.");
-          m_truckSpeed=0.0f;
-          m_dollySpeed=0.0f;
-          m_panSpeed=0.0f;
-          ImGui::End();
-          
-        }
-          
-      }
-      if (m_camera.m_eye[0] < 0.18 && m_camera.m_eye[0] > 0.13 && m_camera.m_eye[1] < 0.34 && m_camera.m_eye[1] > 0.14) {
-          
-          if(exp4) {
-          auto widgetSize{ImVec2(800, 250)};
-          ImGui::SetNextWindowPos(ImVec2((m_viewportWidth - widgetSize.x) / 2,
-                                        (m_viewportHeight - widgetSize.y) / 2));
-          ImGui::SetNextWindowSize(widgetSize);
-          ImGui::Begin("Exposição 4 - Esqueleto de Mantellisaurus", &exp4);
-          ImGui::Text("O iguanodonte foi um dos três primeiros dinossauros a ser descoberto, mas o famoso réptil pode ter");
-          ImGui::Text("arrastado vários esqueletos identificados erroneamente em seu rastro.");
-          ImGui::Text("Um dos esqueletos mais completos do mundo de Mantellisaurus atherfieldensis está em exibição no Hintze");
-          ImGui::Text("Hall do Museu, recentemente remodelado.");
-          ImGui::Text("No entanto, o dinossauro só recentemente reivindicou sua verdadeira identidade,");
-          ImGui::Text("após passar mais de 80 anos conhecido pelo mundo como uma espécie de iguanodonte.");
-          m_truckSpeed=0.0f;
-          m_dollySpeed=0.0f;
-          m_panSpeed=0.0f;
-          ImGui::End();
-        }
+    if (m_model) {
+      auto widgetSizeB{ImVec2(222, 318)};
+      // Slider to control light properties
+      ImGui::SetNextWindowPos(ImVec2(m_viewportWidth - widgetSizeB.x - 50,
+                                     m_viewportHeight - widgetSizeB.y - 50));
+      ImGui::SetNextWindowSize(widgetSizeB);
+      ImGui::Begin(" ", nullptr, ImGuiWindowFlags_NoDecoration);
+      ImGui::Text("%f", m_camera.m_eye[0]);
+      ImGui::Text("%f", m_camera.m_eye[1]);
+      ImGui::Text("%f", m_camera.m_eye[2]);
+      ImGui::Text("Clusters: %zu/%zu", m_model->getNumVisibleClusters(),
+                  m_model->getNumClusters());
+      ImGui::Text("Occluded: %zu%s", m_model->getNumOccludedClusters(),
+                  m_occlusionCulling ? "" : " (off)");
+      ImGui::Text("Not in PVS: %zu%s", m_model->getNumPvsCulledClusters(),
+                  m_pvsCulling ? "" : " (off)");
+      ImGui::Text("Triangles: %zu", m_model->getNumRenderedTriangles());
+      ImGui::Text("Resident: %d/%d", m_trianglesToDraw,
+                  m_model->getNumTriangles());
+      ImGui::Text("Materials: %zu (%zu draws)", m_model->getNumMaterials(),
+                  m_model->getNumDrawBatches());
+      ImGui::SliderFloat("LOD", &m_lodMaxPixelError, 0.0f, 8.0f, "%.1f px");
+      static constexpr std::array mappingModes{"Triplanar", "Cylindrical",
+                                               "Spherical", "From mesh"};
+      ImGui::Combo("Mapping", &m_mappingMode, mappingModes.data(),
+                   static_cast<int>(mappingModes.size()));
+      ImGui::Text("VBO: %.1f MB",
+                  static_cast<double>(m_model->getVertexBufferSize()) /
+                      (1024.0 * 1024.0));
+      auto vertexFormat{static_cast<int>(m_vertexFormat)};
+      ImGui::RadioButton("32 B", &vertexFormat,
+                         static_cast<int>(VertexFormat::Float));
+      ImGui::SameLine();
+      ImGui::RadioButton("16 B", &vertexFormat,
+                         static_cast<int>(VertexFormat::Packed));
+      if (vertexFormat != static_cast<int>(m_vertexFormat)) {
+        // Reload so the new layout goes through createBuffers/setupVAO
+        m_vertexFormat = static_cast<VertexFormat>(vertexFormat);
+        loadModel(getAssetsPath() + "hintze-hall-1m.obj");
       }
-        if (m_camera.m_eye[0] < -0.49 && m_camera.m_eye[0] > -0.57 && m_camera.m_eye[1] < -0.19 && m_camera.m_eye[1] > -0.35  ) {
-          
-          if(exp9) {
-          auto widgetSize{ImVec2(800, 250)};
-          ImGui::SetNextWindowPos(ImVec2((m_viewportWidth - widgetSize.x) / 2,
-                                        (m_viewportHeight - widgetSize.y) / 2));
-          ImGui::SetNextWindowSize(widgetSize);
-          ImGui::Begin("Exposição 9 - insetos", &exp9);
-          ImGui::Text("O número de insetos no mundo é enorme. Existem cerca de cinco e meio milhões de espécies diferentes");
-          ImGui::Text(" de insetos e muitos milhões de indivíduos de qualquer uma dessas espécies.");
-          ImGui::Text("Portanto, não é de surpreender que os insetos como grupo tenham um efeito amplo e profundo ");
-          ImGui::Text("no mundo ao nosso redor.");
-          m_truckSpeed=0.0f;
-          m_dollySpeed=0.0f;
-          m_panSpeed=0.0f;
-          ImGui::End();
-        }
-      }
-
-       if (m_camera.m_eye[0] < 0.01 && m_camera.m_eye[0] > -0.06 && m_camera.m_eye[1] < -0.18 && m_camera.m_eye[1] > -0.35) {
-          
-          if(exp11) {
-          auto widgetSize{ImVec2(800, 250)};
-          ImGui::SetNextWindowPos(ImVec2((m_viewportWidth - widgetSize.x) / 2,
-                                        (m_viewportHeight - widgetSize.y) / 2));
-          ImGui::SetNextWindowSize(widgetSize);
-          ImGui::Begin("Exposição 11 - Turbinaria bifrons", &exp11);
-          ImGui::Text("Um coral antigo branqueado é uma adição instigante ao Hintze Hall.Pesando mais de 300 quilos, o gigante ");
-          ImGui::Text("Turbinaria bifrons foi coletado no Shark Bay Reef, na costa da Austrália Ocidental, há mais de 120 anos.");
-          m_truckSpeed=0.0f;
-          m_dollySpeed=0.0f;
-          m_panSpeed=0.0f;
-          ImGui::End();
+      // Exhibits without a description only label the position
+      for (const auto index : m_activeExhibits) {
+        if (m_exhibits[index].text.empty()) {
+          ImGui::Text("%s", m_exhibits[index].title.c_str());
         }
       }
+      ImGui::End();
+    }
+    paintExhibitsUI();
+  }
 
-      if (m_camera.m_eye[0] < 0.21 && m_camera.m_eye[0] > 0.14 && m_camera.m_eye[1] < -0.19 && m_camera.m_eye[1] > -0.35) {
-          
-          if(exp12) {
-          auto widgetSize{ImVec2(800, 250)};
-          ImGui::SetNextWindowPos(ImVec2((m_viewportWidth - widgetSize.x) / 2,
-                                        (m_viewportHeight - widgetSize.y) / 2));
-          ImGui::SetNextWindowSize(widgetSize);
-          ImGui::Begin("Exposição 12 - Marlin azul do atlântico", &exp12);
-          ImGui::Text("O peixe de quatro metros de comprimento foi descoberto em uma praia de Pembrokeshire na semana passada.");
-          ImGui::Text("Embora algumas pessoas tenham pensado inicialmente que era um peixe-espada, ele foi identificado ");
-          ImGui::Text("como um marlin azul - apenas o terceiro foi encontrado no Reino Unido.");
-          m_truckSpeed=0.0f;
-          m_dollySpeed=0.0f;
-          m_panSpeed=0.0f;
-          ImGui::End();
-        }
-      }
+  m_profiler.endCpu(m_paintUIScope);
+  m_profiler.beginGpu(m_uiGpuScope);
+}
 
-       if (m_camera.m_eye[0] < 0.35 && m_camera.m_eye[0] > 0.29 && m_camera.m_eye[1] < -0.18 && m_camera.m_eye[1] > -0.35) {
-          
-          if(exp13) {
-          auto widgetSize{ImVec2(800, 250)};
-          ImGui::SetNextWindowPos(ImVec2((m_viewportWidth - widgetSize.x) / 2,
-                                        (m_viewportHeight - widgetSize.y) / 2));
-          ImGui::SetNextWindowSize(widgetSize);
-          ImGui::Begin("Exposição 13 - Girafa", &exp13);
-          ImGui::Text("A girafa é o mais alto de todos os animais vivos. Ele pode atingir quase seis metros acima do solo ");
-          ImGui::Text("e pode fazê-lo porque suas pernas e pescoço são muito alongados em comparação com o resto do corpo.");
-          m_truckSpeed=0.0f;
-          m_dollySpeed=0.0f;
-          m_panSpeed=0.0f;
-          ImGui::End();
-        }
-      }
+void OpenGLWindow::paintExhibitsUI() {
+  // Returns whether the window is still open
+  const auto paintExhibit{[&](std::size_t index) {
+    const auto& exhibit{m_exhibits[index]};
+    auto widgetSize{ImVec2(800, 250)};
+    ImGui::SetNextWindowPos(ImVec2((m_viewportWidth - widgetSize.x) / 2,
+                                   (m_viewportHeight - widgetSize.y) / 2));
+    ImGui::SetNextWindowSize(widgetSize);
+    auto open{true};
+    ImGui::Begin(exhibit.title.c_str(), &open);
+    for (const auto& line : exhibit.text) ImGui::Text("%s", line.c_str());
+    ImGui::End();
 
+    // Hold the camera while the description is open
+    m_truckSpeed = 0.0f;
+    m_dollySpeed = 0.0f;
+    m_panSpeed = 0.0f;
+    return open;
+  }};
+
+  for (const auto index : m_activeExhibits) {
+    if (m_exhibits[index].text.empty() || m_exhibitDismissed[index] ||
+        index == m_pickedExhibit) {
+      continue;
+    }
+    m_exhibitDismissed[index] = !paintExhibit(index);
+  }
+  if (m_pickedExhibit && !paintExhibit(*m_pickedExhibit)) {
+    m_pickedExhibit.reset();
   }
+}
+
+void OpenGLWindow::pickExhibit(int x, int y) {
+  if (!m_model) return;
+
+  // Cursor ray from the near to the far plane, in model space
+  const auto modelMatrix{m_modelMatrix * m_model->getStandardizeMatrix()};
+  const auto clipToWorld{
+      glm::inverse(m_camera.m_projMatrix * m_camera.m_viewMatrix)};
+  const auto worldToModel{glm::inverse(modelMatrix)};
+  const glm::vec2 cursor{
+      2.0f * (static_cast<float>(x) + 0.5f) / m_viewportWidth - 1.0f,
+      1.0f - 2.0f * (static_cast<float>(y) + 0.5f) / m_viewportHeight};
+  const auto unproject{[&](float depth) {
+    const auto world{clipToWorld * glm::vec4{cursor.x, cursor.y, depth, 1.0f}};
+    return glm::vec3(worldToModel * (world / world.w));
+  }};
+  const auto nearPoint{unproject(-1.0f)};
+  const auto farPoint{unproject(1.0f)};
+
+  RayHit hit;
+  if (!m_model->getCollisionBvh().raycast(nearPoint, farPoint - nearPoint,
+                                          1.0f, hit)) {
+    return;
   }
-  
 
+  // The first exhibit with a description around the hit, in file order
+  std::vector<std::size_t> exhibits;
+  m_exhibitGrid.query(glm::vec3{modelMatrix * glm::vec4{hit.point, 1.0f}},
+                      exhibits);
+  for (const auto index : exhibits) {
+    if (!m_exhibits[index].text.empty()) {
+      m_pickedExhibit = index;
+      return;
+    }
+  }
 }
 
 void OpenGLWindow::resizeGL(int width, int height) {
@@ -377,19 +552,120 @@ void OpenGLWindow::resizeGL(int width, int height) {
   m_viewportHeight = height;
 
   m_camera.computeProjectionMatrix(width, height);
+  m_depthPyramid.resize(width, height);
 
 }
 
 void OpenGLWindow::terminateGL() {
-  m_model.terminateGL();
-    abcg::glDeleteProgram(m_program);
+  if (m_inputMode == InputMode::Recording) stopInputRecording();
+  if (m_loadFuture.valid()) m_loadFuture.wait();
+  if (m_model) m_model->terminateGL();
+  m_uniformRing.destroy();
+  m_profiler.terminateGL();
+  m_benchmarkRecorder.terminateGL();
+  m_depthPyramid.terminateGL();
+  m_shaderVariants.clear();
 }
 
 void OpenGLWindow::update() {
-  const float deltaTime{static_cast<float>(getDeltaTime())};
+  if (m_inputMode == InputMode::Replaying) {
+    m_inputReplay.nextFrame([&](const CameraInput& input) {
+      stepCamera(m_camera, input, m_replayRecording.timestep);
+    });
+    if (m_inputReplay.isDone()) {
+      m_inputMode = InputMode::Live;
+      fmt::print("Replay of {} finished\n", m_inputRecordingPath);
+    }
+    return;
+  }
+
+  // Whole steps of the elapsed time; the rest carries over. Stalls such as
+  // a shader compile are capped so the camera doesn't jump.
+  m_stepAccumulator = std::min(m_stepAccumulator + getDeltaTime(), 0.25);
+  const auto numSteps{
+      static_cast<std::size_t>(m_stepAccumulator / m_cameraTimestep)};
+  m_stepAccumulator -= static_cast<double>(numSteps) * m_cameraTimestep;
 
+  const CameraInput input{m_dollySpeed, m_truckSpeed, m_panSpeed};
+  if (m_inputMode == InputMode::Recording) {
+    m_inputRecorder.recordFrame(input, numSteps);
+  }
+  for ([[maybe_unused]] const auto step : iter::range(numSteps)) {
+    stepCamera(m_camera, input, m_cameraTimestep);
+  }
+}
+
+void OpenGLWindow::stepCamera(Camera& camera, const CameraInput& input,
+                              float timestep) const {
   // Update LookAt camera
-  m_camera.dolly(m_dollySpeed * deltaTime);
-  m_camera.truck(m_truckSpeed * deltaTime);
-  m_camera.pan(m_panSpeed * deltaTime);
-}
\ No newline at end of file
+  const auto previousEye{camera.m_eye};
+  camera.dolly(input.dollySpeed * timestep);
+  camera.truck(input.truckSpeed * timestep);
+
+  if (m_cameraCollision && m_model && previousEye != camera.m_eye) {
+    // Collide in model space, where the BVH is. The transform scales
+    // uniformly, so the radius scales by the length of any axis.
+    const auto modelToWorld{m_modelMatrix * m_model->getStandardizeMatrix()};
+    const auto worldToModel{glm::inverse(modelToWorld)};
+    const auto from{worldToModel * glm::vec4{previousEye, 1.0f}};
+    const auto to{worldToModel * glm::vec4{camera.m_eye, 1.0f}};
+    const auto radius{m_cameraRadius *
+                      glm::length(glm::vec3{worldToModel[0]})};
+    const auto eye{m_model->getCollisionBvh().slideSphere(
+        glm::vec3{from}, glm::vec3{to}, radius)};
+    const glm::vec3 worldEye{modelToWorld * glm::vec4{eye, 1.0f}};
+
+    camera.m_at += worldEye - camera.m_eye;
+    camera.m_eye = worldEye;
+    camera.computeViewMatrix();
+  }
+
+  camera.pan(input.panSpeed * timestep);
+}
+
+void OpenGLWindow::enableInputRecording(std::string path) {
+  m_inputRecordingPath = std::move(path);
+  startInputRecording();
+}
+
+void OpenGLWindow::enableInputReplay(std::string path) {
+  m_inputRecordingPath = std::move(path);
+  m_replayOnLoad = true;
+}
+
+void OpenGLWindow::startInputRecording() {
+  m_inputRecorder.start({m_camera.m_eye, m_camera.m_at, m_camera.m_up},
+                        m_cameraTimestep);
+  m_inputMode = InputMode::Recording;
+  fmt::print("Recording camera input to {}\n", m_inputRecordingPath);
+}
+
+void OpenGLWindow::stopInputRecording() {
+  m_inputMode = InputMode::Live;
+  if (!saveInputRecording(m_inputRecorder.getRecording(),
+                          m_inputRecordingPath)) {
+    fmt::print(stderr, "Failed to write {}\n", m_inputRecordingPath);
+    return;
+  }
+  fmt::print("Saved {} frames to {}\n",
+             m_inputRecorder.getRecording().stepsPerFrame.size(),
+             m_inputRecordingPath);
+}
+
+void OpenGLWindow::startInputReplay() {
+  if (m_inputMode == InputMode::Recording) stopInputRecording();
+  if (!loadInputRecording(m_replayRecording, m_inputRecordingPath)) {
+    fmt::print(stderr, "Failed to read {}\n", m_inputRecordingPath);
+    return;
+  }
+
+  const auto& start{m_replayRecording.start};
+  m_camera.m_eye = start.eye;
+  m_camera.m_at = start.at;
+  m_camera.m_up = start.up;
+  m_camera.computeViewMatrix();
+  m_dollySpeed = m_truckSpeed = m_panSpeed = 0.0f;
+
+  m_inputReplay.start(m_replayRecording);
+  m_inputMode = InputMode::Replaying;
+}
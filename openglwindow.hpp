@@ -1,11 +1,40 @@
 #ifndef OPENGLWINDOW_HPP_
 #define OPENGLWINDOW_HPP_
 
+#include <future>
+#include <memory>
+#include <optional>
+
 #include "abcg.hpp"
+#include "benchmark.hpp"
+#include "inputrecording.hpp"
 #include "model.hpp"
 #include "camera.hpp"
+#include "depthpyramid.hpp"
+#include "exhibits.hpp"
+#include "loadprogress.hpp"
+#include "profiler.hpp"
+#include "renderstate.hpp"
+#include "threadpool.hpp"
 
 class OpenGLWindow : public abcg::OpenGLWindow {
+ public:
+  // Once the model is fully resident, renders a few warm-up frames and then
+  // one frame per keyframe without UI, writes the frame times to
+  // outputPath + ".csv"/".json" and quits
+  void enableBenchmark(std::vector<CameraKeyframe> cameraPath,
+                       std::string outputPath);
+  // Same, with the camera state of each frame of a recording
+  void enableBenchmark(const InputRecording& recording,
+                       std::string outputPath);
+
+  // Records the camera inputs of the session to path, saved on exit. F5
+  // starts and stops recording to that path at any time.
+  void enableInputRecording(std::string path);
+  // Replays a recording once the model is fully resident. F6 replays the
+  // recording path at any time.
+  void enableInputReplay(std::string path);
+
  protected:
   void handleEvent(SDL_Event& ev) override;
   void initializeGL() override;
@@ -18,15 +47,39 @@ class OpenGLWindow : public abcg::OpenGLWindow {
   int m_viewportWidth{};
   int m_viewportHeight{};
 
-  Model m_model;
-  int m_trianglesToDraw{};
+  // Shared by every model load; declared first so it outlives the models
+  ThreadPool m_threadPool;
+  // Null until the first load finishes. A new model is processed on a
+  // background thread while the current one keeps rendering.
+  std::unique_ptr<Model> m_model;
+  std::unique_ptr<Model> m_loadingModel;
+  std::unique_ptr<LoadProgress> m_loadProgress;
+  std::future<void> m_loadFuture;
+  // Requested while another load was running, with the format current
+  // when it starts
+  std::optional<std::string> m_queuedModelPath;
+  int m_trianglesToDraw{};  // Resident so far while the mesh streams in
+  std::size_t m_streamBytesPerFrame{4 * 1024 * 1024};
+  float m_lodMaxPixelError{1.0f};
+  // Clusters are also culled against the depth of a frame or two ago,
+  // captured by redrawing the visible ones at low resolution; F9 toggles it
+  DepthPyramid m_depthPyramid;
+  bool m_occlusionCulling{true};
+  // Clusters missing from the baked set of the eye's cell are skipped too;
+  // F10 toggles it
+  bool m_pvsCulling{true};
+  VertexFormat m_vertexFormat{VertexFormat::Float};
 
   glm::mat4 m_modelMatrix{1.0f};
   glm::mat4 m_viewMatrix{1.0f};
   glm::mat4 m_projMatrix{1.0f};
 
-  // Shaders
-  GLuint m_program{};
+  // Shaders: one program per mapping mode and vertex format
+  ShaderVariantCache m_shaderVariants{
+      [this](std::string_view vertexShader, std::string_view fragmentShader) {
+        return createProgramFromString(vertexShader, fragmentShader);
+      }};
+  UniformRing m_uniformRing;
 
   //camera
   Camera m_camera;
@@ -34,31 +87,62 @@ class OpenGLWindow : public abcg::OpenGLWindow {
   float m_truckSpeed{0.0f};
   float m_panSpeed{0.0f};
    bool firstExec{true};
-  bool exp1{true};
-  bool exp2{true};
-  bool exp3{true};
-  bool exp4{true};
-  bool exp5{true};
-  bool exp6{true};
-  bool exp7{true};
-  bool exp9{true};
-  bool exp10{true};
-  bool exp11{true};
-  bool exp12{true};
-  bool exp13{true};
+  // The eye is a sphere of this radius in world space; F8 toggles it
+  bool m_cameraCollision{true};
+  float m_cameraRadius{0.01f};
+
+  // Exhibits, with the ones around the camera queried once per frame. A
+  // description closed by the user stays closed.
+  std::vector<Exhibit> m_exhibits;
+  ExhibitGrid m_exhibitGrid;
+  std::vector<bool> m_exhibitDismissed;
+  std::vector<std::size_t> m_activeExhibits;
+  // Opened by clicking the scan inside its region, wherever the camera is
+  std::optional<std::size_t> m_pickedExhibit;
+
   // Mapping mode
   // 0: triplanar; 1: cylindrical; 2: spherical; 3: from mesh
   int m_mappingMode{};
 
-  // Light and material properties
+  // The camera moves in fixed steps so that a recording replays exactly
+  enum class InputMode { Live, Recording, Replaying };
+  InputMode m_inputMode{InputMode::Live};
+  float m_cameraTimestep{1.0f / 120.0f};
+  double m_stepAccumulator{};
+  std::string m_inputRecordingPath{"tour.rec"};
+  bool m_replayOnLoad{false};
+  InputRecorder m_inputRecorder;
+  InputRecording m_replayRecording;
+  InputReplay m_inputReplay;
+
+  // Frame profiler, shown with F7. The UI query spans from the end of
+  // paintUI to the next paintGL, as ImGui is drawn after paintUI returns,
+  // so it includes the buffer swap.
+  FrameProfiler m_profiler;
+  FrameProfiler::Scope m_updateScope{m_profiler.addCpuScope("update")};
+  FrameProfiler::Scope m_paintGLScope{m_profiler.addCpuScope("paintGL")};
+  FrameProfiler::Scope m_paintUIScope{m_profiler.addCpuScope("paintUI")};
+  FrameProfiler::Scope m_modelGpuScope{m_profiler.addGpuScope("model")};
+  FrameProfiler::Scope m_occluderGpuScope{
+      m_profiler.addGpuScope("occluders")};
+  FrameProfiler::Scope m_uiGpuScope{
+      m_profiler.addGpuScope("UI + present")};
+  bool m_showProfiler{true};
+
+  // Benchmark mode
+  bool m_benchmarkMode{false};
+  std::vector<CameraKeyframe> m_benchmarkPath;
+  InputRecording m_benchmarkRecording;  // Stepped once the model is loaded
+  std::string m_benchmarkOutput;
+  std::size_t m_benchmarkWarmupFrames{10};
+  std::size_t m_benchmarkFrame{};
+  BenchmarkRecorder m_benchmarkRecorder;
+
+  // Light properties; materials come from the model
   glm::vec4 m_lightDir{-1.0f, -1.0f, -1.0f, 0.0f};
   glm::vec4 m_Ia{1.0f};
   glm::vec4 m_Id{1.0f};
   glm::vec4 m_Is{1.0f};
-  glm::vec4 m_Ka;
-  glm::vec4 m_Kd;
-  glm::vec4 m_Ks;
-  float m_shininess{};
 
   // Skybox
   const std::string m_skyShaderName{"skybox"};
@@ -93,7 +177,24 @@ class OpenGLWindow : public abcg::OpenGLWindow {
   void renderSkybox();
   void terminateSkybox();
   void loadModel(std::string_view path);
+  const ShaderVariant& getShaderVariant(VertexFormat format);
+  void finishLoading();
+  bool beginBenchmarkFrame();
+  void endBenchmarkFrame(double cpuMilliseconds);
+  void paintLoadingUI();
+  void paintProfilerUI();
+  void paintExhibitsUI();
+  // Casts the ray under the cursor into the model and opens the exhibit
+  // whose region contains the hit
+  void pickExhibit(int x, int y);
   void update();
+  void startInputRecording();
+  void stopInputRecording();
+  void startInputReplay();
+  // Moves the camera by one fixed step, sliding it along the model's
+  // surfaces when collisions are on
+  void stepCamera(Camera& camera, const CameraInput& input,
+                  float timestep) const;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,259 @@
+#include "potentiallyvisible.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cppitertools/itertools.hpp>
+#include <glm/geometric.hpp>
+#include <map>
+#include <numbers>
+
+#include "threadpool.hpp"
+
+namespace {
+
+// Uniform numbers in [0, 1) from a hashed counter, so that a bake gives
+// the same sets on every run and thread count
+class SampleSequence {
+ public:
+  explicit SampleSequence(std::uint32_t seed) : m_state{seed * 0x9e3779b9U} {}
+
+  float next() {
+    auto value{m_state++};
+    value ^= value >> 16;
+    value *= 0x7feb352dU;
+    value ^= value >> 15;
+    value *= 0x846ca68bU;
+    value ^= value >> 16;
+    return static_cast<float>(value >> 8) * (1.0f / 16777216.0f);
+  }
+
+ private:
+  std::uint32_t m_state;
+};
+
+}  // namespace
+
+void PotentiallyVisibleSets::bake(std::span<const Vertex> vertices,
+                                  std::span<const std::uint32_t> indices,
+                                  std::span<const MeshCluster> clusters,
+                                  const MeshBvh& bvh, const Bounds& region,
+                                  ThreadPool& pool, std::size_t cellsPerAxis,
+                                  std::size_t numRays,
+                                  std::size_t numTargetRays) {
+  clear();
+  const auto extent{region.max - region.min};
+  const auto longest{std::max({extent.x, extent.y, extent.z})};
+  if (clusters.empty() || bvh.empty() || cellsPerAxis == 0 ||
+      !(longest > 0.0f)) {
+    return;
+  }
+
+  m_grid.boundsMin = region.min;
+  m_grid.cellSize = longest / static_cast<float>(cellsPerAxis);
+  const auto cellsAlong{[&](float length) {
+    return static_cast<std::uint32_t>(
+        std::clamp(std::ceil(length / m_grid.cellSize), 1.0f,
+                   static_cast<float>(cellsPerAxis)));
+  }};
+  m_grid.cellsX = cellsAlong(extent.x);
+  m_grid.cellsY = cellsAlong(extent.y);
+  m_grid.cellsZ = cellsAlong(extent.z);
+  m_grid.wordsPerSet = static_cast<std::uint32_t>((clusters.size() + 63) / 64);
+
+  // Cluster of each full-detail triangle, for the triangles rays hit
+  std::vector<std::uint32_t> triangleClusters(indices.size() / 3);
+  for (const auto cluster : iter::range(clusters.size())) {
+    const auto first{clusters[cluster].firstIndex / 3};
+    std::fill_n(triangleClusters.begin() + first,
+                clusters[cluster].indexCount / 3,
+                static_cast<std::uint32_t>(cluster));
+  }
+
+  const auto numCells{std::size_t{m_grid.cellsX} * m_grid.cellsY *
+                      m_grid.cellsZ};
+  const std::size_t words{m_grid.wordsPerSet};
+  // Rays cross the whole mesh, not just the region
+  const auto& root{bvh.getNodes().front()};
+  const auto maxDistance{glm::distance(root.boundsMin, root.boundsMax)};
+  const auto twoPi{2.0f * std::numbers::pi_v<float>};
+  std::vector<std::uint64_t> cellBits(numCells * words);
+  pool.parallelForStealing(numCells, 1, [&](std::size_t begin,
+                                            std::size_t end) {
+    for (const auto cell : iter::range(begin, end)) {
+      auto* set{&cellBits[cell * words]};
+      const auto mark{[&](std::size_t cluster) {
+        set[cluster / 64] |= std::uint64_t{1} << (cluster % 64);
+      }};
+      const auto isMarked{[&](std::size_t cluster) {
+        return (set[cluster / 64] >> (cluster % 64) & 1U) != 0;
+      }};
+
+      const glm::vec3 coordinates{
+          static_cast<float>(cell % m_grid.cellsX),
+          static_cast<float>(cell / m_grid.cellsX % m_grid.cellsY),
+          static_cast<float>(cell / m_grid.cellsX / m_grid.cellsY)};
+      const auto cellMin{m_grid.boundsMin + coordinates * m_grid.cellSize};
+      const auto cellMax{cellMin + glm::vec3{m_grid.cellSize}};
+      SampleSequence samples{static_cast<std::uint32_t>(cell)};
+      const auto samplePoint{[&] {
+        const glm::vec3 offset{samples.next(), samples.next(),
+                               samples.next()};
+        return cellMin + offset * m_grid.cellSize;
+      }};
+
+      // Clusters reaching into the cell are seen from inside it
+      for (const auto cluster : iter::range(clusters.size())) {
+        const auto& low{clusters[cluster].boundsMin};
+        const auto& high{clusters[cluster].boundsMax};
+        if (low.x <= cellMax.x && cellMin.x <= high.x && low.y <= cellMax.y &&
+            cellMin.y <= high.y && low.z <= cellMax.z && cellMin.z <= high.z) {
+          mark(cluster);
+        }
+      }
+
+      // Rays in all directions find most of the surroundings
+      RayHit hit;
+      for ([[maybe_unused]] const auto ray : iter::range(numRays)) {
+        const auto z{1.0f - 2.0f * samples.next()};
+        const auto radius{std::sqrt(std::max(1.0f - z * z, 0.0f))};
+        const auto angle{twoPi * samples.next()};
+        const glm::vec3 direction{radius * std::cos(angle),
+                                  radius * std::sin(angle), z};
+        if (bvh.raycast(samplePoint(), direction, maxDistance, hit)) {
+          mark(triangleClusters[hit.triangle]);
+        }
+      }
+
+      // Rays aimed at points of each cluster still unseen find small ones
+      // and those seen through gaps
+      for (const auto cluster : iter::range(clusters.size())) {
+        const auto firstTriangle{clusters[cluster].firstIndex / 3};
+        const auto numTriangles{clusters[cluster].indexCount / 3};
+        for ([[maybe_unused]] const auto ray : iter::range(numTargetRays)) {
+          if (isMarked(cluster) || numTriangles == 0) break;
+
+          const auto triangle{
+              firstTriangle +
+              std::min(static_cast<std::uint32_t>(
+                           samples.next() * static_cast<float>(numTriangles)),
+                       numTriangles - 1)};
+          const auto& a{vertices[indices[3 * triangle + 0]].position};
+          const auto& b{vertices[indices[3 * triangle + 1]].position};
+          const auto& c{vertices[indices[3 * triangle + 2]].position};
+          const auto s{std::sqrt(samples.next())};
+          const auto t{samples.next()};
+          const auto target{a * (1.0f - s) + b * (s * (1.0f - t)) +
+                            c * (s * t)};
+
+          // Nothing in the way, not even the target, happens when grazing
+          // an edge or aiming at a degenerate triangle
+          const auto origin{samplePoint()};
+          if (!bvh.raycast(origin, target - origin, 1.0f, hit)) {
+            mark(cluster);
+          } else {
+            mark(triangleClusters[hit.triangle]);
+          }
+        }
+      }
+    }
+  });
+
+  // Each cell also sees what its neighbors (sharing a face, edge or
+  // corner) saw, which covers most of what sampling missed near a boundary
+  std::vector<std::uint64_t> dilatedBits(cellBits.size());
+  const auto cellsX{static_cast<std::ptrdiff_t>(m_grid.cellsX)};
+  const auto cellsY{static_cast<std::ptrdiff_t>(m_grid.cellsY)};
+  const auto cellsZ{static_cast<std::ptrdiff_t>(m_grid.cellsZ)};
+  pool.parallelFor(numCells, [&](std::size_t cell) {
+    const auto x{static_cast<std::ptrdiff_t>(cell % m_grid.cellsX)};
+    const auto y{static_cast<std::ptrdiff_t>(cell / m_grid.cellsX %
+                                             m_grid.cellsY)};
+    const auto z{static_cast<std::ptrdiff_t>(cell / m_grid.cellsX /
+                                             m_grid.cellsY)};
+    auto* set{&dilatedBits[cell * words]};
+    for (auto nz{std::max(z - 1, std::ptrdiff_t{})};
+         nz <= std::min(z + 1, cellsZ - 1); ++nz) {
+      for (auto ny{std::max(y - 1, std::ptrdiff_t{})};
+           ny <= std::min(y + 1, cellsY - 1); ++ny) {
+        for (auto nx{std::max(x - 1, std::ptrdiff_t{})};
+             nx <= std::min(x + 1, cellsX - 1); ++nx) {
+          const auto neighbor{
+              static_cast<std::size_t>(nx + cellsX * (ny + cellsY * nz))};
+          for (const auto word : iter::range(words)) {
+            set[word] |= cellBits[neighbor * words + word];
+          }
+        }
+      }
+    }
+  });
+  cellBits = std::move(dilatedBits);
+
+  // Cells with the same set share one copy
+  std::map<std::vector<std::uint64_t>, std::uint32_t> setIndices;
+  m_cellSets.resize(numCells);
+  for (const auto cell : iter::range(numCells)) {
+    const auto first{cellBits.begin() +
+                     static_cast<std::ptrdiff_t>(cell * words)};
+    std::vector<std::uint64_t> set(first,
+                                   first + static_cast<std::ptrdiff_t>(words));
+    const auto [entry, inserted]{setIndices.try_emplace(
+        std::move(set), static_cast<std::uint32_t>(setIndices.size()))};
+    if (inserted) {
+      m_sets.insert(m_sets.end(), entry->first.begin(), entry->first.end());
+    }
+    m_cellSets[cell] = entry->second;
+  }
+}
+
+bool PotentiallyVisibleSets::assign(const PvsGrid& grid,
+                                    std::span<const std::uint32_t> cellSets,
+                                    std::span<const std::uint64_t> sets,
+                                    std::size_t numClusters) {
+  clear();
+  const std::size_t words{grid.wordsPerSet};
+  if (!(grid.cellSize > 0.0f) || words != (numClusters + 63) / 64 ||
+      words == 0 || sets.size() % words != 0 ||
+      cellSets.size() !=
+          std::size_t{grid.cellsX} * grid.cellsY * grid.cellsZ ||
+      cellSets.empty()) {
+    return false;
+  }
+  const auto numSets{sets.size() / words};
+  if (std::ranges::any_of(cellSets,
+                          [&](auto set) { return set >= numSets; })) {
+    return false;
+  }
+
+  m_grid = grid;
+  m_cellSets.assign(cellSets.begin(), cellSets.end());
+  m_sets.assign(sets.begin(), sets.end());
+  return true;
+}
+
+void PotentiallyVisibleSets::clear() {
+  m_grid = {};
+  m_cellSets.clear();
+  m_sets.clear();
+}
+
+std::span<const std::uint64_t> PotentiallyVisibleSets::find(
+    const glm::vec3& point) const {
+  if (m_cellSets.empty()) return {};
+
+  const auto cell{(point - m_grid.boundsMin) / m_grid.cellSize};
+  // Written so that NaN falls outside too
+  if (!(cell.x >= 0.0f && cell.y >= 0.0f && cell.z >= 0.0f &&
+        cell.x < static_cast<float>(m_grid.cellsX) &&
+        cell.y < static_cast<float>(m_grid.cellsY) &&
+        cell.z < static_cast<float>(m_grid.cellsZ))) {
+    return {};
+  }
+
+  const auto x{static_cast<std::size_t>(cell.x)};
+  const auto y{static_cast<std::size_t>(cell.y)};
+  const auto z{static_cast<std::size_t>(cell.z)};
+  const auto set{
+      m_cellSets[x + m_grid.cellsX * (y + std::size_t{m_grid.cellsY} * z)]};
+  const std::size_t words{m_grid.wordsPerSet};
+  return std::span{m_sets}.subspan(set * words, words);
+}
@@ -0,0 +1,73 @@
+#ifndef POTENTIALLYVISIBLE_HPP_
+#define POTENTIALLYVISIBLE_HPP_
+
+#include <cstdint>
+#include <glm/vec3.hpp>
+#include <span>
+#include <vector>
+
+#include "meshbvh.hpp"
+#include "meshcluster.hpp"
+#include "meshgeometry.hpp"
+
+class ThreadPool;
+
+// Uniform grid of cubic cells over a box, as stored in the cache
+struct PvsGrid {
+  glm::vec3 boundsMin{};
+  float cellSize{};
+  std::uint32_t cellsX{};
+  std::uint32_t cellsY{};
+  std::uint32_t cellsZ{};
+  std::uint32_t wordsPerSet{};  // 64-bit words of one set
+};
+
+// Clusters that may be seen from somewhere in each cell of a grid, one bit
+// per cluster. Cells with the same set share it.
+class PotentiallyVisibleSets {
+ public:
+  // Splits region, the part of the mesh the eye can be in, into cells,
+  // cellsPerAxis along its longest axis, and marks the clusters that rays
+  // from random points of each cell reach: numRays in all directions, then
+  // up to numTargetRays aimed at each cluster not found yet. Sampling alone
+  // can miss a sliver seen through a gap, so each cell then takes in the
+  // sets of its neighbors, which sampled it from other points. Cells vary
+  // a lot in cost, so they are spread over the pool with work stealing.
+  void bake(std::span<const Vertex> vertices,
+            std::span<const std::uint32_t> indices,
+            std::span<const MeshCluster> clusters, const MeshBvh& bvh,
+            const Bounds& region, ThreadPool& pool,
+            std::size_t cellsPerAxis = 16, std::size_t numRays = 1024,
+            std::size_t numTargetRays = 16);
+  // Restores sets baked for numClusters clusters. Returns false if they
+  // don't fit the grid.
+  bool assign(const PvsGrid& grid, std::span<const std::uint32_t> cellSets,
+              std::span<const std::uint64_t> sets, std::size_t numClusters);
+  void clear();
+
+  // Set of the cell containing point. Empty outside the grid or before a
+  // bake, where every cluster counts as visible.
+  [[nodiscard]] std::span<const std::uint64_t> find(
+      const glm::vec3& point) const;
+  [[nodiscard]] static bool contains(std::span<const std::uint64_t> set,
+                                     std::size_t cluster) {
+    return set.empty() || (set[cluster / 64] >> (cluster % 64) & 1U) != 0;
+  }
+
+  [[nodiscard]] bool empty() const { return m_cellSets.empty(); }
+  [[nodiscard]] const PvsGrid& getGrid() const { return m_grid; }
+  // Index of the set of each cell, x fastest
+  [[nodiscard]] std::span<const std::uint32_t> getCellSets() const {
+    return m_cellSets;
+  }
+  [[nodiscard]] std::span<const std::uint64_t> getSets() const {
+    return m_sets;
+  }
+
+ private:
+  PvsGrid m_grid;
+  std::vector<std::uint32_t> m_cellSets;
+  std::vector<std::uint64_t> m_sets;  // wordsPerSet words per set
+};
+
+#endif
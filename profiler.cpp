@@ -0,0 +1,98 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cppitertools/itertools.hpp>
+#include <numeric>
+
+float FrameProfiler::Series::getAverage() const {
+  // Slots not written yet are zero
+  if (count == 0) return 0.0f;
+  return std::accumulate(samples.begin(), samples.end(), 0.0f) /
+         static_cast<float>(count);
+}
+
+FrameProfiler::Scope FrameProfiler::addCpuScope(std::string name) {
+  m_cpuSeries.push_back({std::move(name)});
+  m_cpuStarts.emplace_back();
+  return m_cpuSeries.size() - 1;
+}
+
+FrameProfiler::Scope FrameProfiler::addGpuScope(std::string name) {
+  m_gpuSeries.push_back({std::move(name)});
+  for (auto& queries : m_gpuQueries) queries.emplace_back();
+  return m_gpuSeries.size() - 1;
+}
+
+void FrameProfiler::beginFrame() {
+  m_frame = (m_frame + 1) % queryLatency;
+
+#if !defined(__EMSCRIPTEN__)
+  // Results of queryLatency frames ago; a result that still isn't ready is
+  // dropped rather than waited for
+  for (const auto scope : iter::range(m_gpuSeries.size())) {
+    auto& query{m_gpuQueries[m_frame][scope]};
+    if (!query.issued) continue;
+    query.issued = false;
+
+    GLint available{};
+    abcg::glGetQueryObjectiv(query.query, GL_QUERY_RESULT_AVAILABLE,
+                             &available);
+    if (available == GL_FALSE) continue;
+
+    GLuint64 nanoseconds{};
+    abcg::glGetQueryObjectui64v(query.query, GL_QUERY_RESULT, &nanoseconds);
+    push(m_gpuSeries[scope], static_cast<float>(nanoseconds) / 1.0e6f);
+  }
+#endif
+}
+
+void FrameProfiler::beginCpu(Scope scope) {
+  m_cpuStarts[scope] = std::chrono::steady_clock::now();
+}
+
+void FrameProfiler::endCpu(Scope scope) {
+  const std::chrono::duration<float, std::milli> elapsed{
+      std::chrono::steady_clock::now() - m_cpuStarts[scope]};
+  push(m_cpuSeries[scope], elapsed.count());
+}
+
+void FrameProfiler::beginGpu([[maybe_unused]] Scope scope) {
+#if !defined(__EMSCRIPTEN__)
+  if (!m_gpuEnabled || m_gpuActive) return;
+
+  auto& query{m_gpuQueries[m_frame][scope]};
+  if (query.query == 0) abcg::glGenQueries(1, &query.query);
+  abcg::glBeginQuery(GL_TIME_ELAPSED, query.query);
+  query.issued = true;
+  m_activeGpuScope = scope;
+  m_gpuActive = true;
+#endif
+}
+
+void FrameProfiler::endGpu([[maybe_unused]] Scope scope) {
+#if !defined(__EMSCRIPTEN__)
+  if (!m_gpuActive || m_activeGpuScope != scope) return;
+
+  abcg::glEndQuery(GL_TIME_ELAPSED);
+  m_gpuActive = false;
+#endif
+}
+
+void FrameProfiler::terminateGL() {
+#if !defined(__EMSCRIPTEN__)
+  if (m_gpuActive) abcg::glEndQuery(GL_TIME_ELAPSED);
+  m_gpuActive = false;
+  for (auto& queries : m_gpuQueries) {
+    for (auto& query : queries) {
+      abcg::glDeleteQueries(1, &query.query);
+      query = {};
+    }
+  }
+#endif
+}
+
+void FrameProfiler::push(Series& series, float sample) {
+  series.samples[series.next] = sample;
+  series.next = (series.next + 1) % historySize;
+  series.count = std::min(series.count + 1, historySize);
+}
@@ -0,0 +1,75 @@
+#ifndef PROFILER_HPP_
+#define PROFILER_HPP_
+
+#include <array>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "abcg.hpp"
+
+// Rolling CPU and GPU times of named scopes, in milliseconds. GPU scopes
+// use GL_TIME_ELAPSED queries kept for a few frames and read only once
+// their results are available, so the profiler never stalls the pipeline.
+// GPU scopes can't nest or overlap; CPU scopes can. WebGL has no timer
+// queries, so GPU scopes record nothing there.
+class FrameProfiler {
+ public:
+  static constexpr std::size_t historySize{120};
+
+  struct Series {
+    std::string name;
+    std::array<float, historySize> samples{};
+    std::size_t next{};  // Oldest sample, for ImGui::PlotLines offsets
+    std::size_t count{};  // Samples recorded so far, up to historySize
+
+    [[nodiscard]] float getAverage() const;
+  };
+
+  using Scope = std::size_t;
+  Scope addCpuScope(std::string name);
+  Scope addGpuScope(std::string name);
+
+  // Collects the GPU results of the frame whose queries are reused next
+  void beginFrame();
+
+  void beginCpu(Scope scope);
+  void endCpu(Scope scope);
+  void beginGpu(Scope scope);
+  // Does nothing if the scope wasn't begun
+  void endGpu(Scope scope);
+
+  // Disables GPU scopes, e.g. while another timer query is in use
+  void setGpuEnabled(bool enabled) { m_gpuEnabled = enabled; }
+
+  [[nodiscard]] const std::vector<Series>& getCpuSeries() const {
+    return m_cpuSeries;
+  }
+  [[nodiscard]] const std::vector<Series>& getGpuSeries() const {
+    return m_gpuSeries;
+  }
+
+  void terminateGL();
+
+ private:
+  // Frames a query may stay in flight before its slot is reused
+  static constexpr std::size_t queryLatency{3};
+
+  struct GpuQuery {
+    GLuint query{};
+    bool issued{};
+  };
+
+  std::vector<Series> m_cpuSeries;
+  std::vector<std::chrono::steady_clock::time_point> m_cpuStarts;
+  std::vector<Series> m_gpuSeries;
+  std::array<std::vector<GpuQuery>, queryLatency> m_gpuQueries;
+  std::size_t m_frame{};
+  std::size_t m_activeGpuScope{};
+  bool m_gpuActive{false};
+  bool m_gpuEnabled{true};
+
+  static void push(Series& series, float sample);
+};
+
+#endif
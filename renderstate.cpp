@@ -0,0 +1,233 @@
+#include "renderstate.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cppitertools/itertools.hpp>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+constexpr std::array<std::pair<std::string_view, GLuint>, 3> blockBindings{{
+    {"FrameData", frameBlockBinding},
+    {"ObjectData", objectBlockBinding},
+    {"MaterialData", materialBlockBinding},
+}};
+
+constexpr std::array<std::pair<std::string_view, GLuint>, 1> samplerUnits{{
+    {"diffuseTex", diffuseTextureUnit},
+}};
+
+}  // namespace
+
+ProgramReflection::ProgramReflection(GLuint program) {
+  GLint maxLength{};
+  abcg::glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+  GLint blockMaxLength{};
+  abcg::glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH,
+                       &blockMaxLength);
+  std::string name(
+      static_cast<std::size_t>(std::max(maxLength, blockMaxLength)), '\0');
+
+  GLint numUniforms{};
+  abcg::glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &numUniforms);
+  for (const auto index : iter::range(numUniforms)) {
+    GLsizei length{};
+    GLint size{};
+    GLenum type{};
+    abcg::glGetActiveUniform(program, static_cast<GLuint>(index),
+                             static_cast<GLsizei>(name.size()), &length, &size,
+                             &type, name.data());
+    std::string uniformName{name.data(), static_cast<std::size_t>(length)};
+
+    // Members of blocks have no location
+    const auto location{
+        abcg::glGetUniformLocation(program, uniformName.c_str())};
+    if (location < 0) continue;
+
+    // Arrays are reported by their first element
+    if (uniformName.ends_with("[0]")) {
+      uniformName.resize(uniformName.size() - 3);
+    }
+    m_uniforms.emplace_back(std::move(uniformName), location);
+  }
+
+  abcg::glUseProgram(program);
+  for (const auto& [samplerName, unit] : samplerUnits) {
+    const auto location{uniformLocation(samplerName)};
+    if (location >= 0) abcg::glUniform1i(location, static_cast<GLint>(unit));
+  }
+  abcg::glUseProgram(0);
+
+  GLint numBlocks{};
+  abcg::glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &numBlocks);
+  for (const auto index : iter::range(numBlocks)) {
+    GLsizei length{};
+    abcg::glGetActiveUniformBlockName(program, static_cast<GLuint>(index),
+                                      static_cast<GLsizei>(name.size()),
+                                      &length, name.data());
+    const std::string_view blockName{name.data(),
+                                     static_cast<std::size_t>(length)};
+    const auto* binding{std::ranges::find(
+        blockBindings, blockName,
+        &std::pair<std::string_view, GLuint>::first)};
+    if (binding == blockBindings.end()) {
+      throw abcg::Exception{abcg::Exception::Runtime(
+          fmt::format("Unknown uniform block {}", blockName))};
+    }
+    abcg::glUniformBlockBinding(program, static_cast<GLuint>(index),
+                                binding->second);
+  }
+}
+
+GLint ProgramReflection::uniformLocation(std::string_view name) const {
+  const auto uniform{std::ranges::find(
+      m_uniforms, name, &std::pair<std::string, GLint>::first)};
+  return uniform == m_uniforms.end() ? -1 : uniform->second;
+}
+
+void UniformRing::create(std::size_t segmentSize, std::size_t numSegments) {
+  destroy();
+
+  m_segmentSize = alignUniformOffset(segmentSize);
+  m_alignment = alignUniformOffset(1);
+  m_fences.assign(numSegments, nullptr);
+  m_segment = 0;
+  m_offset = 0;
+
+  abcg::glGenBuffers(1, &m_buffer);
+  abcg::glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+  abcg::glBufferData(GL_UNIFORM_BUFFER,
+                     static_cast<GLsizeiptr>(m_segmentSize * numSegments),
+                     nullptr, GL_DYNAMIC_DRAW);
+  abcg::glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformRing::destroy() {
+  for (auto& fence : m_fences) {
+    if (fence != nullptr) abcg::glDeleteSync(fence);
+    fence = nullptr;
+  }
+  abcg::glDeleteBuffers(1, &m_buffer);
+  m_buffer = 0;
+}
+
+void UniformRing::beginFrame() {
+  m_segment = (m_segment + 1) % m_fences.size();
+  m_offset = 0;
+
+#if !defined(__EMSCRIPTEN__)
+  // Wait until the GPU is done with the frame that last used this segment
+  auto& fence{m_fences[m_segment]};
+  if (fence != nullptr) {
+    while (abcg::glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                  1'000'000) == GL_TIMEOUT_EXPIRED) {
+    }
+    abcg::glDeleteSync(fence);
+    fence = nullptr;
+  }
+#endif
+}
+
+void UniformRing::endFrame() {
+#if !defined(__EMSCRIPTEN__)
+  m_fences[m_segment] = abcg::glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+}
+
+void UniformRing::bind(GLuint binding, const void* data, std::size_t size) {
+  if (m_offset + size > m_segmentSize) {
+    throw abcg::Exception{
+        abcg::Exception::Runtime("Uniform ring segment is full")};
+  }
+
+  const auto offset{static_cast<GLintptr>(m_segment * m_segmentSize +
+                                          m_offset)};
+  abcg::glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+#if defined(__EMSCRIPTEN__)
+  // WebGL 2 has no buffer mapping
+  abcg::glBufferSubData(GL_UNIFORM_BUFFER, offset,
+                        static_cast<GLsizeiptr>(size), data);
+#else
+  auto* mapped{abcg::glMapBufferRange(
+      GL_UNIFORM_BUFFER, offset, static_cast<GLsizeiptr>(size),
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+          GL_MAP_UNSYNCHRONIZED_BIT)};
+  std::memcpy(mapped, data, size);
+  abcg::glUnmapBuffer(GL_UNIFORM_BUFFER);
+#endif
+  abcg::glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  abcg::glBindBufferRange(GL_UNIFORM_BUFFER, binding, m_buffer, offset,
+                          static_cast<GLsizeiptr>(size));
+  m_offset += (size + m_alignment - 1) / m_alignment * m_alignment;
+}
+
+std::size_t alignUniformOffset(std::size_t size) {
+  GLint alignment{};
+  abcg::glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  const auto step{static_cast<std::size_t>(std::max(alignment, 1))};
+  return (size + step - 1) / step * step;
+}
+
+ShaderVariantCache::ShaderVariantCache(Compiler compiler)
+    : m_compiler{std::move(compiler)} {}
+
+const ShaderVariant& ShaderVariantCache::get(const ShaderVariantKey& key) {
+  if (const auto variant{m_variants.find(key)}; variant != m_variants.end()) {
+    return variant->second;
+  }
+
+  const auto vertexSource{
+      injectDefines(loadSource(key.vertexPath), key.defines)};
+  const auto fragmentSource{
+      injectDefines(loadSource(key.fragmentPath), key.defines)};
+  const auto program{m_compiler(vertexSource, fragmentSource)};
+
+  ShaderVariant variant{program, ProgramReflection{program}};
+  return m_variants.emplace(key, std::move(variant)).first->second;
+}
+
+void ShaderVariantCache::clear() {
+  for (const auto& [key, variant] : m_variants) {
+    abcg::glDeleteProgram(variant.program);
+  }
+  m_variants.clear();
+  m_sources.clear();
+}
+
+const std::string& ShaderVariantCache::loadSource(const std::string& path) {
+  if (const auto source{m_sources.find(path)}; source != m_sources.end()) {
+    return source->second;
+  }
+
+  std::ifstream stream{path};
+  if (!stream) {
+    throw abcg::Exception{
+        abcg::Exception::Runtime(fmt::format("Failed to read {}", path))};
+  }
+  std::stringstream contents;
+  contents << stream.rdbuf();
+  return m_sources.emplace(path, contents.str()).first->second;
+}
+
+std::string injectDefines(std::string_view source,
+                          std::span<const std::string> defines) {
+  // #version must stay the first line
+  std::size_t position{};
+  if (source.starts_with("#version")) {
+    const auto lineEnd{source.find('\n')};
+    position = lineEnd == std::string_view::npos ? source.size() : lineEnd + 1;
+  }
+
+  std::string result{source.substr(0, position)};
+  if (position == source.size() && !result.ends_with('\n')) result += '\n';
+  for (const auto& define : defines) {
+    result += fmt::format("#define {}\n", define);
+  }
+  result += source.substr(position);
+  return result;
+}
@@ -0,0 +1,145 @@
+#ifndef RENDERSTATE_HPP_
+#define RENDERSTATE_HPP_
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "abcg.hpp"
+
+// Binding points of the uniform blocks shared by every program
+constexpr GLuint frameBlockBinding{0};
+constexpr GLuint objectBlockBinding{1};
+constexpr GLuint materialBlockBinding{2};
+
+// Texture unit of the diffuseTex sampler
+constexpr GLuint diffuseTextureUnit{0};
+
+// std140 layouts of the FrameData and ObjectData blocks and of an entry of
+// the MaterialData array
+struct FrameUniforms {
+  glm::mat4 viewMatrix{1.0f};
+  glm::mat4 projMatrix{1.0f};
+  glm::vec4 lightDirWorldSpace{};
+  glm::vec4 Ia{};
+  glm::vec4 Id{};
+  glm::vec4 Is{};
+};
+
+struct ObjectUniforms {
+  glm::mat4 modelMatrix{1.0f};
+  glm::mat4 vertexMatrix{1.0f};  // VBO positions to object space
+  glm::mat4 normalMatrix{1.0f};  // Upper 3x3 is used
+};
+
+struct MaterialUniforms {
+  glm::vec4 Ka{};
+  glm::vec4 Kd{};
+  glm::vec4 Ks{};
+  float shininess{};
+  std::int32_t diffuseLayer{-1};
+  std::int32_t padding[2]{};
+};
+
+static_assert(sizeof(FrameUniforms) == 192);
+static_assert(sizeof(ObjectUniforms) == 192);
+static_assert(sizeof(MaterialUniforms) == 64);
+
+// Materials in one MaterialData block: 16 KB, the largest block GL always
+// supports. Vertices select theirs by index, so one draw covers them all.
+constexpr std::size_t materialsPerBlock{256};
+
+// Uniform locations of a linked program, looked up once. Its uniform blocks
+// and samplers are bound to the binding points and units above on
+// construction.
+class ProgramReflection {
+ public:
+  ProgramReflection() = default;
+  explicit ProgramReflection(GLuint program);
+
+  // -1 if the program has no such active uniform outside a block
+  [[nodiscard]] GLint uniformLocation(std::string_view name) const;
+
+ private:
+  std::vector<std::pair<std::string, GLint>> m_uniforms;
+};
+
+// Streams per-frame uniform data through one UBO split into a few
+// frame-sized segments, bound with glBindBufferRange. On desktop GL a
+// segment is written through an unsynchronized mapping, and only once the
+// fence of the frame that last used it has signaled.
+class UniformRing {
+ public:
+  void create(std::size_t segmentSize, std::size_t numSegments = 3);
+  void destroy();
+
+  void beginFrame();
+  void endFrame();
+
+  // Copies data to the current segment and binds it to the binding point
+  void bind(GLuint binding, const void* data, std::size_t size);
+  template <typename T>
+  void bind(GLuint binding, const T& data) {
+    bind(binding, &data, sizeof(T));
+  }
+
+ private:
+  GLuint m_buffer{};
+  std::size_t m_segmentSize{};
+  std::size_t m_alignment{1};
+  std::size_t m_segment{};
+  std::size_t m_offset{};
+  std::vector<GLsync> m_fences;
+};
+
+// Shader files and the #defines that select one permutation of them
+struct ShaderVariantKey {
+  std::string vertexPath;
+  std::string fragmentPath;
+  std::vector<std::string> defines;
+
+  auto operator<=>(const ShaderVariantKey&) const = default;
+};
+
+struct ShaderVariant {
+  GLuint program{};
+  ProgramReflection reflection;
+};
+
+// Compiles each permutation on first use, with its defines inserted after
+// the #version line of both stages, and keeps it until clear
+class ShaderVariantCache {
+ public:
+  // Builds a program from vertex and fragment shader sources
+  using Compiler = std::function<GLuint(std::string_view, std::string_view)>;
+
+  explicit ShaderVariantCache(Compiler compiler);
+
+  const ShaderVariant& get(const ShaderVariantKey& key);
+  void clear();
+
+ private:
+  Compiler m_compiler;
+  std::map<ShaderVariantKey, ShaderVariant> m_variants;
+  std::map<std::string, std::string, std::less<>> m_sources;
+
+  const std::string& loadSource(const std::string& path);
+};
+
+// Inserts a #define line per entry after the #version line, if any
+std::string injectDefines(std::string_view source,
+                          std::span<const std::string> defines);
+
+// Rounds size up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+std::size_t alignUniformOffset(std::size_t size);
+
+#endif
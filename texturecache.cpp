@@ -0,0 +1,619 @@
+#include "texturecache.hpp"
+
+#include <SDL_image.h>
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cppitertools/itertools.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <vector>
+
+#include "meshcache.hpp"
+
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_RGBA8_ETC2_EAC
+#define GL_COMPRESSED_RGBA8_ETC2_EAC 0x9278
+#endif
+
+namespace {
+
+constexpr std::array<unsigned char, 12> ktx2Identifier{
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+// Key-value entry identifying the image a cached file was built from
+constexpr std::string_view sourceKeyName{"LMTsourceKey"};
+constexpr std::string_view writerKeyName{"KTXwriter"};
+constexpr std::string_view writerName{"london-museum-tour"};
+
+struct Ktx2Header {
+  std::array<unsigned char, 12> identifier{};
+  std::uint32_t vkFormat{};
+  std::uint32_t typeSize{};
+  std::uint32_t pixelWidth{};
+  std::uint32_t pixelHeight{};
+  std::uint32_t pixelDepth{};
+  std::uint32_t layerCount{};
+  std::uint32_t faceCount{};
+  std::uint32_t levelCount{};
+  std::uint32_t supercompressionScheme{};
+  std::uint32_t dfdByteOffset{};
+  std::uint32_t dfdByteLength{};
+  std::uint32_t kvdByteOffset{};
+  std::uint32_t kvdByteLength{};
+  std::uint64_t sgdByteOffset{};
+  std::uint64_t sgdByteLength{};
+};
+static_assert(sizeof(Ktx2Header) == 80);
+
+struct Ktx2Level {
+  std::uint64_t byteOffset{};
+  std::uint64_t byteLength{};
+  std::uint64_t uncompressedByteLength{};
+};
+
+// Formats we can upload, with their Vulkan (KTX2) and GL names
+struct TextureFormat {
+  std::uint32_t vkFormat{};
+  GLenum internalFormat{};
+  std::uint32_t blockBytes{};  // Bytes per pixel, or per 4x4 block
+  bool compressed{};
+};
+
+constexpr TextureFormat rgba8Format{37, GL_RGBA8, 4, false};
+constexpr TextureFormat bc7Format{145, GL_COMPRESSED_RGBA_BPTC_UNORM, 16, true};
+constexpr TextureFormat etc2Format{151, GL_COMPRESSED_RGBA8_ETC2_EAC, 16, true};
+constexpr std::array textureFormats{rgba8Format, bc7Format, etc2Format};
+
+struct TextureImage {
+  TextureFormat format{};
+  std::uint32_t width{};
+  std::uint32_t height{};
+  std::vector<std::vector<std::byte>> levels;  // Largest first
+};
+
+// Largest width or height read from a file. Beyond any GL texture limit,
+// yet small enough for level sizes to fit in 64 bits.
+constexpr std::uint32_t maxTextureSize{1U << 16};
+
+// Bytes of a mip level, whole 4x4 blocks for compressed formats
+std::uint64_t levelByteLength(const TextureFormat& format, std::uint32_t width,
+                              std::uint32_t height, std::size_t level) {
+  std::uint64_t levelWidth{std::max(1U, width >> level)};
+  std::uint64_t levelHeight{std::max(1U, height >> level)};
+  if (format.compressed) {
+    levelWidth = (levelWidth + 3) / 4;
+    levelHeight = (levelHeight + 3) / 4;
+  }
+  return levelWidth * levelHeight * format.blockBytes;
+}
+
+std::optional<TextureFormat> findFormat(std::uint32_t vkFormat) {
+  for (const auto& format : textureFormats) {
+    if (format.vkFormat == vkFormat) return format;
+  }
+  return std::nullopt;
+}
+
+bool isFormatSupported(const TextureFormat& format) {
+  if (!format.compressed) return true;
+
+  GLint count{};
+  abcg::glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+  std::vector<GLint> formats(static_cast<std::size_t>(std::max(count, 0)));
+  abcg::glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+  const auto internalFormat{static_cast<GLint>(format.internalFormat)};
+  return std::ranges::find(formats, internalFormat) != formats.end();
+}
+
+std::size_t alignUp(std::size_t value, std::size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// Basic data format descriptor (Khronos Data Format 1.3) for the formats
+// we write
+std::vector<std::uint32_t> makeDataFormatDescriptor(
+    const TextureFormat& format) {
+  struct Sample {
+    std::uint32_t bitOffset{};
+    std::uint32_t bitLength{};
+    std::uint32_t channel{};
+    std::uint32_t upper{};
+  };
+  std::vector<Sample> samples;
+  std::uint32_t colorModel{};
+  std::uint32_t blockDimension{};
+  if (format.compressed) {
+    colorModel = 134;  // KHR_DF_MODEL_BC7
+    blockDimension = 3;
+    samples.push_back({0, 128, 0, 0xFFFFFFFFU});
+  } else {
+    colorModel = 1;  // KHR_DF_MODEL_RGBSDA
+    samples = {
+        {0, 8, 0, 255}, {8, 8, 1, 255}, {16, 8, 2, 255}, {24, 8, 15, 255}};
+  }
+
+  const auto blockSize{static_cast<std::uint32_t>(24 + 16 * samples.size())};
+  std::vector<std::uint32_t> words{
+      4 + blockSize,
+      0,                     // Khronos vendor, basic descriptor
+      2U | blockSize << 16,  // Version 1.3
+      colorModel | 1U << 8 | 1U << 16,  // BT.709 primaries, linear
+      blockDimension | blockDimension << 8,
+      format.blockBytes,
+      0};
+  for (const auto& sample : samples) {
+    words.push_back(sample.bitOffset | (sample.bitLength - 1) << 16 |
+                    sample.channel << 24);
+    words.push_back(0);
+    words.push_back(0);
+    words.push_back(sample.upper);
+  }
+  return words;
+}
+
+template <typename T>
+void appendBytes(std::vector<std::byte>& bytes, const T& value) {
+  const auto* begin{reinterpret_cast<const std::byte*>(&value)};
+  bytes.insert(bytes.end(), begin, begin + sizeof(T));
+}
+
+void appendKeyValue(std::vector<std::byte>& bytes, std::string_view key,
+                    std::span<const std::byte> value) {
+  const auto length{static_cast<std::uint32_t>(key.size() + 1 + value.size())};
+  appendBytes(bytes, length);
+  const auto* keyBytes{reinterpret_cast<const std::byte*>(key.data())};
+  bytes.insert(bytes.end(), keyBytes, keyBytes + key.size());
+  bytes.push_back(std::byte{});
+  bytes.insert(bytes.end(), value.begin(), value.end());
+  bytes.resize(alignUp(bytes.size(), 4));
+}
+
+bool writeKtx2(std::string_view path, const MeshCacheKey& key,
+               const TextureImage& image) {
+  const auto numLevels{image.levels.size()};
+  const auto dfd{makeDataFormatDescriptor(image.format)};
+
+  // Keys are sorted by their UTF-8 bytes
+  std::vector<std::byte> kvd;
+  std::string writer{writerName};
+  writer.push_back('\0');
+  appendKeyValue(kvd, writerKeyName,
+                 std::as_bytes(std::span{writer.data(), writer.size()}));
+  appendKeyValue(kvd, sourceKeyName, std::as_bytes(std::span{&key, 1}));
+
+  Ktx2Header header;
+  header.identifier = ktx2Identifier;
+  header.vkFormat = image.format.vkFormat;
+  header.typeSize = 1;
+  header.pixelWidth = image.width;
+  header.pixelHeight = image.height;
+  header.faceCount = 1;
+  header.levelCount = static_cast<std::uint32_t>(numLevels);
+  header.dfdByteOffset = static_cast<std::uint32_t>(
+      sizeof(Ktx2Header) + numLevels * sizeof(Ktx2Level));
+  header.dfdByteLength = static_cast<std::uint32_t>(dfd.size() * 4);
+  header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+  header.kvdByteLength = static_cast<std::uint32_t>(kvd.size());
+
+  // Level data goes smallest first, each aligned to the block size
+  std::vector<Ktx2Level> levelIndex(numLevels);
+  auto offset{std::size_t{header.kvdByteOffset} + kvd.size()};
+  for (auto level{numLevels}; level-- > 0;) {
+    offset = alignUp(offset, image.format.blockBytes);
+    levelIndex[level] = {offset, image.levels[level].size(),
+                         image.levels[level].size()};
+    offset += image.levels[level].size();
+  }
+
+  const auto temporaryPath{std::string{path} + ".tmp"};
+  {
+    std::ofstream stream{temporaryPath, std::ios::binary | std::ios::trunc};
+    if (!stream) return false;
+
+    std::vector<std::byte> bytes;
+    appendBytes(bytes, header);
+    for (const auto& level : levelIndex) appendBytes(bytes, level);
+    for (const auto word : dfd) appendBytes(bytes, word);
+    bytes.insert(bytes.end(), kvd.begin(), kvd.end());
+    stream.write(reinterpret_cast<const char*>(bytes.data()),
+                 static_cast<std::streamsize>(bytes.size()));
+
+    auto position{bytes.size()};
+    for (auto level{numLevels}; level-- > 0;) {
+      static constexpr std::array<char, 16> padding{};
+      const auto paddingSize{levelIndex[level].byteOffset - position};
+      stream.write(padding.data(), static_cast<std::streamsize>(paddingSize));
+      stream.write(reinterpret_cast<const char*>(image.levels[level].data()),
+                   static_cast<std::streamsize>(image.levels[level].size()));
+      position = levelIndex[level].byteOffset + levelIndex[level].byteLength;
+    }
+    if (!stream) {
+      stream.close();
+      std::filesystem::remove(temporaryPath);
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temporaryPath, path, error);
+  if (error) std::filesystem::remove(temporaryPath, error);
+  return !error;
+}
+
+// Returns nothing if the file is missing, invalid, of an unknown format or
+// built from another version of the image. Files without our source key
+// were made offline and are trusted to be of the image, though they are
+// checked like any other.
+std::optional<TextureImage> readKtx2(std::string_view path,
+                                     const MeshCacheKey& key) {
+  std::ifstream stream{std::string{path}, std::ios::binary | std::ios::ate};
+  if (!stream) return std::nullopt;
+  std::vector<std::byte> bytes(static_cast<std::size_t>(stream.tellg()));
+  stream.seekg(0);
+  stream.read(reinterpret_cast<char*>(bytes.data()),
+              static_cast<std::streamsize>(bytes.size()));
+  if (!stream || bytes.size() < sizeof(Ktx2Header)) return std::nullopt;
+
+  Ktx2Header header;
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  const auto format{findFormat(header.vkFormat)};
+  if (header.identifier != ktx2Identifier || !format ||
+      header.pixelWidth == 0 || header.pixelHeight == 0 ||
+      header.pixelWidth > maxTextureSize ||
+      header.pixelHeight > maxTextureSize || header.pixelDepth != 0 ||
+      header.layerCount > 1 || header.faceCount != 1 ||
+      header.supercompressionScheme != 0) {
+    return std::nullopt;
+  }
+
+  // Key-value data
+  const auto kvdEnd{std::size_t{header.kvdByteOffset} + header.kvdByteLength};
+  if (kvdEnd > bytes.size()) return std::nullopt;
+  for (auto offset{std::size_t{header.kvdByteOffset}}; offset + 4 <= kvdEnd;) {
+    std::uint32_t length{};
+    std::memcpy(&length, &bytes[offset], 4);
+    offset += 4;
+    if (offset + length > kvdEnd) return std::nullopt;
+
+    const std::string_view entry{reinterpret_cast<const char*>(&bytes[offset]),
+                                 length};
+    if (entry.starts_with(sourceKeyName) &&
+        entry.size() > sourceKeyName.size() &&
+        entry[sourceKeyName.size()] == '\0') {
+      MeshCacheKey storedKey;
+      if (entry.size() != sourceKeyName.size() + 1 + sizeof(storedKey)) {
+        return std::nullopt;
+      }
+      std::memcpy(&storedKey, entry.data() + sourceKeyName.size() + 1,
+                  sizeof(storedKey));
+      if (!(storedKey == key)) return std::nullopt;
+    }
+    offset = alignUp(offset + length, 4);
+  }
+
+  TextureImage image;
+  image.format = *format;
+  image.width = header.pixelWidth;
+  image.height = header.pixelHeight;
+
+  // No more levels than the full chain has, and each exactly as large as
+  // its size and format imply, since uploads read that much
+  const auto numLevels{std::max(header.levelCount, 1U)};
+  if (numLevels > static_cast<std::uint32_t>(std::bit_width(
+                      std::max(header.pixelWidth, header.pixelHeight)))) {
+    return std::nullopt;
+  }
+  const auto levelIndexEnd{sizeof(Ktx2Header) +
+                           std::size_t{numLevels} * sizeof(Ktx2Level)};
+  if (levelIndexEnd > bytes.size()) return std::nullopt;
+  image.levels.resize(numLevels);
+  for (const auto level : iter::range(image.levels.size())) {
+    Ktx2Level entry;
+    std::memcpy(&entry, &bytes[sizeof(Ktx2Header) + level * sizeof(Ktx2Level)],
+                sizeof(entry));
+    if (entry.byteOffset > bytes.size() ||
+        entry.byteLength > bytes.size() - entry.byteOffset ||
+        entry.byteLength != levelByteLength(*format, image.width,
+                                            image.height, level)) {
+      return std::nullopt;
+    }
+    const auto begin{bytes.begin() +
+                     static_cast<std::ptrdiff_t>(entry.byteOffset)};
+    image.levels[level].assign(
+        begin, begin + static_cast<std::ptrdiff_t>(entry.byteLength));
+  }
+  return image;
+}
+
+// Uploads one image as a 2D texture, or images of the same format and size
+// as the layers of a 2D array texture
+GLuint uploadTexture(std::span<const TextureImage> images, GLenum target) {
+  const auto& first{images.front()};
+  const auto numLayers{static_cast<GLsizei>(images.size())};
+
+  GLuint texture{};
+  abcg::glGenTextures(1, &texture);
+  abcg::glBindTexture(target, texture);
+  abcg::glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  std::vector<std::byte> layers;
+  for (const auto level : iter::range(first.levels.size())) {
+    const auto width{static_cast<GLsizei>(std::max(1U, first.width >> level))};
+    const auto height{
+        static_cast<GLsizei>(std::max(1U, first.height >> level))};
+
+    // Array levels take the level of every layer at once
+    std::span<const std::byte> data{first.levels[level]};
+    if (target == GL_TEXTURE_2D_ARRAY) {
+      layers.clear();
+      for (const auto& image : images) {
+        layers.insert(layers.end(), image.levels[level].begin(),
+                      image.levels[level].end());
+      }
+      data = layers;
+    }
+
+    const auto glLevel{static_cast<GLint>(level)};
+    const auto size{static_cast<GLsizei>(data.size())};
+    if (target == GL_TEXTURE_2D_ARRAY && first.format.compressed) {
+      abcg::glCompressedTexImage3D(target, glLevel, first.format.internalFormat,
+                                   width, height, numLayers, 0, size,
+                                   data.data());
+    } else if (target == GL_TEXTURE_2D_ARRAY) {
+      abcg::glTexImage3D(target, glLevel,
+                         static_cast<GLint>(first.format.internalFormat), width,
+                         height, numLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                         data.data());
+    } else if (first.format.compressed) {
+      abcg::glCompressedTexImage2D(target, glLevel, first.format.internalFormat,
+                                   width, height, 0, size, data.data());
+    } else {
+      abcg::glTexImage2D(target, glLevel,
+                         static_cast<GLint>(first.format.internalFormat), width,
+                         height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+    }
+  }
+
+  // A single uncompressed level (e.g. from an offline tool) gets its chain
+  // built here
+  if (first.levels.size() == 1 && !first.format.compressed) {
+    abcg::glGenerateMipmap(target);
+  } else {
+    abcg::glTexParameteri(target, GL_TEXTURE_MAX_LEVEL,
+                          static_cast<GLint>(first.levels.size() - 1));
+  }
+
+  abcg::glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  abcg::glBindTexture(target, 0);
+  return texture;
+}
+
+// Decodes an image to RGBA8 with the bottom row first, as
+// abcg::opengl::loadTexture uploads it
+std::optional<TextureImage> decodeImage(std::string_view path) {
+  auto* surface{IMG_Load(std::string{path}.c_str())};
+  if (surface == nullptr) return std::nullopt;
+  auto* rgbaSurface{
+      SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0)};
+  SDL_FreeSurface(surface);
+  if (rgbaSurface == nullptr) return std::nullopt;
+
+  TextureImage image;
+  image.format = rgba8Format;
+  image.width = static_cast<std::uint32_t>(rgbaSurface->w);
+  image.height = static_cast<std::uint32_t>(rgbaSurface->h);
+  auto& pixels{image.levels.emplace_back(std::size_t{image.width} *
+                                         image.height * 4)};
+  const auto rowSize{std::size_t{image.width} * 4};
+  const auto* rows{static_cast<const std::byte*>(rgbaSurface->pixels)};
+  for (const auto row : iter::range(std::size_t{image.height})) {
+    std::memcpy(&pixels[(image.height - 1 - row) * rowSize],
+                rows + row * static_cast<std::size_t>(rgbaSurface->pitch),
+                rowSize);
+  }
+  SDL_FreeSurface(rgbaSurface);
+  return image;
+}
+
+// Builds an RGBA8 array texture with each image scaled to the size of the
+// first one, for images that can't be uploaded as they are. Adds the size
+// of the texture data to memorySize.
+GLuint blitTextureArray(std::span<const std::string> paths,
+                        std::size_t& memorySize) {
+  std::vector<TextureImage> images;
+  for (const auto& path : paths) {
+    auto image{decodeImage(path)};
+    if (!image) {
+      throw abcg::Exception{abcg::Exception::Runtime(
+          fmt::format("Failed to load texture {}", path))};
+    }
+    images.push_back(std::move(*image));
+  }
+  const auto width{static_cast<GLint>(images.front().width)};
+  const auto height{static_cast<GLint>(images.front().height)};
+
+  GLuint texture{};
+  abcg::glGenTextures(1, &texture);
+  abcg::glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  abcg::glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height,
+                     static_cast<GLsizei>(images.size()), 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, nullptr);
+
+  std::array<GLuint, 2> framebuffers{};
+  abcg::glGenFramebuffers(2, framebuffers.data());
+  abcg::glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+  abcg::glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[1]);
+  for (const auto layer : iter::range(images.size())) {
+    const auto& image{images[layer]};
+    const auto source{uploadTexture(std::span{&image, 1}, GL_TEXTURE_2D)};
+    abcg::glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                 GL_TEXTURE_2D, source, 0);
+    abcg::glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                    texture, 0, static_cast<GLint>(layer));
+    abcg::glBlitFramebuffer(0, 0, static_cast<GLint>(image.width),
+                            static_cast<GLint>(image.height), 0, 0, width,
+                            height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    abcg::glDeleteTextures(1, &source);
+  }
+  abcg::glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  abcg::glDeleteFramebuffers(2, framebuffers.data());
+
+  abcg::glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  abcg::glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+  abcg::glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  // Full mip chain of RGBA8 texels
+  for (auto levelWidth{width}, levelHeight{height};;) {
+    memorySize += std::size_t{4} * static_cast<std::size_t>(levelWidth) *
+                  static_cast<std::size_t>(levelHeight) * images.size();
+    if (levelWidth == 1 && levelHeight == 1) break;
+    levelWidth = std::max(levelWidth / 2, 1);
+    levelHeight = std::max(levelHeight / 2, 1);
+  }
+  return texture;
+}
+
+#if !defined(__EMSCRIPTEN__)
+// Reads back the mip chain of a texture, compressed to BC7 by the driver if
+// it supports the format. WebGL can't read textures back.
+std::optional<TextureImage> readBackTexture(GLuint texture) {
+  abcg::glBindTexture(GL_TEXTURE_2D, texture);
+  GLint width{};
+  GLint height{};
+  // Texture queries and readbacks are desktop only, so abcg has no wrappers
+  // for them
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+  if (width <= 0 || height <= 0) return std::nullopt;
+  abcg::glGenerateMipmap(GL_TEXTURE_2D);
+
+  TextureImage image;
+  image.format = rgba8Format;
+  image.width = static_cast<std::uint32_t>(width);
+  image.height = static_cast<std::uint32_t>(height);
+  image.levels.resize(
+      std::bit_width(static_cast<unsigned>(std::max(width, height))));
+
+  abcg::glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  for (const auto level : iter::range(image.levels.size())) {
+    const auto levelWidth{std::max(1U, image.width >> level)};
+    const auto levelHeight{std::max(1U, image.height >> level)};
+    image.levels[level].resize(std::size_t{levelWidth} * levelHeight * 4);
+    glGetTexImage(GL_TEXTURE_2D, static_cast<GLint>(level), GL_RGBA,
+                  GL_UNSIGNED_BYTE, image.levels[level].data());
+  }
+  abcg::glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+  if (isFormatSupported(bc7Format)) {
+    GLuint compressed{};
+    abcg::glGenTextures(1, &compressed);
+    abcg::glBindTexture(GL_TEXTURE_2D, compressed);
+    for (const auto level : iter::range(image.levels.size())) {
+      abcg::glTexImage2D(
+          GL_TEXTURE_2D, static_cast<GLint>(level),
+          static_cast<GLint>(bc7Format.internalFormat),
+          static_cast<GLsizei>(std::max(1U, image.width >> level)),
+          static_cast<GLsizei>(std::max(1U, image.height >> level)), 0,
+          GL_RGBA, GL_UNSIGNED_BYTE, image.levels[level].data());
+    }
+
+    GLint isCompressed{};
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED,
+                             &isCompressed);
+    if (isCompressed == GL_TRUE) {
+      std::vector<std::vector<std::byte>> levels(image.levels.size());
+      for (const auto level : iter::range(levels.size())) {
+        GLint size{};
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, static_cast<GLint>(level),
+                                 GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+        levels[level].resize(static_cast<std::size_t>(size));
+        glGetCompressedTexImage(GL_TEXTURE_2D, static_cast<GLint>(level),
+                                levels[level].data());
+      }
+      image.format = bc7Format;
+      image.levels = std::move(levels);
+    }
+    abcg::glDeleteTextures(1, &compressed);
+  }
+
+  abcg::glBindTexture(GL_TEXTURE_2D, 0);
+  return image;
+}
+#endif
+
+// Mip chain of an image from its KTX2 file, which is created first on
+// desktop GL. Returns nothing if the image must be decoded in the usual way.
+std::optional<TextureImage> loadImage(std::string_view path) {
+  const auto cachePath{textureCachePath(path)};
+  const auto key{MeshCacheKey::fromFile(path, 0)};
+
+  if (auto image{readKtx2(cachePath, key)};
+      image && isFormatSupported(image->format)) {
+    return image;
+  }
+
+#if !defined(__EMSCRIPTEN__)
+  const auto texture{abcg::opengl::loadTexture(path)};
+  auto image{readBackTexture(texture)};
+  abcg::glDeleteTextures(1, &texture);
+  if (image && !writeKtx2(cachePath, key, *image)) {
+    fmt::print("Warning: could not write texture cache {}\n", cachePath);
+  }
+  return image;
+#else
+  return std::nullopt;
+#endif
+}
+
+}  // namespace
+
+std::string textureCachePath(std::string_view sourcePath) {
+  return std::string{sourcePath} + ".ktx2";
+}
+
+GLuint loadTextureCached(std::string_view path) {
+  if (const auto image{loadImage(path)}) {
+    return uploadTexture(std::span{&*image, 1}, GL_TEXTURE_2D);
+  }
+  return abcg::opengl::loadTexture(path);
+}
+
+GLuint loadTextureArrayCached(std::span<const std::string> paths,
+                              std::size_t* memorySize) {
+  std::size_t size{};
+  if (memorySize != nullptr) *memorySize = 0;
+  if (paths.empty()) return 0;
+
+  std::vector<TextureImage> images;
+  for (const auto& path : paths) {
+    auto image{loadImage(path)};
+    if (!image) break;
+    images.push_back(std::move(*image));
+  }
+
+  const auto matchesFirst{[&](const TextureImage& image) {
+    const auto& first{images.front()};
+    return image.format.vkFormat == first.format.vkFormat &&
+           image.width == first.width && image.height == first.height &&
+           image.levels.size() == first.levels.size();
+  }};
+  if (images.size() == paths.size() &&
+      std::ranges::all_of(images, matchesFirst)) {
+    for (const auto& image : images) {
+      for (const auto& level : image.levels) size += level.size();
+    }
+    if (memorySize != nullptr) *memorySize = size;
+    return uploadTexture(images, GL_TEXTURE_2D_ARRAY);
+  }
+
+  const auto texture{blitTextureArray(paths, size)};
+  if (memorySize != nullptr) *memorySize = size;
+  return texture;
+}
@@ -0,0 +1,29 @@
+#ifndef TEXTURECACHE_HPP_
+#define TEXTURECACHE_HPP_
+
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "abcg.hpp"
+
+// Path of the KTX2 file stored next to a source image
+std::string textureCachePath(std::string_view sourcePath);
+
+// Loads a 2D texture with a full mip chain from the KTX2 file next to the
+// image, skipping the image decode. Without one (or if it was built from
+// another version of the image), the image is decoded and, on desktop GL,
+// its mip chain is read back, compressed to BC7 by the driver when
+// supported (RGBA8 otherwise) and written to the KTX2 file for the next
+// run. KTX2 files made offline with BC7, ETC2 or RGBA8 data are used as is.
+GLuint loadTextureCached(std::string_view path);
+
+// Loads images as the layers of a 2D array texture, through the same KTX2
+// files as loadTextureCached. If the images differ in format or size (or
+// have no KTX2 file on WebGL), they are decoded, scaled to the size of the
+// first one and stored as RGBA8 instead. Returns 0 if paths is empty. If
+// memorySize isn't null, it's set to the bytes of texture data uploaded.
+GLuint loadTextureArrayCached(std::span<const std::string> paths,
+                              std::size_t* memorySize = nullptr);
+
+#endif
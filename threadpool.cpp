@@ -0,0 +1,179 @@
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cppitertools/itertools.hpp>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+ThreadPool::ThreadPool(std::size_t numThreads) {
+  if (numThreads == 0) {
+    numThreads = std::max(1U, std::thread::hardware_concurrency());
+  }
+
+  // The thread calling parallelFor is the remaining worker
+  m_workers.reserve(numThreads - 1);
+  for (std::size_t i{1}; i < numThreads; ++i) {
+    m_workers.emplace_back([this] { workerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    const std::scoped_lock lock{m_mutex};
+    m_stopping = true;
+  }
+  m_condition.notify_all();
+  for (auto& worker : m_workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::parallelFor(std::size_t count,
+                             const std::function<void(std::size_t)>& function) {
+  if (count == 0) return;
+
+  std::atomic<std::size_t> next{0};
+  std::exception_ptr firstError;
+  std::mutex errorMutex;
+
+  // Every participant claims indices until none are left
+  const auto run{[&] {
+    for (auto index{next++}; index < count; index = next++) {
+      try {
+        function(index);
+      } catch (...) {
+        const std::scoped_lock lock{errorMutex};
+        if (!firstError) firstError = std::current_exception();
+        next = count;
+      }
+    }
+  }};
+
+  // Helpers still queued behind another caller's work when this one is
+  // done skip it, so only those already running are waited for. The state
+  // they check outlives this call.
+  struct Helpers {
+    std::mutex mutex;
+    std::condition_variable done;
+    std::size_t running{};
+    bool closed{false};
+  };
+  const auto helpers{std::make_shared<Helpers>()};
+  const auto numHelpers{std::min(m_workers.size(), count - 1)};
+
+  {
+    const std::scoped_lock lock{m_mutex};
+    for (std::size_t i{}; i < numHelpers; ++i) {
+      m_tasks.emplace_back([helpers, &run] {
+        {
+          const std::scoped_lock helpersLock{helpers->mutex};
+          if (helpers->closed) return;
+          ++helpers->running;
+        }
+        run();
+        const std::scoped_lock helpersLock{helpers->mutex};
+        if (--helpers->running == 0) helpers->done.notify_one();
+      });
+    }
+  }
+  m_condition.notify_all();
+
+  run();
+
+  std::unique_lock helpersLock{helpers->mutex};
+  helpers->closed = true;
+  helpers->done.wait(helpersLock, [&] { return helpers->running == 0; });
+
+  if (firstError) std::rethrow_exception(firstError);
+}
+
+void ThreadPool::parallelForStealing(
+    std::size_t count, std::size_t grainSize,
+    const std::function<void(std::size_t, std::size_t)>& function) {
+  if (count == 0) return;
+  grainSize = std::max(grainSize, std::size_t{1});
+
+  // Ranges are packed as begin << 32 | end, so that owners and thieves can
+  // both update them with a single compare-and-swap
+  if (count > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::length_error{"parallelForStealing: too many indices"};
+  }
+  const auto pack{[](std::uint64_t begin, std::uint64_t end) {
+    return begin << 32 | end;
+  }};
+  const auto unpack{[](std::uint64_t range) {
+    return std::pair{range >> 32, range & 0xFFFFFFFFU};
+  }};
+
+  struct alignas(64) Share {
+    std::atomic<std::uint64_t> range;
+  };
+  const auto numShares{std::min(size(), (count + grainSize - 1) / grainSize)};
+  const auto shares{std::make_unique<Share[]>(numShares)};
+  for (const auto share : iter::range(numShares)) {
+    shares[share].range = pack(count * share / numShares,
+                               count * (share + 1) / numShares);
+  }
+
+  // Takes chunks from the front of a share until it is empty
+  const auto drain{[&](Share& share) {
+    auto range{share.range.load()};
+    while (true) {
+      const auto [begin, end]{unpack(range)};
+      if (begin >= end) return;
+      const auto chunkEnd{std::min(begin + grainSize, end)};
+      if (share.range.compare_exchange_weak(range, pack(chunkEnd, end))) {
+        function(begin, chunkEnd);
+        range = share.range.load();
+      }
+    }
+  }};
+
+  parallelFor(numShares, [&](std::size_t index) {
+    auto& own{shares[index]};
+    drain(own);
+    while (true) {
+      // Only shares worth splitting are stolen from; owners finish the rest
+      Share* victim{};
+      std::uint64_t victimRange{};
+      std::uint64_t mostRemaining{grainSize};
+      for (const auto share : iter::range(numShares)) {
+        const auto range{shares[share].range.load()};
+        const auto [begin, end]{unpack(range)};
+        if (begin < end && end - begin > mostRemaining) {
+          victim = &shares[share];
+          victimRange = range;
+          mostRemaining = end - begin;
+        }
+      }
+      if (victim == nullptr) return;
+
+      const auto [begin, end]{unpack(victimRange)};
+      const auto middle{begin + (end - begin) / 2};
+      if (victim->range.compare_exchange_strong(victimRange,
+                                                pack(begin, middle))) {
+        own.range = pack(middle, end);
+        drain(own);
+      }
+    }
+  });
+}
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock lock{m_mutex};
+      m_condition.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+      if (m_stopping && m_tasks.empty()) return;
+      task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+    }
+    task();
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+ public:
+  // Zero threads means one per hardware thread
+  explicit ThreadPool(std::size_t numThreads = 0);
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ~ThreadPool();
+
+  // Number of threads taking part in parallelFor, including the caller
+  [[nodiscard]] std::size_t size() const { return m_workers.size() + 1; }
+
+  // Calls function(i) for every i in [0, count) and blocks until all calls
+  // return. The calling thread takes part in the work. The first exception
+  // thrown by any call is rethrown here. Must not be nested, but several
+  // threads may call it at once.
+  void parallelFor(std::size_t count,
+                   const std::function<void(std::size_t)>& function);
+
+  // Calls function(begin, end) on chunks of at most grainSize indices that
+  // together cover [0, count), for work whose cost varies a lot per index.
+  // Each participant starts on its own contiguous share; once done, it
+  // steals the back half of the fullest share left. Neighboring indices
+  // mostly stay on one thread. Blocks and rethrows like parallelFor.
+  void parallelForStealing(
+      std::size_t count, std::size_t grainSize,
+      const std::function<void(std::size_t, std::size_t)>& function);
+
+ private:
+  std::vector<std::thread> m_workers;
+  std::deque<std::function<void()>> m_tasks;
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  bool m_stopping{false};
+
+  void workerLoop();
+};
+
+#endif
@@ -0,0 +1,40 @@
+#include "vertex.hpp"
+
+#include <bit>
+#include <glm/geometric.hpp>
+#include <glm/gtc/packing.hpp>
+
+namespace {
+
+// Maps a unit vector to the [-1, 1] square by projecting it onto the
+// octahedron |x| + |y| + |z| = 1 and folding the lower half outwards
+glm::vec2 encodeOctahedral(const glm::vec3& normal) {
+  const auto projected{normal / (std::abs(normal.x) + std::abs(normal.y) +
+                                 std::abs(normal.z))};
+  if (projected.z >= 0.0f) return {projected.x, projected.y};
+
+  const auto signX{projected.x >= 0.0f ? 1.0f : -1.0f};
+  const auto signY{projected.y >= 0.0f ? 1.0f : -1.0f};
+  return {(1.0f - std::abs(projected.y)) * signX,
+          (1.0f - std::abs(projected.x)) * signY};
+}
+
+}  // namespace
+
+PackedVertex packVertex(const Vertex& vertex) {
+  PackedVertex packed;
+
+  const auto position{glm::packSnorm4x16(
+      glm::vec4(glm::clamp(vertex.position, -1.0f, 1.0f), 0.0f))};
+  packed.position = std::bit_cast<std::array<std::int16_t, 4>>(position);
+
+  const auto length{glm::length(vertex.normal)};
+  const auto normal{glm::packSnorm2x16(
+      length > 0.0f ? encodeOctahedral(vertex.normal / length) : glm::vec2{})};
+  packed.normal = std::bit_cast<std::array<std::int16_t, 2>>(normal);
+
+  const auto texCoord{glm::packHalf2x16(vertex.texCoord)};
+  packed.texCoord = std::bit_cast<std::array<std::uint16_t, 2>>(texCoord);
+
+  return packed;
+}
@@ -0,0 +1,38 @@
+#ifndef VERTEX_HPP_
+#define VERTEX_HPP_
+
+#include <array>
+#include <cstdint>
+#include <glm/gtc/epsilon.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <limits>
+
+struct Vertex {
+  glm::vec3 position{};
+  glm::vec3 normal{};
+  glm::vec2 texCoord{};
+
+  bool operator==(const Vertex& other) const noexcept {
+    static const auto epsilon{std::numeric_limits<float>::epsilon()};
+    return glm::all(glm::epsilonEqual(position, other.position, epsilon)) &&
+           glm::all(glm::epsilonEqual(normal, other.normal, epsilon)) &&
+           glm::all(glm::epsilonEqual(texCoord, other.texCoord, epsilon));
+  }
+};
+
+// Layout of the vertex buffer, chosen at load time
+enum class VertexFormat { Float, Packed };
+
+// 16-byte alternative to Vertex. Positions are snorm16 and must lie in
+// [-1, 1] (Model quantizes them against the mesh bounds), normals are
+// octahedral snorm16 and texture coordinates are half floats.
+struct PackedVertex {
+  std::array<std::int16_t, 4> position{};  // w is padding
+  std::array<std::int16_t, 2> normal{};
+  std::array<std::uint16_t, 2> texCoord{};
+};
+
+PackedVertex packVertex(const Vertex& vertex);
+
+#endif
@@ -0,0 +1,273 @@
+#include "vertexwelder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cppitertools/itertools.hpp>
+
+#include "threadpool.hpp"
+
+namespace {
+
+constexpr std::uint32_t emptySlot{std::numeric_limits<std::uint32_t>::max()};
+
+struct Key {
+  std::array<std::uint32_t, 8> words{};
+
+  bool operator==(const Key& other) const = default;
+};
+
+class Quantizer {
+ public:
+  explicit Quantizer(int bits)
+      : m_half{bits > 0 ? 1U << (bits - 1) : 0U}, m_mask{~((1U << bits) - 1U)} {}
+
+  [[nodiscard]] Key key(const Vertex& vertex) const {
+    return {{quantize(vertex.position.x), quantize(vertex.position.y),
+             quantize(vertex.position.z), quantize(vertex.normal.x),
+             quantize(vertex.normal.y), quantize(vertex.normal.z),
+             quantize(vertex.texCoord.x), quantize(vertex.texCoord.y)}};
+  }
+
+ private:
+  std::uint32_t m_half{};
+  std::uint32_t m_mask{};
+
+  // Rounds the mantissa to nearest; -0 and +0 share a key
+  [[nodiscard]] std::uint32_t quantize(float value) const {
+    const auto bits{std::bit_cast<std::uint32_t>(value)};
+    const auto magnitude{((bits & 0x7FFFFFFFU) + m_half) & m_mask};
+    return magnitude == 0 ? 0 : (bits & 0x80000000U) | magnitude;
+  }
+};
+
+std::uint64_t hashKey(const Key& key) {
+  std::uint64_t hash{0x9E3779B97F4A7C15ULL};
+  for (const auto word : key.words) {
+    hash = (hash ^ word) * 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 31;
+  }
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+// Linear-probing table from quantized key to the first corner with that key.
+// Slots hold the corner and the upper half of its hash, so most mismatches
+// are rejected without rebuilding the stored corner's key.
+class WeldTable {
+ public:
+  explicit WeldTable(std::size_t expectedSize) {
+    resize(std::bit_ceil(std::max<std::size_t>(expectedSize * 2, 64)));
+  }
+
+  template <typename KeyOf>
+  std::uint32_t findOrInsert(std::uint64_t hash, const Key& key,
+                             std::uint32_t corner, const KeyOf& keyOf) {
+    if ((m_size + 1) * 2 > m_slots.size()) grow(keyOf);
+
+    const auto tag{static_cast<std::uint32_t>(hash >> 32)};
+    for (auto slot{hash & m_mask};; slot = (slot + 1) & m_mask) {
+      auto& entry{m_slots[slot]};
+      if (entry.corner == emptySlot) {
+        entry = {tag, corner};
+        ++m_size;
+        return corner;
+      }
+      if (entry.tag == tag && keyOf(entry.corner) == key) return entry.corner;
+    }
+  }
+
+ private:
+  struct Slot {
+    std::uint32_t tag{};
+    std::uint32_t corner{emptySlot};
+  };
+
+  std::vector<Slot> m_slots;
+  std::size_t m_mask{};
+  std::size_t m_size{};
+
+  void resize(std::size_t capacity) {
+    m_slots.assign(capacity, Slot{});
+    m_mask = capacity - 1;
+    m_size = 0;
+  }
+
+  template <typename KeyOf>
+  void grow(const KeyOf& keyOf) {
+    const auto previous{std::move(m_slots)};
+    resize(previous.size() * 2);
+    for (const auto& entry : previous) {
+      if (entry.corner == emptySlot) continue;
+      const auto hash{hashKey(keyOf(entry.corner))};
+      auto slot{hash & m_mask};
+      while (m_slots[slot].corner != emptySlot) slot = (slot + 1) & m_mask;
+      m_slots[slot] = entry;
+      ++m_size;
+    }
+  }
+};
+
+// Finds the first corner sharing the key of each of the given corners.
+// Corners must be listed in increasing order.
+template <typename CornerIds>
+void findRepresentatives(std::span<const Vertex> corners, const CornerIds& ids,
+                         std::size_t count, const Quantizer& quantizer,
+                         std::vector<std::uint32_t>& representatives) {
+  // Triangle meshes have about one vertex per six corners
+  WeldTable table{count / 4};
+  const auto keyOf{[&](std::uint32_t corner) {
+    return quantizer.key(corners[corner]);
+  }};
+
+  for (const auto i : iter::range(count)) {
+    const auto corner{static_cast<std::uint32_t>(ids(i))};
+    const auto key{quantizer.key(corners[corner])};
+    representatives[corner] =
+        table.findOrInsert(hashKey(key), key, corner, keyOf);
+  }
+}
+
+// Numbers unique vertices in order of first appearance and writes the
+// output arrays. With a pool, this is a parallel prefix sum over blocks.
+void buildOutput(std::span<const Vertex> corners,
+                 const std::vector<std::uint32_t>& representatives,
+                 std::vector<Vertex>& vertices,
+                 std::vector<std::uint32_t>& indices, ThreadPool* pool) {
+  const auto numCorners{corners.size()};
+  const auto numBlocks{pool == nullptr ? std::size_t{1} : pool->size() * 4};
+  const auto blockSize{(numCorners + numBlocks - 1) / numBlocks};
+  const auto forEachBlock{[&](const auto& function) {
+    if (pool == nullptr) {
+      function(0);
+    } else {
+      pool->parallelFor(numBlocks, function);
+    }
+  }};
+  const auto blockRange{[&](std::size_t block) {
+    return std::pair{std::min(block * blockSize, numCorners),
+                     std::min((block + 1) * blockSize, numCorners)};
+  }};
+
+  // Count unique vertices per block
+  std::vector<std::uint32_t> firsts(numBlocks + 1);
+  forEachBlock([&](std::size_t block) {
+    const auto [begin, end]{blockRange(block)};
+    std::uint32_t count{};
+    for (const auto corner : iter::range(begin, end)) {
+      if (representatives[corner] == corner) ++count;
+    }
+    firsts[block + 1] = count;
+  });
+  for (const auto block : iter::range(numBlocks)) {
+    firsts[block + 1] += firsts[block];
+  }
+
+  // Assign vertex indices to representatives, then to every corner
+  vertices.resize(firsts.back());
+  indices.resize(numCorners);
+  forEachBlock([&](std::size_t block) {
+    const auto [begin, end]{blockRange(block)};
+    auto next{firsts[block]};
+    for (const auto corner : iter::range(begin, end)) {
+      if (representatives[corner] == corner) {
+        vertices[next] = corners[corner];
+        indices[corner] = next++;
+      }
+    }
+  });
+  forEachBlock([&](std::size_t block) {
+    const auto [begin, end]{blockRange(block)};
+    for (const auto corner : iter::range(begin, end)) {
+      if (representatives[corner] != corner) {
+        indices[corner] = indices[representatives[corner]];
+      }
+    }
+  });
+}
+
+}  // namespace
+
+VertexWelder::VertexWelder(int quantizationBits)
+    : m_quantizationBits{std::clamp(quantizationBits, 0, 16)} {}
+
+void VertexWelder::weld(std::span<const Vertex> corners,
+                        std::vector<Vertex>& vertices,
+                        std::vector<std::uint32_t>& indices) const {
+  const Quantizer quantizer{m_quantizationBits};
+  std::vector<std::uint32_t> representatives(corners.size());
+  findRepresentatives(
+      corners, [](std::size_t i) { return i; }, corners.size(), quantizer,
+      representatives);
+  buildOutput(corners, representatives, vertices, indices, nullptr);
+}
+
+void VertexWelder::weld(std::span<const Vertex> corners,
+                        std::vector<Vertex>& vertices,
+                        std::vector<std::uint32_t>& indices,
+                        ThreadPool& pool) const {
+  const Quantizer quantizer{m_quantizationBits};
+  const auto numCorners{corners.size()};
+
+  // Partitions are selected by the top bits of the hash, and the table
+  // slots by the low bits, so partitions don't skew table occupancy
+  const auto numPartitions{
+      std::min<std::size_t>(std::bit_ceil(pool.size() * 4), 256)};
+  const auto partitionShift{64 - std::countr_zero(numPartitions)};
+  const auto numBlocks{pool.size() * 4};
+  const auto blockSize{(numCorners + numBlocks - 1) / numBlocks};
+
+  // Histogram of partitions per block of corners
+  std::vector<std::uint8_t> partitionOf(numCorners);
+  std::vector<std::size_t> offsets(numBlocks * numPartitions);
+  pool.parallelFor(numBlocks, [&](std::size_t block) {
+    const auto begin{std::min(block * blockSize, numCorners)};
+    const auto end{std::min(begin + blockSize, numCorners)};
+    auto* counts{&offsets[block * numPartitions]};
+    for (const auto corner : iter::range(begin, end)) {
+      const auto hash{hashKey(quantizer.key(corners[corner]))};
+      const auto partition{
+          numPartitions == 1 ? 0 : static_cast<std::size_t>(hash >> partitionShift)};
+      partitionOf[corner] = static_cast<std::uint8_t>(partition);
+      ++counts[partition];
+    }
+  });
+
+  // Exclusive prefix sum, partition-major, so each partition's corners are
+  // contiguous and stay in increasing order
+  std::vector<std::size_t> partitionBegin(numPartitions + 1);
+  std::size_t total{};
+  for (const auto partition : iter::range(numPartitions)) {
+    partitionBegin[partition] = total;
+    for (const auto block : iter::range(numBlocks)) {
+      auto& offset{offsets[block * numPartitions + partition]};
+      const auto count{offset};
+      offset = total;
+      total += count;
+    }
+  }
+  partitionBegin[numPartitions] = total;
+
+  std::vector<std::uint32_t> sortedCorners(numCorners);
+  pool.parallelFor(numBlocks, [&](std::size_t block) {
+    const auto begin{std::min(block * blockSize, numCorners)};
+    const auto end{std::min(begin + blockSize, numCorners)};
+    auto* next{&offsets[block * numPartitions]};
+    for (const auto corner : iter::range(begin, end)) {
+      sortedCorners[next[partitionOf[corner]]++] =
+          static_cast<std::uint32_t>(corner);
+    }
+  });
+
+  // Weld partitions independently; they share no keys
+  std::vector<std::uint32_t> representatives(numCorners);
+  pool.parallelFor(numPartitions, [&](std::size_t partition) {
+    const auto begin{partitionBegin[partition]};
+    findRepresentatives(
+        corners, [&](std::size_t i) { return sortedCorners[begin + i]; },
+        partitionBegin[partition + 1] - begin, quantizer, representatives);
+  });
+
+  buildOutput(corners, representatives, vertices, indices, &pool);
+}
@@ -0,0 +1,34 @@
+#ifndef VERTEXWELDER_HPP_
+#define VERTEXWELDER_HPP_
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "vertex.hpp"
+
+class ThreadPool;
+
+// Merges face corners whose position, normal and texture coordinates are
+// equal after quantization, using an open-addressing hash table with one
+// probe sequence per corner. Each attribute is rounded to its float
+// mantissa with the lowest quantizationBits bits cleared, so the tolerance
+// is relative to the value's magnitude. The first corner of each group is
+// kept unmodified and unique vertices are numbered in order of first
+// appearance, in both the sequential and the parallel mode.
+class VertexWelder {
+ public:
+  explicit VertexWelder(int quantizationBits = 4);
+
+  void weld(std::span<const Vertex> corners, std::vector<Vertex>& vertices,
+            std::vector<std::uint32_t>& indices) const;
+
+  // Partitions corners by hash and welds each partition on its own thread
+  void weld(std::span<const Vertex> corners, std::vector<Vertex>& vertices,
+            std::vector<std::uint32_t>& indices, ThreadPool& pool) const;
+
+ private:
+  int m_quantizationBits{};
+};
+
+#endif